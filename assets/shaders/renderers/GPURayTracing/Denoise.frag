@@ -0,0 +1,172 @@
+#version 430 core
+
+// Edge avoiding a-trous wavelet filter (Dammertz et al. 2010) with the luminance weight guided by the variance of every
+// pixel as in SVGF (Schied et al. 2017), the same filter as Denoiser on the CPU.
+//
+// Drawn once with demodulate set, which divides the albedo of the primary hit out of the mean of every pixel, and then
+// once per iteration, each one reading what the last one wrote. The last iteration multiplies the albedo back in
+
+layout(location = 0) out vec4 outIllumination; // Lighting in rgb and its variance in a, or the final color
+
+in vec2 normalizedPixelPosition;
+
+uniform bool demodulate;
+uniform bool remodulate;
+
+uniform int stepWidth;
+
+uniform float luminancePhi;
+uniform float normalPhi;
+uniform float depthPhi;
+
+// From the ray tracer, the albedo is in gamma space like the samples, and the distance is 0.0 where the primary ray missed
+uniform sampler2D accumulationBuffer;
+uniform sampler2D momentBuffer;
+uniform sampler2D primaryHitDistanceBuffer;
+uniform sampler2D normalBuffer;
+uniform sampler2D albedoBuffer;
+
+// What the last iteration wrote
+uniform sampler2D illuminationBuffer;
+
+// Below this many samples the variance from the moments is too noisy, it is estimated from the neighbours
+const float MIN_TEMPORAL_SAMPLES = 4.0;
+
+// B3 spline, the kernel gets wider by leaving holes between these taps
+const float KERNEL[5] = float[5](1.0 / 16.0, 1.0 / 4.0, 3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+
+float Luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+bool Missed(ivec2 pixel) {
+    return texelFetch(primaryHitDistanceBuffer, pixel, 0).r == 0.0;
+}
+
+// Dividing by black would lose the lighting
+vec3 Albedo(ivec2 pixel) {
+    return Missed(pixel) ? vec3(1.0) : max(texelFetch(albedoBuffer, pixel, 0).rgb, vec3(0.001));
+}
+
+bool OnScreen(ivec2 pixel) {
+    ivec2 size = textureSize(primaryHitDistanceBuffer, 0);
+    return all(greaterThanEqual(pixel, ivec2(0))) && all(lessThan(pixel, size));
+}
+
+vec3 DemodulatedMean(ivec2 pixel) {
+    vec4 accumulation = texelFetch(accumulationBuffer, pixel, 0);
+    return accumulation.rgb / max(accumulation.a, 1.0) / Albedo(pixel);
+}
+
+vec4 Demodulate(ivec2 pixel) {
+    vec4 accumulation = texelFetch(accumulationBuffer, pixel, 0);
+    float sampleCount = max(accumulation.a, 1.0);
+
+    vec3 illumination = DemodulatedMean(pixel);
+
+    float variance;
+    if (sampleCount >= MIN_TEMPORAL_SAMPLES) {
+        // Variance of the mean, from the variance of the samples
+        float meanLuminance = Luminance(accumulation.rgb) / sampleCount;
+        float sampleVariance = max(texelFetch(momentBuffer, pixel, 0).r / sampleCount - meanLuminance * meanLuminance, 0.0);
+
+        float albedoLuminance = Luminance(Albedo(pixel));
+
+        variance = sampleVariance / sampleCount / (albedoLuminance * albedoLuminance);
+    } else {
+        // Spread of the surrounding pixels on the same surface
+        bool missed = Missed(pixel);
+
+        float luminanceSum = 0.0;
+        float luminanceSquaredSum = 0.0;
+        float count = 0.0;
+
+        for (int y = -1; y <= 1; ++y) {
+            for (int x = -1; x <= 1; ++x) {
+                ivec2 neighbour = pixel + ivec2(x, y);
+
+                if (!OnScreen(neighbour) || Missed(neighbour) != missed) {
+                    continue;
+                }
+
+                float luminance = Luminance(DemodulatedMean(neighbour));
+
+                luminanceSum += luminance;
+                luminanceSquaredSum += luminance * luminance;
+                count += 1.0;
+            }
+        }
+
+        float mean = luminanceSum / count;
+        variance = max(luminanceSquaredSum / count - mean * mean, 0.0);
+    }
+
+    return vec4(illumination, variance);
+}
+
+vec4 Filter(ivec2 pixel) {
+    vec4 center = texelFetch(illuminationBuffer, pixel, 0);
+    float centerDepth = texelFetch(primaryHitDistanceBuffer, pixel, 0).r;
+
+    // Nothing was hit, the background has no noise to filter
+    if (centerDepth == 0.0) {
+        return center;
+    }
+
+    vec3 centerNormal = texelFetch(normalBuffer, pixel, 0).xyz;
+    float centerLuminance = Luminance(center.rgb);
+
+    float luminanceScale = luminancePhi * sqrt(center.a) + 1e-6;
+
+    vec3 colorSum = vec3(0.0);
+    float varianceSum = 0.0;
+    float weightSum = 0.0;
+
+    for (int y = -2; y <= 2; ++y) {
+        for (int x = -2; x <= 2; ++x) {
+            ivec2 neighbour = pixel + ivec2(x, y) * stepWidth;
+
+            if (!OnScreen(neighbour)) {
+                continue;
+            }
+
+            float neighbourDepth = texelFetch(primaryHitDistanceBuffer, neighbour, 0).r;
+
+            if (neighbourDepth == 0.0) {
+                continue;
+            }
+
+            vec4 illumination = texelFetch(illuminationBuffer, neighbour, 0);
+            vec3 neighbourNormal = texelFetch(normalBuffer, neighbour, 0).xyz;
+
+            float offsetLength = float(stepWidth) * length(vec2(x, y));
+
+            float normalWeight = pow(max(dot(centerNormal, neighbourNormal), 0.0), normalPhi);
+            float depthWeight = exp(-abs(centerDepth - neighbourDepth) / (depthPhi * centerDepth * offsetLength + 1e-6));
+            float luminanceWeight = exp(-abs(centerLuminance - Luminance(illumination.rgb)) / luminanceScale);
+
+            float weight = KERNEL[x + 2] * KERNEL[y + 2] * normalWeight * depthWeight * luminanceWeight;
+
+            colorSum += weight * illumination.rgb;
+            varianceSum += weight * weight * illumination.a;
+            weightSum += weight;
+        }
+    }
+
+    // The center always has a weight above zero
+    return vec4(colorSum / weightSum, varianceSum / (weightSum * weightSum));
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+    if (demodulate) {
+        outIllumination = Demodulate(pixel);
+        return;
+    }
+
+    vec4 illumination = Filter(pixel);
+
+    // A sample count of 1 in a, so the resolve can present it like an accumulation
+    outIllumination = remodulate ? vec4(illumination.rgb * Albedo(pixel), 1.0) : illumination;
+}
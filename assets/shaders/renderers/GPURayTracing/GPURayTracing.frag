@@ -3,6 +3,9 @@
 // Lots of code translated from Ray Tracing In One Weekend:
 // https://raytracing.github.io/books/RayTracingInOneWeekend.html
 
+// Also compiled as a compute shader with COMPUTE_SHADER, WORKGROUP_SIZE defined, which accumulates straight into an
+// image instead of drawing a fullscreen quad into a framebuffer
+
 //#define STATS
 
 struct Ray {
@@ -129,10 +132,62 @@ uniform float miliTime;
 uniform int screenWidth;
 uniform int screenHeight;
 
-out vec4 outFragColor;
+// The accumulation holds the sum of the samples in rgb and how many there are in a, the moments hold the sum of the
+// squared luminance of the samples, and the primary hit distance is how far the last primary ray went, 0.0 if it missed.
+// The normal and albedo of the primary hit are only read by the denoiser
+#ifdef COMPUTE_SHADER
+layout(local_size_x = WORKGROUP_SIZE, local_size_y = WORKGROUP_SIZE) in;
+
+layout(rgba32f, binding = 0) uniform image2D accumulationImage;
+layout(r32f, binding = 1) uniform image2D momentImage;
+layout(r32f, binding = 2) uniform image2D primaryHitDistanceImage;
+layout(rgba16f, binding = 3) uniform image2D normalImage;
+layout(rgba8, binding = 4) uniform image2D albedoImage;
+
+uniform int samplesPerPixel;
+#else
+layout(location = 0) out vec4 outFragColor;
+layout(location = 1) out float outMoment;
+layout(location = 2) out float outPrimaryHitDistance;
+layout(location = 3) out vec4 outNormal;
+layout(location = 4) out vec4 outAlbedo;
 
 in vec2 normalizedPixelPosition;
 
+uniform sampler2D accumulationBuffer;
+uniform sampler2D momentBuffer;
+#endif
+
+// Adaptive sampling, a pixel stops being traced once the standard error of its mean luminance is below
+// convergenceThreshold times the mean, or it has maximumSamples samples
+uniform bool adaptiveSampling;
+uniform int minimumSamples;
+uniform int maximumSamples;
+uniform float convergenceThreshold;
+
+layout(std430, binding = 5) buffer activePixelBuffer {
+    uint activePixels; // Pixels that were traced this frame
+};
+
+// Temporal reprojection, on the first frame after the camera moves every pixel starts from what was accumulated where
+// its primary hit was on screen before, see ReprojectHistory. The history textures are copies of the accumulation
+// textures from before the move
+uniform bool reproject;
+uniform mat4 previousViewProjection;
+uniform vec3 previousCameraPosition;
+uniform int historyLength;
+uniform float depthTolerance;
+
+uniform sampler2D historyAccumulationBuffer;
+uniform sampler2D historyMomentBuffer;
+uniform sampler2D historyPrimaryHitDistanceBuffer;
+
+// Of the last ray FireRayIntoScene was given, the distance is 0.0 when it missed everything
+vec3 primaryRayDirection;
+float primaryHitDistance;
+vec3 primaryHitNormal;
+vec3 primaryHitAlbedo; // In gamma space, like the samples
+
 uniform mat4 invView;
 uniform mat4 invProjection;
 
@@ -143,8 +198,6 @@ uniform vec3 backgroundColor;
 const float MAX_FLOAT = 3.402823466e+38F;
 const int MAX_INT = 2147483647;
 
-uniform sampler2D accumulationBuffer;
-
 uniform int maxBounces;
 
 vec3 FireRayIntoScene(Ray ray);
@@ -195,18 +248,92 @@ vec3 LinearToGamma(vec3 color) {
     return vec3(LinearToGamma(color.r), LinearToGamma(color.g), LinearToGamma(color.b));
 }
 
+float Luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+bool Converged(vec4 accumulation, float luminanceSquaredSum) {
+    float sampleCount = accumulation.a;
+
+    if (!adaptiveSampling || sampleCount < float(minimumSamples)) {
+        return false;
+    }
+
+    if (sampleCount >= float(maximumSamples)) {
+        return true;
+    }
+
+    float mean = Luminance(accumulation.rgb) / sampleCount;
+    float variance = max(luminanceSquaredSum / sampleCount - mean * mean, 0.0);
+
+    float standardError = sqrt(variance / sampleCount);
+
+    return standardError <= convergenceThreshold * max(mean, 1e-3);
+}
+
+// Replaces the accumulation with what was accumulated for the surface of the primary hit before the camera moved, or
+// nothing when it was off screen or hidden behind something else. The history is cut down to historyLength samples,
+// so shading that depends on the view catches up
+void ReprojectHistory(out vec4 accumulation, out float luminanceSquaredSum) {
+    accumulation = vec4(0.0);
+    luminanceSquaredSum = 0.0;
+
+    bool missed = primaryHitDistance == 0.0;
+    vec3 hitPosition = cameraPosition + primaryRayDirection * primaryHitDistance;
+
+    // What the ray missed is infinitely far away, only the rotation of the camera moves it on screen
+    vec4 previousClipPosition = missed ? previousViewProjection * vec4(primaryRayDirection, 0.0) : previousViewProjection * vec4(hitPosition, 1.0);
+
+    if (previousClipPosition.w <= 0.0) {
+        return;
+    }
+
+    vec2 previousNormalizedPosition = (previousClipPosition.xy / previousClipPosition.w) * 0.5 + 0.5;
+
+    if (any(lessThan(previousNormalizedPosition, vec2(0.0))) || any(greaterThanEqual(previousNormalizedPosition, vec2(1.0)))) {
+        return;
+    }
+
+    ivec2 previousPixel = ivec2(previousNormalizedPosition * vec2(screenWidth, screenHeight));
+
+    // Disocclusion, the previous pixel saw a different surface than this one does
+    float previousDistance = texelFetch(historyPrimaryHitDistanceBuffer, previousPixel, 0).r;
+
+    if (missed != (previousDistance == 0.0)) {
+        return;
+    }
+
+    if (!missed) {
+        float expectedDistance = length(hitPosition - previousCameraPosition);
+
+        if (abs(previousDistance - expectedDistance) > depthTolerance * expectedDistance) {
+            return;
+        }
+    }
+
+    accumulation = texelFetch(historyAccumulationBuffer, previousPixel, 0);
+    luminanceSquaredSum = texelFetch(historyMomentBuffer, previousPixel, 0).r;
+
+    // Scaling both sums keeps the mean and the variance
+    if (accumulation.a > float(historyLength)) {
+        float scale = float(historyLength) / accumulation.a;
+
+        accumulation *= scale;
+        luminanceSquaredSum *= scale;
+    }
+}
+
 bool NearZero(vec3 vec) {
     float epsilon = 1e-8;
     return (abs(vec.x) < epsilon) && (abs(vec.y) < epsilon) && (abs(vec.z) < epsilon);
 }
 
-void main() {
+// One jittered sample through the pixel, in gamma space or as the stats color
+vec3 TracePixel(vec2 normalizedPixelPosition) {
 #ifdef STATS
     stats = Stats(0, 0, 0, 0);
 #endif
 
-    randomState = normalizedPixelPosition.xy * miliTime * 3.4135;
-
     vec2 normalizedPixelCoordinate = normalizedPixelPosition;
 
     float normalizedPixelWidth = 1.0 / float(screenWidth);
@@ -235,9 +362,6 @@ void main() {
 
     pixelColor = LinearToGamma(pixelColor);
 
-    // Writing to accumulation buffer
-    vec3 accumulationColor = texture(accumulationBuffer, normalizedPixelPosition).rgb;
-
 #ifdef STATS
     float col;
     if (maxBboxChecks != -1) {
@@ -251,14 +375,97 @@ void main() {
     }
 
     pixelColor = vec3(col, 0.0, 0.0);
+#endif
+
+    return pixelColor;
+}
+
+#ifdef COMPUTE_SHADER
+void main() {
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+
+    // The dispatch is rounded up to whole workgroups
+    if (pixel.x >= screenWidth || pixel.y >= screenHeight) {
+        return;
+    }
+
+    vec4 accumulation = imageLoad(accumulationImage, pixel);
+    float luminanceSquaredSum = imageLoad(momentImage, pixel).r;
 
-    accumulationColor = pixelColor;
+    // When reprojecting the images are rebuilt, so every pixel has to be written
+    if (!reproject && Converged(accumulation, luminanceSquaredSum)) {
+        return;
+    }
+
+    atomicAdd(activePixels, 1u);
+
+    // The center of the pixel, like the interpolated position the fragment path gets. This also keeps the random
+    // state of pixel (0, 0) from starting at zero, which RandomFloat never moves away from
+    vec2 normalizedPixelPosition = (vec2(pixel) + 0.5) / vec2(screenWidth, screenHeight);
+
+    randomState = normalizedPixelPosition.xy * miliTime * 3.4135;
+
+    // Every sample continues the random state of the last one
+    vec3 sampleColor = vec3(0.0);
+    float sampleLuminanceSquaredSum = 0.0;
+    for (int i = 0; i < samplesPerPixel; ++i) {
+        vec3 color = TracePixel(normalizedPixelPosition);
+
+        sampleColor += color;
+        sampleLuminanceSquaredSum += Luminance(color) * Luminance(color);
+    }
+
+    if (reproject) {
+        ReprojectHistory(accumulation, luminanceSquaredSum);
+    }
+
+#ifdef STATS
+    accumulation = vec4(sampleColor / float(samplesPerPixel), 1.0);
 #else
-    accumulationColor += pixelColor;
+    accumulation += vec4(sampleColor, float(samplesPerPixel));
+#endif
+
+    imageStore(accumulationImage, pixel, accumulation);
+    imageStore(momentImage, pixel, vec4(luminanceSquaredSum + sampleLuminanceSquaredSum, 0.0, 0.0, 0.0));
+    imageStore(primaryHitDistanceImage, pixel, vec4(primaryHitDistance, 0.0, 0.0, 0.0));
+    imageStore(normalImage, pixel, vec4(primaryHitNormal, 0.0));
+    imageStore(albedoImage, pixel, vec4(primaryHitAlbedo, 1.0));
+}
+#else
+void main() {
+    vec4 accumulation = texelFetch(accumulationBuffer, ivec2(gl_FragCoord.xy), 0);
+    float luminanceSquaredSum = texelFetch(momentBuffer, ivec2(gl_FragCoord.xy), 0).r;
+
+    // Nothing is written, so the framebuffer keeps what the pixel has. When reprojecting the textures are rebuilt, so
+    // every pixel has to be written
+    if (!reproject && Converged(accumulation, luminanceSquaredSum)) {
+        discard;
+    }
+
+    atomicAdd(activePixels, 1u);
+
+    randomState = normalizedPixelPosition.xy * miliTime * 3.4135;
+
+    vec3 pixelColor = TracePixel(normalizedPixelPosition);
+
+    if (reproject) {
+        ReprojectHistory(accumulation, luminanceSquaredSum);
+    }
+
+    // Writing to accumulation buffer
+#ifdef STATS
+    accumulation = vec4(pixelColor, 1.0);
+#else
+    accumulation += vec4(pixelColor, 1.0);
 #endif
   
-    outFragColor = vec4(accumulationColor.rgb, 1.0);
+    outFragColor = accumulation;
+    outMoment = luminanceSquaredSum + Luminance(pixelColor) * Luminance(pixelColor);
+    outPrimaryHitDistance = primaryHitDistance;
+    outNormal = vec4(primaryHitNormal, 0.0);
+    outAlbedo = vec4(primaryHitAlbedo, 1.0);
 }
+#endif
 
 float reflectance(float cosine, float refractionIndex) {
     float r0 = (1.0 - refractionIndex) / (1.0 + refractionIndex);
@@ -272,6 +479,11 @@ vec3 FireRayIntoScene(Ray r) {
 
     Ray ray = r;
 
+    primaryRayDirection = r.direction;
+    primaryHitDistance = 0.0;
+    primaryHitNormal = vec3(0.0);
+    primaryHitAlbedo = vec3(1.0);
+
     int bounces = 0;
     while (true) {
         if (bounces >= maxBounces) {
@@ -280,13 +492,20 @@ vec3 FireRayIntoScene(Ray r) {
 
         HitInfo hitInfo;
         if (HitScene(ray, hitInfo)) { // Scatter the ray
-            
             ScatterInfo scatterInfo;
             scatterInfo.ray = ray;
             scatterInfo.throughput = vec3(0.0, 0.0, 0.0);
 
             Material mat = materialBank[objects[hitInfo.hitObjectIndex].materialIndex];
 
+            if (bounces == 0) {
+                primaryHitDistance = length(hitInfo.hitPosition - r.origin);
+                primaryHitNormal = hitInfo.normal;
+
+                // Glass does not tint what is seen through it
+                primaryHitAlbedo = mat.type == DIELECTRIC_TYPE ? vec3(1.0) : LinearToGamma(mat.color);
+            }
+
             if (mat.type == DIFFUSE_TYPE) {
                 scatterInfo = DiffuseScatter(scatterInfo, mat, hitInfo, bounces);
             }
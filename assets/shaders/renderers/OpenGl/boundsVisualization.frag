@@ -0,0 +1,9 @@
+#version 330 core
+
+out vec4 outFragColor;
+
+uniform vec4 color;
+
+void main() {
+   outFragColor = color;
+}
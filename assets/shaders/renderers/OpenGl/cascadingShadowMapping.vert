@@ -1,10 +1,28 @@
-#version 330 core
+#version 430 core
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUv;
+layout (location = 3) in uint inObjectIndex;
+layout (location = 4) in uint inLayerMask;
 
-uniform mat4 model;
+struct ObjectData {
+    mat4 model;
+
+    vec4 solidColor;
+
+    vec4 phongAmbient;
+    vec4 phongDiffuse;
+    vec4 phongSpecular; // w is the shininess
+};
+
+layout (std430, binding = 0) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+flat out uint layerMask; // Layers this object is visible in, culled on the CPU
 
 void main() {
-    gl_Position = model * vec4(inPos, 1.0);
+    gl_Position = objects[inObjectIndex].model * vec4(inPos, 1.0);
+
+    layerMask = inLayerMask;
 }  
\ No newline at end of file
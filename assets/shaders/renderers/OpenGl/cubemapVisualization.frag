@@ -1,6 +1,7 @@
-#version 330
+#version 400
 
-uniform samplerCube cubeMap;
+uniform samplerCubeArray cubeMaps;
+uniform int layer;
 
 out vec4 outFragColor;
 
@@ -18,7 +19,7 @@ void main() {
 
     vec3 dir = vec3(cos(phi) * cos(theta), sin(theta), sin(phi) * cos(theta));
 
-    float depth = texture(cubeMap, dir).r;
+    float depth = texture(cubeMaps, vec4(dir, layer)).r;
 
     outFragColor = vec4(vec3(depth), 1.0);
 }
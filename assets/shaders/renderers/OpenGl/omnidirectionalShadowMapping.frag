@@ -1,10 +1,18 @@
-#version 330 core
+#version 430 core
 in vec4 fragmentPosition;
+flat in uint lightIndex;
 
-uniform vec3 lightPosition;
-uniform float farPlane;
+const int MAX_SHADOWED_POINT_LIGHTS = 16;
+
+layout (std140, binding = 3) uniform PointLightShadows {
+    mat4 shadowMatrices[MAX_SHADOWED_POINT_LIGHTS * 6];
+    vec4 lightPositions[MAX_SHADOWED_POINT_LIGHTS]; // w is the far plane
+};
 
 void main() {
+    vec3 lightPosition = lightPositions[lightIndex].xyz;
+    float farPlane = lightPositions[lightIndex].w;
+
     //gl_FragDepth = 0.5;
     // get distance between fragment and light source
     float lightDistance = length(fragmentPosition.xyz - lightPosition);
@@ -31,19 +31,63 @@ struct DirectionalLight {
 
 out vec4 outFragColor;
 
-uniform Phong phong;
-uniform vec3 cameraPosition;
+layout (std140, binding = 0) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 cameraPosition;
+};
+
+struct ObjectData {
+    mat4 model;
+
+    vec4 solidColor;
+
+    vec4 phongAmbient;
+    vec4 phongDiffuse;
+    vec4 phongSpecular; // w is the shininess
+};
+
+layout (std430, binding = 0) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+Phong phong; // Filled in from objects at the start of main
 
 in vec3 normal;
 in vec3 fragPosition;
+flat in uint objectIndex;
+
+layout (std140, binding = 1) uniform Lights {
+    DirectionalLight directionalLight;
+
+    int pointLightCount;
+    bool haveDirectionalLight;
+    int shadowedPointLightCount; // Lights past this don't have a shadow map
+};
+
+layout (std430, binding = 1) readonly buffer PointLights {
+    PointLight pointLights[];
+};
+
+// Clustered shading, the lights reaching each cluster of the view frustum
+layout (std140, binding = 4) uniform ClusterGrid {
+    uvec4 gridSize;
+    vec2 screenSize;
+    float clusterNearPlane;
+    float clusterFarPlane;
+};
 
-const int MAX_LIGHTS = 4;
+layout (std430, binding = 2) readonly buffer Clusters {
+    uvec2 clusters[]; // Offset into clusterLightIndices and light count
+};
+
+layout (std430, binding = 3) readonly buffer ClusterLightIndices {
+    uint clusterLightIndices[];
+};
 
-uniform PointLight pointLights[MAX_LIGHTS];
-uniform int pointLightCount;
+uniform bool clusteredShading;
 
-uniform DirectionalLight directionalLight;
-uniform bool haveDirectionalLight;
+uint findCluster(vec3 fragPosition);
 
 vec3 pointLightAddition      (PointLight light,       vec3 normal, vec3 viewDir, float shadow);
 vec3 directionalLightAddition(DirectionalLight light, vec3 normal, vec3 viewDir, float shadow);
@@ -62,28 +106,26 @@ uniform int omnidirectionalShadowMapSampleCount;
 uniform int omnidirectionalShadowMapDiskRadiusMode;
 uniform float omnidirectionalShadowMapDiskRadius;
 
-// Arrays of sampler cubes were causing problems
-uniform samplerCube pointLightCubeMap0;
-uniform samplerCube pointLightCubeMap1;
-uniform samplerCube pointLightCubeMap2;
-uniform samplerCube pointLightCubeMap3;
+// Every point light's cube map is one layer of the array, indexed by the light's index
+uniform samplerCubeArray pointLightShadowMaps;
 
 // Directional Shadows
 float calculateDirectionalShadow();
 
 uniform bool directionalShadows;
 
-uniform mat4 view;
-
 // Cascading Shadow maps
 uniform sampler2DArray cascadingShadowMap;
 
-uniform int cascadeCount;
-uniform float cascadeFrustumPlanes[11];
+const int MAX_CASCADE_COUNT = 10;
 
-uniform mat4 lightSpaceMatrices[10];
+layout (std140, binding = 2) uniform Cascades {
+    mat4 lightSpaceMatrices[MAX_CASCADE_COUNT];
+    float cascadeFrustumPlanes[MAX_CASCADE_COUNT + 1];
 
-uniform float farPlane;
+    int cascadeCount;
+    float farPlane;
+};
 
 //vec3 spotLightAddition       (SpotLight light,        vec3 normal, vec3 viewDir, float shadow);
 
@@ -136,14 +178,28 @@ vec3 LinearToGamma(vec3 color) {
 }
 
 void main() {
+    ObjectData object = objects[objectIndex];
+    phong = Phong(object.phongAmbient.xyz, object.phongDiffuse.xyz, object.phongSpecular.xyz, object.phongSpecular.w);
+
     vec3 result = vec3(0.0, 0.0, 0.0);
 
     vec3 norm = normalize(normal);
     vec3 viewDir = normalize(cameraPosition - fragPosition);
     
-    for (int i = 0; i < pointLightCount; ++i) {
+    uint firstLight = 0;
+    uint lightCount = uint(pointLightCount);
+
+    if (clusteredShading) {
+        uvec2 cluster = clusters[findCluster(fragPosition)];
+        firstLight = cluster.x;
+        lightCount = cluster.y;
+    }
+
+    for (uint j = 0; j < lightCount; ++j) {
+        int i = clusteredShading ? int(clusterLightIndices[firstLight + j]) : int(j);
+
         float shadow = 0.0;
-        if (omnidirectionalShadowMaps) {
+        if (omnidirectionalShadowMaps && i < shadowedPointLightCount) {
             shadow = calculateOmnidirectionalShadow(i, fragPosition);
         }
         result += pointLightAddition(pointLights[i], norm, viewDir, shadow);
@@ -164,6 +220,21 @@ void main() {
     outFragColor = vec4(result, 1.0);
 }
 
+uint findCluster(vec3 fragPosition) {
+    float depth = -(view * vec4(fragPosition, 1.0)).z;
+
+    // Slices grow exponentially with depth, see OpenGlRenderer::CalculateClusterBounds
+    int slice = int(log(max(depth, clusterNearPlane) / clusterNearPlane) * float(gridSize.z) / log(clusterFarPlane / clusterNearPlane));
+
+    uvec3 cluster = uvec3(
+        clamp(uint(gl_FragCoord.x * float(gridSize.x) / screenSize.x), 0u, gridSize.x - 1u),
+        clamp(uint(gl_FragCoord.y * float(gridSize.y) / screenSize.y), 0u, gridSize.y - 1u),
+        uint(clamp(slice, 0, int(gridSize.z) - 1))
+    );
+
+    return cluster.x + gridSize.x * (cluster.y + gridSize.y * cluster.z);
+}
+
 vec3 pointLightAddition(PointLight light, vec3 normal, vec3 viewDir, float shadow) {
     //float shadow = shadowCalculationForOmnidirectionalShadowMaps(fragPosition);
     vec3 lightDirection = normalize(light.position - fragPosition);
@@ -217,22 +288,7 @@ float calculateOmnidirectionalShadow(int pointLightIndex, vec3 fragPosition) {
     float shadow = 0.0;
     vec3 fragmentToLight = fragPosition - pointLights[pointLightIndex].position;
 
-    float closestDepth = 0.0;
-
-    switch(pointLightIndex) {
-        case 0:
-            closestDepth = texture(pointLightCubeMap0, fragmentToLight).r;
-            break;
-        case 1:
-            closestDepth = texture(pointLightCubeMap1, fragmentToLight).r;
-            break;
-        case 2:
-            closestDepth = texture(pointLightCubeMap2, fragmentToLight).r;
-            break;
-        case 3:
-            closestDepth = texture(pointLightCubeMap3, fragmentToLight).r;
-            break;
-    }
+    float closestDepth = texture(pointLightShadowMaps, vec4(fragmentToLight, pointLightIndex)).r;
 
     closestDepth *= pointLights[pointLightIndex].farPlane;
 
@@ -248,21 +304,7 @@ float calculateOmnidirectionalShadow(int pointLightIndex, vec3 fragPosition) {
         for(float x = -offset; x < offset; x += offset / (samples * 0.5)) {
             for(float y = -offset; y < offset; y += offset / (samples * 0.5)) {
                 for(float z = -offset; z < offset; z += offset / (samples * 0.5)) {
-                    float closestDepth = 0.0;
-                    switch(pointLightIndex) {
-                        case 0:
-                            closestDepth = texture(pointLightCubeMap0, fragmentToLight + vec3(x, y, z)).r;
-                            break;
-                        case 1:
-                            closestDepth = texture(pointLightCubeMap1, fragmentToLight + vec3(x, y, z)).r;
-                            break;
-                        case 2:
-                            closestDepth = texture(pointLightCubeMap2, fragmentToLight + vec3(x, y, z)).r;
-                            break;
-                        case 3:
-                            closestDepth = texture(pointLightCubeMap3, fragmentToLight + vec3(x, y, z)).r;
-                            break;
-                    }
+                    float closestDepth = texture(pointLightShadowMaps, vec4(fragmentToLight + vec3(x, y, z), pointLightIndex)).r;
                     closestDepth *= pointLights[pointLightIndex].farPlane;
                     if(currentDepth - bias > closestDepth) {
                         shadow += 1.0;
@@ -292,21 +334,7 @@ float calculateOmnidirectionalShadow(int pointLightIndex, vec3 fragPosition) {
         }
             
         for(int j = 0; j < samples; ++j) {
-            float closestDepth = 0.0;
-            switch(pointLightIndex) {
-                case 0:
-                    closestDepth = texture(pointLightCubeMap0, fragmentToLight + sampleOffsetDirections[j] * diskRadius).r;
-                    break;
-                case 1:
-                    closestDepth = texture(pointLightCubeMap1, fragmentToLight + sampleOffsetDirections[j] * diskRadius).r;
-                    break;
-                case 2:
-                    closestDepth = texture(pointLightCubeMap2, fragmentToLight + sampleOffsetDirections[j] * diskRadius).r;
-                    break;
-                case 3:
-                    closestDepth = texture(pointLightCubeMap3, fragmentToLight + sampleOffsetDirections[j] * diskRadius).r;
-                    break;
-            }
+            float closestDepth = texture(pointLightShadowMaps, vec4(fragmentToLight + sampleOffsetDirections[j] * diskRadius, pointLightIndex)).r;
             closestDepth *= pointLights[pointLightIndex].farPlane;
             if(currentDepth - bias > closestDepth) { 
                 shadow += 1.0;
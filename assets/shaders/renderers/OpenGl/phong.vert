@@ -1,14 +1,33 @@
-#version 330 core
+#version 430 core
 
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUv;
+layout (location = 3) in uint inObjectIndex; // Per instance, the base instance of each draw selects the object
 
-uniform mat4 mvp;
-uniform mat4 model;
+layout (std140, binding = 0) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 cameraPosition;
+};
+
+struct ObjectData {
+    mat4 model;
+
+    vec4 solidColor;
+
+    vec4 phongAmbient;
+    vec4 phongDiffuse;
+    vec4 phongSpecular; // w is the shininess
+};
+
+layout (std430, binding = 0) readonly buffer Objects {
+    ObjectData objects[];
+};
 
 out vec3 normal;
 out vec3 fragPosition;
+flat out uint objectIndex;
 
 // Shadow Maps
 //out vec4 fragPositionInLightSpace;
@@ -16,10 +35,13 @@ out vec3 fragPosition;
 //uniform mat4 lightSpaceMatrix;
 
 void main() {
-	gl_Position = mvp * vec4(inPos.x, inPos.y, inPos.z, 1.0);
+	mat4 model = objects[inObjectIndex].model;
+
+	gl_Position = projection * view * model * vec4(inPos.x, inPos.y, inPos.z, 1.0);
 
 	normal = inNormal;
 	fragPosition = vec3(model * vec4(inPos, 1.0));
+	objectIndex = inObjectIndex;
 
 	// Cascading Shadow maps
 	//fragPositionInLightSpace = lightSpaceMatrix * vec4(fragPosition, 1.0);
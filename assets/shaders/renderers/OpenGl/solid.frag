@@ -1,8 +1,8 @@
-#version 330 core
+#version 430 core
 
 out vec4 outFragColor;
 
-uniform vec4 color;
+flat in vec4 color;
 
 void main() {
    outFragColor = color;
@@ -1,11 +1,34 @@
-#version 330 core
+#version 430 core
 
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUv;
+layout (location = 3) in uint inObjectIndex;
 
-uniform mat4 mvp;
+layout (std140, binding = 0) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 cameraPosition;
+};
+
+struct ObjectData {
+    mat4 model;
+
+    vec4 solidColor;
+
+    vec4 phongAmbient;
+    vec4 phongDiffuse;
+    vec4 phongSpecular; // w is the shininess
+};
+
+layout (std430, binding = 0) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+flat out vec4 color;
 
 void main() {
-   gl_Position = mvp * vec4(inPos.x, inPos.y, inPos.z, 1.0);
+   gl_Position = projection * view * objects[inObjectIndex].model * vec4(inPos.x, inPos.y, inPos.z, 1.0);
+
+   color = objects[inObjectIndex].solidColor;
 }
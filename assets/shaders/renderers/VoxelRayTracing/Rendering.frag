@@ -5,15 +5,16 @@ out vec4 outFragColor;
 in vec2 normalizedPixelPosition;
 
 uniform sampler2D accumulationBuffer;
-uniform int frameCount;
 
 //#define STATS
 
 void main() {
-	vec3 accumulationValue = texture(accumulationBuffer, normalizedPixelPosition).rgb;
+	vec4 accumulation = texture(accumulationBuffer, normalizedPixelPosition);
+	vec3 accumulationValue = accumulation.rgb;
 
 #ifndef STATS
-	accumulationValue /= float(frameCount);
+	// Every pixel has its own sample count in a, converged pixels stop collecting samples
+	accumulationValue /= max(accumulation.a, 1.0);
 #endif
 
     outFragColor = vec4(accumulationValue.rgb, 1.0);
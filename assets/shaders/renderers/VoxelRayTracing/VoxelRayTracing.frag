@@ -72,7 +72,11 @@ uniform float miliTime;
 uniform int screenWidth;
 uniform int screenHeight;
 
-out vec4 outFragColor;
+// The accumulation holds the sum of the samples in rgb and how many there are in a, the moments hold the sum of the
+// squared luminance of the samples, and the primary hit distance is how far the last primary ray went, 0.0 if it missed
+layout(location = 0) out vec4 outFragColor;
+layout(location = 1) out float outMoment;
+layout(location = 2) out float outPrimaryHitDistance;
 
 in vec2 normalizedPixelPosition;
 
@@ -87,9 +91,38 @@ const float MAX_FLOAT = 3.402823466e+38F;
 const int MAX_INT = 2147483647;
 
 uniform sampler2D accumulationBuffer;
+uniform sampler2D momentBuffer;
 
 uniform int maxBounces;
 
+// Adaptive sampling, a pixel stops being traced once the standard error of its mean luminance is below
+// convergenceThreshold times the mean, or it has maximumSamples samples
+uniform bool adaptiveSampling;
+uniform int minimumSamples;
+uniform int maximumSamples;
+uniform float convergenceThreshold;
+
+layout(std430, binding = 8) buffer activePixelBuffer {
+    uint activePixels; // Pixels that were traced this frame
+};
+
+// Temporal reprojection, on the first frame after the camera moves every pixel starts from what was accumulated where
+// its primary hit was on screen before, see ReprojectHistory. The history textures are copies of the accumulation
+// textures from before the move
+uniform bool reproject;
+uniform mat4 previousViewProjection;
+uniform vec3 previousCameraPosition;
+uniform int historyLength;
+uniform float depthTolerance;
+
+uniform sampler2D historyAccumulationBuffer;
+uniform sampler2D historyMomentBuffer;
+uniform sampler2D historyPrimaryHitDistanceBuffer;
+
+// Of the last ray FireRayIntoScene was given, the distance is 0.0 when it missed everything
+vec3 primaryRayDirection;
+float primaryHitDistance;
+
 vec3 FireRayIntoScene(Ray ray);
 
 // Scene hitting functions
@@ -142,7 +175,93 @@ bool NearZero(vec3 vec) {
     return (abs(vec.x) < epsilon) && (abs(vec.y) < epsilon) && (abs(vec.z) < epsilon);
 }
 
+float Luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+bool Converged(vec4 accumulation, float luminanceSquaredSum) {
+    float sampleCount = accumulation.a;
+
+    if (!adaptiveSampling || sampleCount < float(minimumSamples)) {
+        return false;
+    }
+
+    if (sampleCount >= float(maximumSamples)) {
+        return true;
+    }
+
+    float mean = Luminance(accumulation.rgb) / sampleCount;
+    float variance = max(luminanceSquaredSum / sampleCount - mean * mean, 0.0);
+
+    float standardError = sqrt(variance / sampleCount);
+
+    return standardError <= convergenceThreshold * max(mean, 1e-3);
+}
+
+// Replaces the accumulation with what was accumulated for the surface of the primary hit before the camera moved, or
+// nothing when it was off screen or hidden behind something else. The history is cut down to historyLength samples,
+// so shading that depends on the view catches up
+void ReprojectHistory(out vec4 accumulation, out float luminanceSquaredSum) {
+    accumulation = vec4(0.0);
+    luminanceSquaredSum = 0.0;
+
+    bool missed = primaryHitDistance == 0.0;
+    vec3 hitPosition = cameraPosition + primaryRayDirection * primaryHitDistance;
+
+    // What the ray missed is infinitely far away, only the rotation of the camera moves it on screen
+    vec4 previousClipPosition = missed ? previousViewProjection * vec4(primaryRayDirection, 0.0) : previousViewProjection * vec4(hitPosition, 1.0);
+
+    if (previousClipPosition.w <= 0.0) {
+        return;
+    }
+
+    vec2 previousNormalizedPosition = (previousClipPosition.xy / previousClipPosition.w) * 0.5 + 0.5;
+
+    if (any(lessThan(previousNormalizedPosition, vec2(0.0))) || any(greaterThanEqual(previousNormalizedPosition, vec2(1.0)))) {
+        return;
+    }
+
+    ivec2 previousPixel = ivec2(previousNormalizedPosition * vec2(screenWidth, screenHeight));
+
+    // Disocclusion, the previous pixel saw a different surface than this one does
+    float previousDistance = texelFetch(historyPrimaryHitDistanceBuffer, previousPixel, 0).r;
+
+    if (missed != (previousDistance == 0.0)) {
+        return;
+    }
+
+    if (!missed) {
+        float expectedDistance = length(hitPosition - previousCameraPosition);
+
+        if (abs(previousDistance - expectedDistance) > depthTolerance * expectedDistance) {
+            return;
+        }
+    }
+
+    accumulation = texelFetch(historyAccumulationBuffer, previousPixel, 0);
+    luminanceSquaredSum = texelFetch(historyMomentBuffer, previousPixel, 0).r;
+
+    // Scaling both sums keeps the mean and the variance
+    if (accumulation.a > float(historyLength)) {
+        float scale = float(historyLength) / accumulation.a;
+
+        accumulation *= scale;
+        luminanceSquaredSum *= scale;
+    }
+}
+
 void main() {
+    vec4 accumulation = texelFetch(accumulationBuffer, ivec2(gl_FragCoord.xy), 0);
+    float luminanceSquaredSum = texelFetch(momentBuffer, ivec2(gl_FragCoord.xy), 0).r;
+
+    // Nothing is written, so the framebuffer keeps what the pixel has. When reprojecting the textures are rebuilt, so
+    // every pixel has to be written
+    if (!reproject && Converged(accumulation, luminanceSquaredSum)) {
+        discard;
+    }
+
+    atomicAdd(activePixels, 1u);
+
 #ifdef STATS
     stats = Stats(0, 0, 0, 0);
 #endif
@@ -177,9 +296,6 @@ void main() {
     
     pixelColor = LinearToGamma(pixelColor);
 
-    // Writing to accumulation buffer
-    vec3 accumulationColor = texture(accumulationBuffer, normalizedPixelPosition).rgb;
-
 #ifdef STATS
     float col;
     if (maxBboxChecks != -1) {
@@ -193,13 +309,22 @@ void main() {
     }
 
     pixelColor = vec3(col, 0.0, 0.0);
+#endif
 
-    accumulationColor = pixelColor;
+    if (reproject) {
+        ReprojectHistory(accumulation, luminanceSquaredSum);
+    }
+
+    // Writing to accumulation buffer
+#ifdef STATS
+    accumulation = vec4(pixelColor, 1.0);
 #else
-    accumulationColor += pixelColor;
+    accumulation += vec4(pixelColor, 1.0);
 #endif
   
-    outFragColor = vec4(accumulationColor.rgb, 1.0);
+    outFragColor = accumulation;
+    outMoment = luminanceSquaredSum + Luminance(pixelColor) * Luminance(pixelColor);
+    outPrimaryHitDistance = primaryHitDistance;
 }
 
 float reflectance(float cosine, float refractionIndex) {
@@ -214,6 +339,9 @@ vec3 FireRayIntoScene(Ray r) {
 
     Ray ray = r;
 
+    primaryRayDirection = r.direction;
+    primaryHitDistance = 0.0;
+
     int bounces = 0;
     while (true) {
         if (bounces >= maxBounces) {
@@ -222,6 +350,9 @@ vec3 FireRayIntoScene(Ray r) {
 
         HitInfo hitInfo;
         if (HitScene(ray, hitInfo)) { // Scatter the ray
+            if (bounces == 0) {
+                primaryHitDistance = length(hitInfo.hitPosition - r.origin);
+            }
 
             ScatterInfo scatterInfo;
             scatterInfo.ray = ray;
@@ -282,14 +413,62 @@ struct Voxel {
     bool shouldDraw;
 
     int childMask;
+
+    int averageMaterial;
+
+    int brick;
 };
 
 layout(std430, binding = 5) readonly buffer VoxelBuffer {
     Voxel voxels[];
 };
 
+// BRICK_SIZE, BRICK_OCCUPANCY_WORDS and BRICK_WORDS are defined by VoxelBrick::GLSLDefines
+// Each brick is BRICK_OCCUPANCY_WORDS of occupancy bits followed by its attribute offset, palette size and bits per index
+layout(std430, binding = 6) readonly buffer BrickBuffer {
+    uint brickWords[];
+};
+
+// Palettes of materials followed by the packed palette indices of every cell, for each brick
+layout(std430, binding = 7) readonly buffer BrickAttributeBuffer {
+    uint brickAttributes[];
+};
+
+int BrickCellIndex(ivec3 cell) {
+    return cell.x * BRICK_SIZE * BRICK_SIZE + cell.y * BRICK_SIZE + cell.z;
+}
+
+bool BrickCellFilled(int brick, int cell) {
+    return (brickWords[brick * BRICK_WORDS + cell / 32] & (1u << uint(cell % 32))) != 0u;
+}
+
+int BrickCellMaterial(int brick, int cell) {
+    int header = brick * BRICK_WORDS + BRICK_OCCUPANCY_WORDS;
+
+    uint attributeOffset = brickWords[header + 0];
+    uint paletteSize     = brickWords[header + 1];
+    uint bitsPerIndex    = brickWords[header + 2];
+
+    uint paletteIndex = 0u;
+    if (bitsPerIndex != 0u) {
+        uint indicesPerWord = 32u / bitsPerIndex;
+        uint word = brickAttributes[attributeOffset + paletteSize + uint(cell) / indicesPerWord];
+
+        paletteIndex = (word >> ((uint(cell) % indicesPerWord) * bitsPerIndex)) & ((1u << bitsPerIndex) - 1u);
+    }
+
+    return int(brickAttributes[attributeOffset + paletteIndex]);
+}
+
+bool HitBrick(Ray ray, Voxel voxel, inout HitInfo hitInfo);
+vec3 getFaceNormal(Ray ray, vec3 outwardNormal);
+
 uniform int octreeRootIndex;
 
+// Level of detail, a voxel is treated as solid once its width is smaller than lodVoxelSizeThreshold * distance
+uniform bool lodEnabled;
+uniform float lodVoxelSizeThreshold;
+
 struct DistIndex {
     float dist;
     int index;
@@ -331,7 +510,9 @@ bool HitScene(Ray ray, inout HitInfo hitInfo) {
             continue;
         }
 
-        if (voxel.hasKids) {
+        bool stopAtThisLevel = lodEnabled && (voxel.hasKids || voxel.brick != -1) && (voxel.maxX - voxel.minX) < lodVoxelSizeThreshold * max(element.dist, 0.0);
+
+        if (voxel.hasKids && !stopAtThisLevel) {
 
             DistIndexHitVoxelInd distIndices[8];
 
@@ -411,22 +592,113 @@ bool HitScene(Ray ray, inout HitInfo hitInfo) {
             if (distIndices[7].hit) { DistIndex element; element.index = distIndices[7].voxelIndex; element.dist = distIndices[7].dist; stack[stackIndex += 1] = element; }
         }
         else { // No kids, we should shoot a ray at it
-            if (voxel.shouldDraw) {
+            if (voxel.shouldDraw || stopAtThisLevel) {
                 HitInfo backupHitInfo = hitInfo;
                 if (HitAABB2(ray, AABB(vec3(voxel.minX, voxel.minY, voxel.minZ), vec3(voxel.maxX, voxel.maxY, voxel.maxZ)), backupHitInfo)) {
                     if (backupHitInfo.closestDistance < hitInfo.closestDistance) {
                         hitInfo = backupHitInfo;
                         hitSomething = true;
-                        hitInfo.hitObjectIndex = voxel.k0;
+                        hitInfo.hitObjectIndex = stopAtThisLevel ? voxel.averageMaterial : voxel.k0;
                     }
                 }
             }
+            else if (voxel.brick != -1) {
+                if (HitBrick(ray, voxel, hitInfo)) {
+                    hitSomething = true;
+                }
+            }
         }
     }
 
     return hitSomething;
 }
 
+// Steps through the cells of a brick with a 3D DDA, only updates hitInfo if a cell closer than hitInfo.closestDistance is hit
+bool HitBrick(Ray ray, Voxel voxel, inout HitInfo hitInfo) {
+    vec3 minBound = vec3(voxel.minX, voxel.minY, voxel.minZ);
+    vec3 maxBound = vec3(voxel.maxX, voxel.maxY, voxel.maxZ);
+
+    vec3 t0Temp = (minBound - ray.origin) * ray.inverseDirection;
+    vec3 t1Temp = (maxBound - ray.origin) * ray.inverseDirection;
+
+    vec3 t0 = min(t0Temp, t1Temp);
+    vec3 t1 = max(t0Temp, t1Temp);
+
+    float tNear = max(t0.x, max(t0.y, t0.z));
+    float tFar = min(t1.x, min(t1.y, t1.z));
+
+    if (tFar < tNear || tFar <= 0) {
+        return false;
+    }
+
+    // The face of the brick the ray entered through, is the face of the first cell that gets hit
+    vec3 normal;
+    if (tNear == t0.x) {
+        normal = vec3(ray.inverseDirection.x > 0.0 ? -1.0 : 1.0, 0.0, 0.0);
+    } 
+    else if (tNear == t0.y) {
+        normal = vec3(0.0, ray.inverseDirection.y > 0.0 ? -1.0 : 1.0, 0.0);
+    } 
+    else {
+        normal = vec3(0.0, 0.0, ray.inverseDirection.z > 0.0 ? -1.0 : 1.0);
+    }
+
+    float cellSize = (voxel.maxX - voxel.minX) / float(BRICK_SIZE);
+
+    float t = max(tNear, 0.0);
+    vec3 entryPoint = ray.origin + ray.direction * t;
+
+    ivec3 cell = clamp(ivec3(floor((entryPoint - minBound) / cellSize)), ivec3(0), ivec3(BRICK_SIZE - 1));
+    ivec3 cellStep = ivec3(sign(ray.direction));
+
+    vec3 tDelta = abs(vec3(cellSize) * ray.inverseDirection);
+    vec3 tMax = (minBound + (vec3(cell) + max(vec3(cellStep), vec3(0.0))) * cellSize - ray.origin) * ray.inverseDirection;
+
+    // Axes the ray is parallel to are never crossed
+    tMax = mix(tMax, vec3(MAX_FLOAT), equal(cellStep, ivec3(0)));
+
+    for (int i = 0; i < 3 * BRICK_SIZE; ++i) {
+        if (t > hitInfo.closestDistance) {
+            return false;
+        }
+
+        int cellIndex = BrickCellIndex(cell);
+        if (t > MIN_RAY_DISTANCE && BrickCellFilled(voxel.brick, cellIndex)) {
+            hitInfo.closestDistance = t;
+            hitInfo.hitPosition = ray.origin + ray.direction * t;
+            hitInfo.normal = getFaceNormal(ray, normal);
+            hitInfo.hitObjectIndex = BrickCellMaterial(voxel.brick, cellIndex);
+
+            return true;
+        }
+
+        if (tMax.x < tMax.y && tMax.x < tMax.z) {
+            t = tMax.x;
+            tMax.x += tDelta.x;
+            cell.x += cellStep.x;
+            normal = vec3(-float(cellStep.x), 0.0, 0.0);
+        }
+        else if (tMax.y < tMax.z) {
+            t = tMax.y;
+            tMax.y += tDelta.y;
+            cell.y += cellStep.y;
+            normal = vec3(0.0, -float(cellStep.y), 0.0);
+        }
+        else {
+            t = tMax.z;
+            tMax.z += tDelta.z;
+            cell.z += cellStep.z;
+            normal = vec3(0.0, 0.0, -float(cellStep.z));
+        }
+
+        if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, ivec3(BRICK_SIZE)))) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
 vec3 getFaceNormal(Ray ray, vec3 outwardNormal) {
     bool frontFace = dot(ray.direction, outwardNormal) < 0;
     vec3 normal = frontFace ? outwardNormal : -outwardNormal;
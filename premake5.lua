@@ -44,6 +44,11 @@ project "Rutile"
 		"src/**.cpp"
 	}
 
+	-- Only the SIMD kernels are built with AVX2, callers check CPUSupportsAVX2() before using them
+	filter "files:src/**AVX2.cpp"
+		vectorextensions "AVX2"
+	filter {}
+
 	defines {
 		"GLEW_STATIC"
 	}
@@ -79,7 +79,8 @@ namespace Rutile {
                 "80K Triangle Dragon",
                 "800K Triangle Dragon",
                 "Sports Car Front 3/4",
-                "Minecraft World"
+                "Minecraft World",
+                "Many Point Lights"
             }, 
             (int*)&App::sceneType, 
             [] {
@@ -15,4 +15,15 @@ namespace Rutile {
             ++i;
         }
     }
+
+    bool DenoiserSettingsEditor(DenoiserSettings* settings) {
+        bool changed = false;
+
+        changed |= ImGui::DragInt("Denoiser Iterations", &settings->iterations, 0.05f, 1, 10);
+        changed |= ImGui::DragFloat("Luminance Phi", &settings->luminancePhi, 0.05f, 0.1f, 100.0f);
+        changed |= ImGui::DragFloat("Normal Phi", &settings->normalPhi, 1.0f, 1.0f, 1024.0f);
+        changed |= ImGui::DragFloat("Depth Phi", &settings->depthPhi, 0.0005f, 0.0001f, 1.0f);
+
+        return changed;
+    }
 }
\ No newline at end of file
@@ -5,6 +5,11 @@
 
 #include "Settings/App.h"
 
+#include "Utility/RayTracing/Denoiser.h"
+
 namespace Rutile {
     void RadioButtons(const std::string& name, std::vector<std::string> optionNames, int*, const std::function<void()>& func = []{ });
+
+    // Returns true when any of the settings changed
+    bool DenoiserSettingsEditor(DenoiserSettings* settings);
 }
\ No newline at end of file
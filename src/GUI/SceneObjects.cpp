@@ -109,8 +109,8 @@ namespace Rutile {
                             if (ImGui::ColorEdit3(("Specular Color##" + std::to_string(lightIndex)).c_str(), glm::value_ptr(pointLight.specular))) { App::renderer->SignalPointLightUpdate(lightIndex); }
 
                             ImGui::Text("Frustum");
-                            ImGui::DragFloat("Near Plane Distance##pointLight", &pointLight.shadowMapNearPlane, 0.1f);
-                            ImGui::DragFloat("Far Plane Distance##pointLight", &pointLight.shadowMapFarPlane, 0.1f);
+                            if (ImGui::DragFloat("Near Plane Distance##pointLight", &pointLight.shadowMapNearPlane, 0.1f)) { App::renderer->SignalPointLightUpdate(lightIndex); }
+                            if (ImGui::DragFloat("Far Plane Distance##pointLight", &pointLight.shadowMapFarPlane, 0.1f))   { App::renderer->SignalPointLightUpdate(lightIndex); }
 
                             if (App::settings.omnidirectionalShadowMaps) {
                                 App::renderer->ProvideLightVisualization(lightIndex);
@@ -1,5 +1,6 @@
 #include "TimingStatistics.h"
 #include "imgui.h"
+#include "implot.h"
 #include <chrono>
 
 #include "Settings/App.h"
@@ -12,6 +13,26 @@ namespace Rutile {
         const auto renderTime = std::chrono::duration_cast<std::chrono::nanoseconds>(App::timingData.renderTime);
         ImGui::Text(("Render Time: " + std::to_string((double)renderTime.count() / 1000000.0) + "ms").c_str());
 
+        if (App::gpuTimer && ImGui::TreeNode("GPU Passes")) {
+            const std::vector<GPUTimer::Pass>& passes = App::gpuTimer->GetPasses();
+
+            for (const GPUTimer::Pass& pass : passes) {
+                ImGui::Text((pass.name + ": " + std::to_string(pass.milliseconds) + "ms").c_str());
+            }
+
+            if (ImPlot::BeginPlot("GPU Pass Times")) {
+                ImPlot::SetupAxes("Frame", "ms", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+
+                for (const GPUTimer::Pass& pass : passes) {
+                    ImPlot::PlotLine(pass.name.c_str(), pass.history.data(), (int)pass.historyCount, 1.0, 0.0, 0, (int)pass.historyOffset);
+                }
+
+                ImPlot::EndPlot();
+            }
+
+            ImGui::TreePop();
+        }
+
         App::renderer->ProvideTimingStatistics();
     }
 }
\ No newline at end of file
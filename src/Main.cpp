@@ -49,6 +49,8 @@ std::unique_ptr<Renderer> CreateRenderer(RendererType type) {
 
     App::window = renderer->Init();
 
+    App::gpuTimer = std::make_unique<GPUTimer>();
+
     for (auto object : App::scene.objects) {
         App::scene.transformBank[object.transform].CalculateMatrix();
     }
@@ -67,6 +69,8 @@ std::unique_ptr<Renderer> CreateRenderer(RendererType type) {
 void ShutdownRenderer(std::unique_ptr<Renderer>& renderer) {
     App::imGui.Cleanup();
 
+    App::gpuTimer.reset();
+
     App::glfw.DetachFromWindow(App::window);
 
     renderer->Cleanup(App::window);
@@ -111,10 +115,14 @@ int main() {
 
             glfwSwapBuffers(App::window);
         }
+
+        App::gpuTimer->EndFrame();
     }
 
     App::imGui.Cleanup();
 
+    App::gpuTimer.reset();
+
     App::glfw.DetachFromWindow(App::window);
 
     App::renderer->Cleanup(App::window);
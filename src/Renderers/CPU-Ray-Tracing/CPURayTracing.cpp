@@ -1,5 +1,6 @@
 #include "CPURayTracing.h"
 #include "imgui.h"
+#include <algorithm>
 #include <iostream>
 
 #include "Settings/App.h"
@@ -9,6 +10,8 @@
 #include "Utility/events/Events.h"
 #include "Utility/OpenGl/GLDebug.h"
 
+#include "GUI/ImGuiUtil.h"
+
 namespace Rutile {
     float LinearToGamma(float component) {
         if (component > 0.0f) {
@@ -21,7 +24,7 @@ namespace Rutile {
         return glm::vec3{ LinearToGamma(color.r), LinearToGamma(color.g), LinearToGamma(color.b) };
     }
 
-    glm::vec4 RenderPixel(glm::u32vec2 pixelCoordinate) {
+    glm::vec4 RenderPixel(glm::u32vec2 pixelCoordinate, PrimaryHit& primaryHit) {
         glm::vec2 normalizedPixelCoordinate = { (float)pixelCoordinate.x / (float)App::screenWidth, (float)pixelCoordinate.y / (float)App::screenHeight };
 
         const float normalizedPixelWidth = 1.0f / (float)App::screenWidth;
@@ -55,7 +58,7 @@ namespace Rutile {
         // The cameras position is already in world space, and so it does not need to be transformed
         ray.origin = App::camera.position;
 
-        glm::vec3 pixelColor = FireRayIntoScene(ray);
+        glm::vec3 pixelColor = FireRayIntoScene(ray, primaryHit);
 
         pixelColor = LinearToGamma(pixelColor);
 
@@ -67,7 +70,7 @@ namespace Rutile {
         int y = (int)section->startIndex / App::screenWidth;
 
         for (size_t i = section->startIndex; i < section->startIndex + section->length; ++i) {
-            section->pixels[i - section->startIndex] = RenderPixel(glm::u32vec2{ x, y });
+            section->pixels[i - section->startIndex] = RenderPixel(glm::u32vec2{ x, y }, section->primaryHits[i - section->startIndex]);
 
             ++x;
             if (x == App::screenWidth) {
@@ -77,7 +80,12 @@ namespace Rutile {
         }
     }
 
-    glm::vec3 FireRayIntoScene(Ray ray) {
+    glm::vec3 FireRayIntoScene(Ray ray, PrimaryHit& primaryHit) {
+        primaryHit.direction = ray.direction;
+        primaryHit.distance = 0.0f;
+        primaryHit.normal = glm::vec3{ 0.0f };
+        primaryHit.albedo = glm::vec3{ 1.0f };
+
         constexpr float r = 1.0f; // Sphere radius in local space
         constexpr glm::vec3 spherePos = { 0.0f, 0.0f, 0.0f }; // Sphere position in local space
 
@@ -115,12 +123,25 @@ namespace Rutile {
 
             // At this point, no matter what t will be the closest hit for this object
 
-            glm::vec3 hitPointWorldSpace = App::scene.transformBank[object.transform].matrix * glm::vec4{ o + t * normalize(d), 1.0 };
+            const glm::vec3 hitPointLocalSpace = o + t * normalize(d);
+            glm::vec3 hitPointWorldSpace = App::scene.transformBank[object.transform].matrix * glm::vec4{ hitPointLocalSpace, 1.0 };
 
             float lengthAlongRayWorldSpace = length(hitPointWorldSpace - ray.origin);
 
             if (lengthAlongRayWorldSpace < std::numeric_limits<float>::max()) {
-                return App::scene.materialBank[object.material].solid.color;
+                const glm::vec3 color = App::scene.materialBank[object.material].solid.color;
+
+                // Normals go through the inverse transpose so that non uniform scales keep them perpendicular
+                glm::vec3 normal = glm::normalize(glm::transpose(glm::mat3{ invModel }) * (hitPointLocalSpace - spherePos));
+                if (glm::dot(normal, ray.direction) > 0.0f) {
+                    normal = -normal;
+                }
+
+                primaryHit.distance = lengthAlongRayWorldSpace;
+                primaryHit.normal = normal;
+                primaryHit.albedo = LinearToGamma(color);
+
+                return color;
             }
         }
 
@@ -174,8 +195,10 @@ namespace Rutile {
 
             ResetAccumulatedPixelData();
         }
-        if (EVENT_IS(event, CameraUpdate)          || 
-            EVENT_IS(event, ObjectTransformUpdate) || 
+        if (EVENT_IS(event, CameraUpdate)) {
+            ViewChanged();
+        }
+        if (EVENT_IS(event, ObjectTransformUpdate) || 
             EVENT_IS(event, ObjectMaterialUpdate)) {
 
             ResetAccumulatedPixelData();
@@ -298,14 +321,15 @@ namespace Rutile {
     }
 
     void CPURayTracing::Render() {
-        ++m_FrameCount;
-
         // Pixel Rendering
         const auto pixelRenderStart = std::chrono::steady_clock::now();
         for (auto& section : m_Sections) {
             section.pixels.clear();
             section.pixels.resize(section.length);
 
+            section.primaryHits.clear();
+            section.primaryHits.resize(section.length);
+
             m_ThreadPool->QueueJob(RenderSection, &section);
         }
 
@@ -319,8 +343,17 @@ namespace Rutile {
         std::vector<glm::vec4> combinedSectionData;
         combinedSectionData.resize((size_t)App::screenWidth * (size_t)App::screenHeight);
 
+        std::vector<PrimaryHit> combinedPrimaryHits;
+        combinedPrimaryHits.resize((size_t)App::screenWidth * (size_t)App::screenHeight);
+
         for (auto& section : m_Sections) {
             std::memcpy(combinedSectionData.data() + section.startIndex, section.pixels.data(), section.length * sizeof(glm::vec4));
+            std::memcpy(combinedPrimaryHits.data() + section.startIndex, section.primaryHits.data(), section.length * sizeof(PrimaryHit));
+        }
+
+        if (m_ViewChanged) {
+            ReprojectHistory(combinedPrimaryHits);
+            m_ViewChanged = false;
         }
 
         std::vector<glm::vec4> imageData;
@@ -328,14 +361,48 @@ namespace Rutile {
 
         size_t i = 0;
         for (const auto& pixel : combinedSectionData) {
+            const float luminance = Denoiser::Luminance(glm::vec3{ pixel });
+
             m_AccumulatedPixelData[i] += pixel;
+            m_LuminanceSquaredSums[i] += luminance * luminance;
+            m_PrimaryHitDistances[i] = combinedPrimaryHits[i].distance;
 
-            imageData[i] = m_AccumulatedPixelData[i] / (float)m_FrameCount;
+            m_Denoiser.gBuffer.normals[i] = combinedPrimaryHits[i].normal;
+            m_Denoiser.gBuffer.depths[i] = combinedPrimaryHits[i].distance;
+            m_Denoiser.gBuffer.albedos[i] = combinedPrimaryHits[i].albedo;
+
+            // Every pixel has its own sample count in a, reprojected pixels keep theirs
+            imageData[i] = m_AccumulatedPixelData[i] / m_AccumulatedPixelData[i].a;
             ++i;
         }
 
+        const glm::mat4 cameraProjection = glm::perspective(glm::radians(App::settings.fieldOfView), (float)App::screenWidth / (float)App::screenHeight, App::settings.nearPlane, App::settings.farPlane);
+        m_PreviousViewProjection = cameraProjection * App::camera.View();
+        m_PreviousCameraPosition = App::camera.position;
+
         m_SectionCombinationTime = std::chrono::steady_clock::now() - sectionCombinationStart;
 
+        // Denoising
+        if (m_Denoise) {
+            const auto denoiseStart = std::chrono::steady_clock::now();
+
+            ForEachSection([&](Section* section) {
+                m_Denoiser.Demodulate(m_AccumulatedPixelData, m_LuminanceSquaredSums, section->startIndex, section->length);
+            });
+
+            for (int iteration = 0; iteration < m_DenoiserSettings.iterations; ++iteration) {
+                ForEachSection([&](Section* section) {
+                    m_Denoiser.Filter(m_DenoiserSettings, iteration, section->startIndex, section->length);
+                });
+            }
+
+            for (size_t pixel = 0; pixel < imageData.size(); ++pixel) {
+                imageData[pixel] = glm::vec4{ m_Denoiser.Remodulate(m_DenoiserSettings, pixel), 1.0f };
+            }
+
+            m_DenoiseTime = std::chrono::steady_clock::now() - denoiseStart;
+        }
+
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, imageData.data());
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -354,6 +421,14 @@ namespace Rutile {
         ResetAccumulatedPixelData();
     }
 
+    void CPURayTracing::ForEachSection(const RayTracingThreadPool::Job& job) {
+        for (auto& section : m_Sections) {
+            m_ThreadPool->QueueJob(job, &section);
+        }
+
+        m_ThreadPool->WaitForCompletion();
+    }
+
     void CPURayTracing::CalculateSections() {
         m_Sections.clear();
 
@@ -387,6 +462,11 @@ namespace Rutile {
         const auto totalSectionCombinationTime = std::chrono::duration_cast<std::chrono::nanoseconds>(m_SectionCombinationTime);
         ImGui::Text(("Total Section Combination Time: " + std::to_string((double)totalSectionCombinationTime.count() / 1000000.0) + "ms").c_str());
 
+        if (m_Denoise) {
+            const auto denoiseTime = std::chrono::duration_cast<std::chrono::nanoseconds>(m_DenoiseTime);
+            ImGui::Text(("Denoise Time: " + std::to_string((double)denoiseTime.count() / 1000000.0) + "ms").c_str());
+        }
+
         ImGui::Separator();
 
         const auto averagePixelRenderTime = std::chrono::duration_cast<std::chrono::nanoseconds>(m_PixelRenderTime);
@@ -400,11 +480,111 @@ namespace Rutile {
         if (ImGui::DragInt("Section Count", &m_SectionCount, 0.01f, 1, 100)) {
             CalculateSections();
         }
+
+        ImGui::Checkbox("Denoise", &m_Denoise);
+
+        if (m_Denoise) {
+            // The image is denoised again every frame, so there is nothing to reset
+            DenoiserSettingsEditor(&m_DenoiserSettings);
+        }
+
+        ImGui::Checkbox("Temporal Reprojection", &m_TemporalReprojection);
+
+        if (m_TemporalReprojection) {
+            // Only used when the view changes, so there is nothing to reset
+            ImGui::DragInt("History Length", &m_HistoryLength, 1.0f, 1, 1 << 20);
+            ImGui::DragFloat("Depth Tolerance", &m_DepthTolerance, 0.001f, 0.001f, 1.0f);
+        }
     }
 
     void CPURayTracing::ResetAccumulatedPixelData() {
         m_AccumulatedPixelData.clear();
         m_AccumulatedPixelData.resize((size_t)App::screenWidth * (size_t)App::screenHeight);
-        m_FrameCount = 0;
+
+        m_LuminanceSquaredSums.clear();
+        m_LuminanceSquaredSums.resize((size_t)App::screenWidth * (size_t)App::screenHeight);
+
+        m_PrimaryHitDistances.clear();
+        m_PrimaryHitDistances.resize((size_t)App::screenWidth * (size_t)App::screenHeight);
+
+        m_Denoiser.Resize((size_t)App::screenWidth, (size_t)App::screenHeight);
+
+        // Nothing has been accumulated that could be reprojected
+        m_ViewChanged = false;
+    }
+
+    void CPURayTracing::ViewChanged() {
+        if (!m_TemporalReprojection) {
+            ResetAccumulatedPixelData();
+            return;
+        }
+
+        m_ViewChanged = true;
+    }
+
+    void CPURayTracing::ReprojectHistory(const std::vector<PrimaryHit>& primaryHits) {
+        std::vector<glm::vec4> reprojectedPixelData;
+        reprojectedPixelData.resize(m_AccumulatedPixelData.size());
+
+        std::vector<float> reprojectedLuminanceSquaredSums;
+        reprojectedLuminanceSquaredSums.resize(m_LuminanceSquaredSums.size());
+
+        for (size_t i = 0; i < primaryHits.size(); ++i) {
+            const glm::vec3 direction = primaryHits[i].direction;
+            const float distance = primaryHits[i].distance;
+
+            const bool missed = distance == 0.0f;
+            const glm::vec3 hitPosition = App::camera.position + direction * distance;
+
+            // What the ray missed is infinitely far away, only the rotation of the camera moves it on screen
+            const glm::vec4 previousClipPosition = missed ? m_PreviousViewProjection * glm::vec4{ direction, 0.0f } : m_PreviousViewProjection * glm::vec4{ hitPosition, 1.0f };
+
+            if (previousClipPosition.w <= 0.0f) {
+                continue;
+            }
+
+            const glm::vec2 previousNormalizedPosition = glm::vec2{ previousClipPosition } / previousClipPosition.w * 0.5f + 0.5f;
+
+            if (previousNormalizedPosition.x < 0.0f || previousNormalizedPosition.x >= 1.0f ||
+                previousNormalizedPosition.y < 0.0f || previousNormalizedPosition.y >= 1.0f) {
+                continue;
+            }
+
+            const size_t previousX = std::min((size_t)(previousNormalizedPosition.x * (float)App::screenWidth), (size_t)App::screenWidth - 1);
+            const size_t previousY = std::min((size_t)(previousNormalizedPosition.y * (float)App::screenHeight), (size_t)App::screenHeight - 1);
+            const size_t previous = previousY * (size_t)App::screenWidth + previousX;
+
+            // Disocclusion, the previous pixel saw a different surface than this one does
+            const float previousDistance = m_PrimaryHitDistances[previous];
+
+            if (missed != (previousDistance == 0.0f)) {
+                continue;
+            }
+
+            if (!missed) {
+                const float expectedDistance = glm::length(hitPosition - m_PreviousCameraPosition);
+
+                if (std::abs(previousDistance - expectedDistance) > m_DepthTolerance * expectedDistance) {
+                    continue;
+                }
+            }
+
+            glm::vec4 history = m_AccumulatedPixelData[previous];
+            float luminanceSquaredSum = m_LuminanceSquaredSums[previous];
+
+            // Dropping older samples lets shading that depends on the view catch up, scaling keeps the mean
+            if (history.a > (float)m_HistoryLength) {
+                const float scale = (float)m_HistoryLength / history.a;
+
+                history *= scale;
+                luminanceSquaredSum *= scale;
+            }
+
+            reprojectedPixelData[i] = history;
+            reprojectedLuminanceSquaredSums[i] = luminanceSquaredSum;
+        }
+
+        m_AccumulatedPixelData = std::move(reprojectedPixelData);
+        m_LuminanceSquaredSums = std::move(reprojectedLuminanceSquaredSums);
     }
 }
\ No newline at end of file
@@ -7,16 +7,27 @@
 #include <GLFW/glfw3.h>
 
 #include "Utility/ThreadPool.h"
+#include "Utility/RayTracing/Denoiser.h"
 
 namespace Rutile {
+    // Where the ray from the camera went, used for reprojection and as the G-buffer of the denoiser
+    struct PrimaryHit {
+        glm::vec3 direction;
+        float distance;    // 0 if it missed
+
+        glm::vec3 normal;  // Facing the camera, zero if it missed
+        glm::vec3 albedo;  // In gamma space, like the samples
+    };
+
     struct Section {
         size_t startIndex;
         size_t length;
 
         std::vector<glm::vec4> pixels;
+        std::vector<PrimaryHit> primaryHits;
     };
 
-    glm::vec4 RenderPixel(glm::u32vec2 pixelCoordinate);
+    glm::vec4 RenderPixel(glm::u32vec2 pixelCoordinate, PrimaryHit& primaryHit);
     void RenderSection(Section* section);
 
     struct Ray {
@@ -24,7 +35,7 @@ namespace Rutile {
         glm::vec3 direction;
     };
 
-    glm::vec3 FireRayIntoScene(Ray ray);
+    glm::vec3 FireRayIntoScene(Ray ray, PrimaryHit& primaryHit);
 
     class CPURayTracing : public Renderer {
     public:
@@ -45,8 +56,33 @@ namespace Rutile {
     private:
         void ResetAccumulatedPixelData();
 
-        std::vector<glm::vec4> m_AccumulatedPixelData;
-        int m_FrameCount{ 0 };
+        // Reprojects what was accumulated on the next frame when temporal reprojection is on, otherwise starts over
+        void ViewChanged();
+
+        // Replaces the accumulation of every pixel with what was accumulated for the surface of its primary hit before
+        // the view changed, or nothing when it was off screen or hidden behind something else
+        void ReprojectHistory(const std::vector<PrimaryHit>& primaryHits);
+
+        // Runs job on every section with the thread pool, and waits for all of them to finish
+        void ForEachSection(const RayTracingThreadPool::Job& job);
+
+        std::vector<glm::vec4> m_AccumulatedPixelData; // Sum of the samples in rgb, and their count in a
+        std::vector<float> m_LuminanceSquaredSums;     // Sum of the squared luminance of the samples
+        std::vector<float> m_PrimaryHitDistances;      // Of the last sample, 0 if it missed
+
+        // Temporal reprojection
+        bool m_TemporalReprojection{ true };
+        int m_HistoryLength{ 64 };
+        float m_DepthTolerance{ 0.05f };
+
+        bool m_ViewChanged{ false }; // The next frame reprojects instead of adding to the accumulation in place
+        glm::mat4 m_PreviousViewProjection{ 1.0f }; // Of the last rendered frame
+        glm::vec3 m_PreviousCameraPosition{ 0.0f };
+
+        // Denoising
+        bool m_Denoise{ false };
+        DenoiserSettings m_DenoiserSettings;
+        Denoiser m_Denoiser;
 
         std::unique_ptr<RayTracingThreadPool> m_ThreadPool;
 
@@ -58,6 +94,7 @@ namespace Rutile {
         // Timing Statistics
         std::chrono::duration<double> m_PixelRenderTime{ };
         std::chrono::duration<double> m_SectionCombinationTime{ };
+        std::chrono::duration<double> m_DenoiseTime{ };
 
         // Presenting Image
         unsigned int m_ShaderProgram{ 0 };
@@ -1,5 +1,6 @@
 #include "GPURayTracing.h"
 #include "imgui.h"
+#include <array>
 #include <iostream>
 
 #define GLM_ENABLE_EXPERIMENTAL
@@ -13,6 +14,7 @@
 
 #include "Utility/GeometryFactory.h"
 #include "Utility/events/Events.h"
+#include "Utility/OpenGl/GLCapabilities.h"
 #include "Utility/OpenGl/GLDebug.h"
 #include "Utility/RayTracing/BoundingVolumeHierarchy/BVHBank.h"
 #include "Utility/RayTracing/BoundingVolumeHierarchy/BVHFactory.h"
@@ -59,6 +61,9 @@ namespace Rutile {
 
         m_RayTracingShader = std::make_unique<Shader>("assets\\shaders\\renderers\\GPURayTracing\\GPURayTracing.vert", "assets\\shaders\\renderers\\GPURayTracing\\GPURayTracing.frag");
         m_RenderingShader = std::make_unique<Shader>("assets\\shaders\\renderers\\GPURayTracing\\Rendering.vert", "assets\\shaders\\renderers\\GPURayTracing\\Rendering.frag");
+        m_DenoiseShader = std::make_unique<Shader>("assets\\shaders\\renderers\\GPURayTracing\\Rendering.vert", "assets\\shaders\\renderers\\GPURayTracing\\Denoise.frag");
+
+        m_ComputeRayTracingShader = Shader::Compute("assets\\shaders\\renderers\\GPURayTracing\\GPURayTracing.frag", "#define COMPUTE_SHADER\n#define WORKGROUP_SIZE " + std::to_string(workgroupSize));
 
         // Screen Rectangle
         glGenVertexArrays(1, &m_VAO);
@@ -93,6 +98,45 @@ namespace Rutile {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
+        glGenTextures(1, &m_MomentTexture);
+        glBindTexture(GL_TEXTURE_2D, m_MomentTexture);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_MomentTexture, 0);
+
+        glGenTextures(1, &m_PrimaryHitDistanceTexture);
+        glBindTexture(GL_TEXTURE_2D, m_PrimaryHitDistanceTexture);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_PrimaryHitDistanceTexture, 0);
+
+        glGenTextures(1, &m_NormalTexture);
+        glBindTexture(GL_TEXTURE_2D, m_NormalTexture);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, m_NormalTexture, 0);
+
+        glGenTextures(1, &m_AlbedoTexture);
+        glBindTexture(GL_TEXTURE_2D, m_AlbedoTexture);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D, m_AlbedoTexture, 0);
+
+        const std::array<GLenum, 5> drawBuffers{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4 };
+        glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+
         glGenRenderbuffers(1, &m_AccumulationRBO);
         glBindRenderbuffer(GL_RENDERBUFFER, m_AccumulationRBO);
 
@@ -105,8 +149,48 @@ namespace Rutile {
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-        m_RayTracingShader->Bind();
+        // History, only ever copied into and read with texelFetch
+        glGenTextures(1, &m_HistoryAccumulationTexture);
+        glBindTexture(GL_TEXTURE_2D, m_HistoryAccumulationTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenTextures(1, &m_HistoryMomentTexture);
+        glBindTexture(GL_TEXTURE_2D, m_HistoryMomentTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenTextures(1, &m_HistoryPrimaryHitDistanceTexture);
+        glBindTexture(GL_TEXTURE_2D, m_HistoryPrimaryHitDistanceTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        // Denoise Framebuffers
+        glGenFramebuffers((GLsizei)m_DenoiseFrameBuffers.size(), m_DenoiseFrameBuffers.data());
+        glGenTextures((GLsizei)m_DenoiseTextures.size(), m_DenoiseTextures.data());
+
+        for (size_t i = 0; i < m_DenoiseFrameBuffers.size(); ++i) {
+            glBindFramebuffer(GL_FRAMEBUFFER, m_DenoiseFrameBuffers[i]);
+            glBindTexture(GL_TEXTURE_2D, m_DenoiseTextures[i]);
+
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_DenoiseTextures[i], 0);
+
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                std::cout << "ERROR: Denoise Framebuffer is not complete" << std::endl;
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
         m_RayTracingShader->SetInt("maxBounces", App::settings.maxBounces);
+        m_ComputeRayTracingShader->SetInt("maxBounces", App::settings.maxBounces);
 
         m_MaterialBank = std::make_unique<SSBO<LocalMaterial>>(0);
         m_ObjectBank = std::make_unique<SSBO<LocalObject>>(1);
@@ -114,17 +198,19 @@ namespace Rutile {
         m_TLASBank = std::make_unique<SSBO<LocalTLASNode>>(3);
         m_BLASBank = std::make_unique<SSBO<LocalBLASNode>>(4);
 
+        m_ActivePixelCounter = std::make_unique<GPUCounter>();
+
         ResetAccumulatedPixelData();
         return window;
     }
 
     void GPURayTracing::Notify(Event* event) {
         if (EVENT_IS(event, ObjectTransformUpdate)) {
-            CreateAndUploadBVHAndMeshAndObjectBuffers(); // TODO we really only need to change the object transforms,
-            // TODO but because the objects need starting indices, and we do all of it at once, we just call this
+            // The meshes are in object space, only the top level BVH and the objects change
+            CreateAndUploadObjectBuffers();
         }
         if (EVENT_IS(event, ObjectMaterialUpdate)) {
-            CreateAndUploadMaterialBuffer();
+            UploadMaterial(App::scene.objects[dynamic_cast<ObjectMaterialUpdate*>(event)->index].material);
         }
         if (EVENT_IS(event, WindowResize)) {
             glBindFramebuffer(GL_FRAMEBUFFER, m_AccumulationFrameBuffer);
@@ -134,15 +220,49 @@ namespace Rutile {
 
             glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_AccumulationTexture, 0);
 
+            glBindTexture(GL_TEXTURE_2D, m_MomentTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_MomentTexture, 0);
+
+            glBindTexture(GL_TEXTURE_2D, m_PrimaryHitDistanceTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_PrimaryHitDistanceTexture, 0);
+
+            glBindTexture(GL_TEXTURE_2D, m_NormalTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, m_NormalTexture, 0);
+
+            glBindTexture(GL_TEXTURE_2D, m_AlbedoTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D, m_AlbedoTexture, 0);
+
+            glBindTexture(GL_TEXTURE_2D, m_HistoryAccumulationTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+
+            glBindTexture(GL_TEXTURE_2D, m_HistoryMomentTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+
+            glBindTexture(GL_TEXTURE_2D, m_HistoryPrimaryHitDistanceTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+
             glBindRenderbuffer(GL_RENDERBUFFER, m_AccumulationRBO);
 
             glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, App::screenWidth, App::screenHeight);
             glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_AccumulationRBO);
 
+            for (unsigned int texture : m_DenoiseTextures) {
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+            }
+
+            m_DenoiseOutdated = true;
+
             ResetAccumulatedPixelData();
         }
-        if (EVENT_IS(event, CameraUpdate)          || 
-            EVENT_IS(event, ObjectTransformUpdate) || 
+        if (EVENT_IS(event, CameraUpdate)) {
+            ViewChanged();
+        }
+        if (EVENT_IS(event, ObjectTransformUpdate) || 
             EVENT_IS(event, ObjectMaterialUpdate)) {
 
             ResetAccumulatedPixelData();
@@ -150,7 +270,7 @@ namespace Rutile {
     }
 
     void GPURayTracing::ProjectionMatrixUpdate() {
-        ResetAccumulatedPixelData();
+        ViewChanged();
     }
 
     void GPURayTracing::Cleanup(GLFWwindow* window) {
@@ -160,83 +280,316 @@ namespace Rutile {
         m_ObjectBank.reset();
         m_MaterialBank.reset();
 
+        m_ActivePixelCounter.reset();
+
         glDeleteVertexArrays(1, &m_VAO);
         glDeleteBuffers(1, &m_VBO);
         glDeleteBuffers(1, &m_EBO);
 
         m_RayTracingShader.reset();
+        m_ComputeRayTracingShader.reset();
+        m_RenderingShader.reset();
+        m_DenoiseShader.reset();
 
         glfwDestroyWindow(window);
     }
 
     void GPURayTracing::Render() {
-        ++m_FrameCount;
+        GPUTimer* timer = App::gpuTimer.get();
+
+        if (m_SampleCount == 0) {
+            if (GLCapabilities::ClearTexture()) {
+                // A null clear value is zero, the storage is kept
+                glClearTexImage(m_AccumulationTexture, 0, GL_RGBA, GL_FLOAT, nullptr);
+                glClearTexImage(m_MomentTexture, 0, GL_RED, GL_FLOAT, nullptr);
+                glClearTexImage(m_PrimaryHitDistanceTexture, 0, GL_RED, GL_FLOAT, nullptr);
+            } else {
+                // Zeros are uploaded instead, a buffer big enough for the RGBA texture covers the single channel ones
+                const std::vector<glm::vec4> zeros((size_t)App::screenWidth * (size_t)App::screenHeight, glm::vec4{ 0.0f });
+
+                glBindTexture(GL_TEXTURE_2D, m_AccumulationTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, App::screenWidth, App::screenHeight, GL_RGBA, GL_FLOAT, zeros.data());
+
+                glBindTexture(GL_TEXTURE_2D, m_MomentTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, App::screenWidth, App::screenHeight, GL_RED, GL_FLOAT, zeros.data());
+
+                glBindTexture(GL_TEXTURE_2D, m_PrimaryHitDistanceTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, App::screenWidth, App::screenHeight, GL_RED, GL_FLOAT, zeros.data());
+            }
 
-        // Render into accumulation framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, m_AccumulationFrameBuffer);
+            // Nothing has been accumulated that could be reprojected
+            m_ViewChanged = false;
+        }
+
+        // Once every pixel has converged only the resolve is left
+        const bool traced = !m_Converged;
+
+        if (traced) {
+            timer->Begin("Ray Tracing");
+            m_ActivePixelCounter->Begin(activePixelBinding);
+
+            if (m_ViewChanged) {
+                CopyAccumulationToHistory();
+            }
+
+            if (m_ComputeRayTracing) {
+                TraceWithComputeShader();
+            } else {
+                TraceWithFragmentShader();
+            }
+
+            m_ActivePixelCounter->End();
+            timer->End();
+
+            m_ViewChanged = false;
+
+            const glm::mat4 cameraProjection = glm::perspective(glm::radians(App::settings.fieldOfView), (float)App::screenWidth / (float)App::screenHeight, App::settings.nearPlane, App::settings.farPlane);
+            m_PreviousViewProjection = cameraProjection * App::camera.View();
+            m_PreviousCameraPosition = App::camera.position;
+
+            m_Converged = m_AdaptiveSampling && m_ActivePixelCounter->Value() == 0u;
+        }
+
+        // The last denoised image is still right when nothing was traced
+        if (m_Denoise && (traced || m_DenoiseOutdated)) {
+            timer->Begin("Denoise");
+            Denoise();
+            timer->End();
+        }
+
+        // Read from accumulation texture, divide by sample count, and render to default framebuffer
+        timer->Begin("Accumulation Resolve");
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glViewport(0, 0, App::screenWidth, App::screenHeight);
 
-        m_RayTracingShader->Bind();
+        glClearColor(App::settings.backgroundColor.b, App::settings.backgroundColor.g, App::settings.backgroundColor.b, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
 
-        const glm::mat4 cameraProjection = glm::perspective(glm::radians(App::settings.fieldOfView), (float)App::screenWidth / (float)App::screenHeight, App::settings.nearPlane, App::settings.farPlane);
-        const glm::mat4 inverseProjection = glm::inverse(cameraProjection);
+        m_RenderingShader->Bind();
 
-        const glm::mat4 inverseView = glm::inverse(App::camera.View());
+        // The denoised image has a sample count of 1 in every pixel, so it is presented the same way
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_Denoise ? m_DenoiseTextures[m_DenoiserSettings.iterations % 2] : m_AccumulationTexture);
+        m_RenderingShader->SetInt("accumulationBuffer", 0);
 
-        m_RayTracingShader->SetFloat("miliTime", (float)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_RendererLoadTime).count() / 1000.0f);
-        m_RayTracingShader->SetInt("screenWidth", App::screenWidth);
-        m_RayTracingShader->SetInt("screenHeight", App::screenHeight);
+        glBindVertexArray(m_VAO);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
 
-        m_RayTracingShader->SetMat4("invView", inverseView);
-        m_RayTracingShader->SetMat4("invProjection", inverseProjection);
-        m_RayTracingShader->SetVec3("cameraPosition", App::camera.position);
+        timer->End();
+    }
 
-        m_RayTracingShader->SetVec3("backgroundColor", App::settings.backgroundColor);
+    void GPURayTracing::Denoise() {
+        m_DenoiseOutdated = false;
 
-        m_RayTracingShader->SetInt("objectCount", (int)App::scene.objects.size());
+        glViewport(0, 0, App::screenWidth, App::screenHeight);
+
+        m_DenoiseShader->Bind();
+
+        m_DenoiseShader->SetFloat("luminancePhi", m_DenoiserSettings.luminancePhi);
+        m_DenoiseShader->SetFloat("normalPhi", m_DenoiserSettings.normalPhi);
+        m_DenoiseShader->SetFloat("depthPhi", m_DenoiserSettings.depthPhi);
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, m_AccumulationTexture);
-        m_RayTracingShader->SetInt("accumulationBuffer", 0);
+        m_DenoiseShader->SetInt("accumulationBuffer", 0);
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_MomentTexture);
+        m_DenoiseShader->SetInt("momentBuffer", 1);
+
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, m_PrimaryHitDistanceTexture);
+        m_DenoiseShader->SetInt("primaryHitDistanceBuffer", 2);
+
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, m_NormalTexture);
+        m_DenoiseShader->SetInt("normalBuffer", 3);
+
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, m_AlbedoTexture);
+        m_DenoiseShader->SetInt("albedoBuffer", 4);
+
+        m_DenoiseShader->SetInt("illuminationBuffer", 5);
 
         glBindVertexArray(m_VAO);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, m_DenoiseFrameBuffers[0]);
+
+        m_DenoiseShader->SetBool("demodulate", true);
+        m_DenoiseShader->SetBool("remodulate", false);
+
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
 
-        // Read from accumulation framebuffer, divide by frame count, and render to default framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        m_DenoiseShader->SetBool("demodulate", false);
+
+        glActiveTexture(GL_TEXTURE5);
+
+        for (int i = 0; i < m_DenoiserSettings.iterations; ++i) {
+            glBindFramebuffer(GL_FRAMEBUFFER, m_DenoiseFrameBuffers[(i + 1) % 2]);
+            glBindTexture(GL_TEXTURE_2D, m_DenoiseTextures[i % 2]);
+
+            m_DenoiseShader->SetInt("stepWidth", 1 << i);
+            m_DenoiseShader->SetBool("remodulate", i == m_DenoiserSettings.iterations - 1);
+
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+        }
+    }
+
+    void GPURayTracing::SetFrameUniforms(Shader& shader) {
+        const glm::mat4 cameraProjection = glm::perspective(glm::radians(App::settings.fieldOfView), (float)App::screenWidth / (float)App::screenHeight, App::settings.nearPlane, App::settings.farPlane);
+        const glm::mat4 inverseProjection = glm::inverse(cameraProjection);
+
+        const glm::mat4 inverseView = glm::inverse(App::camera.View());
+
+        shader.SetFloat("miliTime", (float)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_RendererLoadTime).count() / 1000.0f);
+        shader.SetInt("screenWidth", App::screenWidth);
+        shader.SetInt("screenHeight", App::screenHeight);
+
+        shader.SetMat4("invView", inverseView);
+        shader.SetMat4("invProjection", inverseProjection);
+        shader.SetVec3("cameraPosition", App::camera.position);
+
+        shader.SetVec3("backgroundColor", App::settings.backgroundColor);
+
+        shader.SetInt("objectCount", (int)App::scene.objects.size());
+
+        shader.SetBool("adaptiveSampling", m_AdaptiveSampling);
+        shader.SetInt("minimumSamples", m_MinimumSamples);
+        shader.SetInt("maximumSamples", m_MaximumSamples);
+        shader.SetFloat("convergenceThreshold", m_ConvergenceThreshold);
+
+        shader.SetBool("reproject", m_ViewChanged);
+        shader.SetMat4("previousViewProjection", m_PreviousViewProjection);
+        shader.SetVec3("previousCameraPosition", m_PreviousCameraPosition);
+        shader.SetInt("historyLength", m_HistoryLength);
+        shader.SetFloat("depthTolerance", m_DepthTolerance);
+
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, m_HistoryAccumulationTexture);
+        shader.SetInt("historyAccumulationBuffer", 2);
+
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, m_HistoryMomentTexture);
+        shader.SetInt("historyMomentBuffer", 3);
+
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, m_HistoryPrimaryHitDistanceTexture);
+        shader.SetInt("historyPrimaryHitDistanceBuffer", 4);
+    }
+
+    void GPURayTracing::TraceWithFragmentShader() {
+        ++m_SampleCount;
+
+        // Render into accumulation framebuffer
+        glBindFramebuffer(GL_FRAMEBUFFER, m_AccumulationFrameBuffer);
         glViewport(0, 0, App::screenWidth, App::screenHeight);
 
-        glClearColor(App::settings.backgroundColor.b, App::settings.backgroundColor.g, App::settings.backgroundColor.b, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+        m_RayTracingShader->Bind();
 
-        m_RenderingShader->Bind();
+        SetFrameUniforms(*m_RayTracingShader);
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, m_AccumulationTexture);
-        m_RenderingShader->SetInt("accumulationBuffer", 0);
+        m_RayTracingShader->SetInt("accumulationBuffer", 0);
 
-        m_RenderingShader->SetInt("frameCount", m_FrameCount);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_MomentTexture);
+        m_RayTracingShader->SetInt("momentBuffer", 1);
 
         glBindVertexArray(m_VAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
     }
 
+    void GPURayTracing::TraceWithComputeShader() {
+        m_SampleCount += m_SamplesPerPixel;
+
+        m_ComputeRayTracingShader->Bind();
+
+        SetFrameUniforms(*m_ComputeRayTracingShader);
+        m_ComputeRayTracingShader->SetInt("samplesPerPixel", m_SamplesPerPixel);
+
+        // Every invocation only ever touches its own pixel, so the image is read and written in place
+        glBindImageTexture(0, m_AccumulationTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindImageTexture(1, m_MomentTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        glBindImageTexture(2, m_PrimaryHitDistanceTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glBindImageTexture(3, m_NormalTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glBindImageTexture(4, m_AlbedoTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+        const GLuint groupsX = (GLuint)((App::screenWidth + workgroupSize - 1) / workgroupSize);
+        const GLuint groupsY = (GLuint)((App::screenHeight + workgroupSize - 1) / workgroupSize);
+
+        glDispatchCompute(groupsX, groupsY, 1);
+
+        // The resolve samples the image, and the next dispatch loads it again
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+
     void GPURayTracing::LoadScene() {
         ResetAccumulatedPixelData();
 
         CreateAndUploadMaterialBuffer();
 
-        CreateAndUploadBVHAndMeshAndObjectBuffers();
+        CreateAndUploadMeshBuffers();
+        CreateAndUploadObjectBuffers();
     }
 
     void GPURayTracing::SignalRayTracingSettingsChange() {
-        m_RayTracingShader->Bind();
         m_RayTracingShader->SetInt("maxBounces", App::settings.maxBounces);
+        m_ComputeRayTracingShader->SetInt("maxBounces", App::settings.maxBounces);
 
         ResetAccumulatedPixelData();
     }
 
     void GPURayTracing::ProvideLocalRendererSettings() {
+        if (ImGui::Checkbox("Compute Shader Path", &m_ComputeRayTracing)) {
+            ResetAccumulatedPixelData();
+        }
+
+        if (m_ComputeRayTracing) {
+            ImGui::DragInt("Samples Per Pixel Per Frame", &m_SamplesPerPixel, 0.1f, 1, 64);
+        }
+
+        if (ImGui::Checkbox("Denoise", &m_Denoise)) {
+            m_DenoiseOutdated = true;
+        }
+
+        if (m_Denoise && DenoiserSettingsEditor(&m_DenoiserSettings)) {
+            m_DenoiseOutdated = true;
+        }
+
+        ImGui::Checkbox("Temporal Reprojection", &m_TemporalReprojection);
+
+        if (m_TemporalReprojection) {
+            // Only used when the view changes, so there is nothing to reset
+            ImGui::DragInt("History Length", &m_HistoryLength, 1.0f, 1, 1 << 20);
+            ImGui::DragFloat("Depth Tolerance", &m_DepthTolerance, 0.001f, 0.001f, 1.0f);
+        }
+
+        if (ImGui::Checkbox("Adaptive Sampling", &m_AdaptiveSampling)) {
+            ResumeSampling();
+        }
+
+        if (m_AdaptiveSampling) {
+            // Nothing accumulated is invalidated by these, pixels are only ever held back
+            if (ImGui::DragFloat("Convergence Threshold", &m_ConvergenceThreshold, 0.0005f, 0.001f, 0.5f)) {
+                ResumeSampling();
+            }
+            if (ImGui::DragInt("Minimum Samples", &m_MinimumSamples, 0.1f, 1, m_MaximumSamples)) {
+                ResumeSampling();
+            }
+            if (ImGui::DragInt("Maximum Samples", &m_MaximumSamples, 1.0f, m_MinimumSamples, 1 << 20)) {
+                ResumeSampling();
+            }
+
+            if (m_Converged) {
+                ImGui::Text("Converged");
+            } else if (const std::optional<uint32_t> activePixels = m_ActivePixelCounter->Value()) {
+                const double activePercentage = 100.0 * (double)*activePixels / ((double)App::screenWidth * (double)App::screenHeight);
+                ImGui::Text(("Active Pixels: " + std::to_string(*activePixels) + " (" + std::to_string(activePercentage) + "%)").c_str());
+            }
+        }
+
         static int maxBboxChecks = 100;
         static int maxSphereChecks = 100;
         static int maxTriangleChecks = 100;
@@ -292,84 +645,81 @@ namespace Rutile {
             break;
         }
 
-        m_RayTracingShader->Bind();
-        m_RayTracingShader->SetInt("maxBboxChecks", bbox);
-        m_RayTracingShader->SetInt("maxSphereChecks", sphere);
-        m_RayTracingShader->SetInt("maxTriangleChecks", tri);
-        m_RayTracingShader->SetInt("maxMeshChecks", mesh);
+        for (Shader* shader : { m_RayTracingShader.get(), m_ComputeRayTracingShader.get() }) {
+            shader->SetInt("maxBboxChecks", bbox);
+            shader->SetInt("maxSphereChecks", sphere);
+            shader->SetInt("maxTriangleChecks", tri);
+            shader->SetInt("maxMeshChecks", mesh);
+        }
     }
 
     void GPURayTracing::ResetAccumulatedPixelData() {
-        m_FrameCount = 0;
-
-        glBindFramebuffer(GL_FRAMEBUFFER, m_AccumulationFrameBuffer);
-        glBindTexture(GL_TEXTURE_2D, m_AccumulationTexture);
-
-        std::vector<glm::vec4> clearData{ };
-        clearData.resize((size_t)App::screenWidth * (size_t)App::screenHeight);
-        for (auto& val : clearData) {
-            val = glm::vec4{ 0.0f };
-        }
+        // The textures are cleared by the next Render, however many resets happen before it
+        m_SampleCount = 0;
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, clearData.data());
+        ResumeSampling();
     }
 
-    void GPURayTracing::CreateAndUploadMaterialBuffer() {
-        m_RayTracingShader->Bind();
+    void GPURayTracing::ResumeSampling() {
+        m_Converged = false;
 
-        std::vector<LocalMaterial> localMats{ };
-        for (size_t i = 0; i < App::scene.materialBank.Size(); ++i) {
-            LocalMaterial mat{ };
-            mat.type = (int)App::scene.materialBank[i].type;
-            mat.fuzz = App::scene.materialBank[i].fuzz;
-            mat.indexOfRefraction = App::scene.materialBank[i].indexOfRefraction;
-            mat.color = glm::vec4{ App::scene.materialBank[i].solid.color, 1.0 };
+        // Counts from before may have been of pixels that are no longer converged
+        m_ActivePixelCounter->Reset();
+    }
 
-            localMats.emplace_back(mat);
+    void GPURayTracing::ViewChanged() {
+        if (!m_TemporalReprojection) {
+            ResetAccumulatedPixelData();
+            return;
         }
 
-        m_MaterialBank->SetData(localMats);
+        // Pixels may now see surfaces that were never sampled, or fewer samples than they had before
+        m_ViewChanged = true;
+        ResumeSampling();
     }
 
-    void GPURayTracing::CreateAndUploadBVHAndMeshAndObjectBuffers() {
-        m_RayTracingShader->Bind();
-
-        std::vector<Object> objects = App::scene.objects;
-        auto nodes = TemplateBVHFactory<Object>::Construct(objects, 1);
+    void GPURayTracing::CopyAccumulationToHistory() {
+        glCopyImageSubData(m_AccumulationTexture, GL_TEXTURE_2D, 0, 0, 0, 0, m_HistoryAccumulationTexture, GL_TEXTURE_2D, 0, 0, 0, 0, App::screenWidth, App::screenHeight, 1);
+        glCopyImageSubData(m_MomentTexture, GL_TEXTURE_2D, 0, 0, 0, 0, m_HistoryMomentTexture, GL_TEXTURE_2D, 0, 0, 0, 0, App::screenWidth, App::screenHeight, 1);
+        glCopyImageSubData(m_PrimaryHitDistanceTexture, GL_TEXTURE_2D, 0, 0, 0, 0, m_HistoryPrimaryHitDistanceTexture, GL_TEXTURE_2D, 0, 0, 0, 0, App::screenWidth, App::screenHeight, 1);
+    }
 
-        std::vector<LocalTLASNode> TLASNodes;
+    GPURayTracing::LocalMaterial GPURayTracing::CreateLocalMaterial(const Material& material) {
+        LocalMaterial mat{ };
+        mat.type = (int)material.type;
+        mat.fuzz = material.fuzz;
+        mat.indexOfRefraction = material.indexOfRefraction;
+        mat.color = glm::vec4{ material.solid.color, 1.0 };
 
-        for (auto node : nodes) {
-            LocalTLASNode n{ };
-
-            n.min = node.bbox.min;
-            n.max = node.bbox.max;
+        return mat;
+    }
 
-            n.node2 = node.count;
+    void GPURayTracing::CreateAndUploadMaterialBuffer() {
+        std::vector<LocalMaterial> localMats{ };
+        for (size_t i = 0; i < App::scene.materialBank.Size(); ++i) {
+            localMats.emplace_back(CreateLocalMaterial(App::scene.materialBank[i]));
+        }
 
-            if (node.count > 0) {
-                n.node1 = node.offset;
-            }
-            else {
-                n.node1 = node.node1;
-            }
+        m_MaterialBank->SetData(localMats);
+    }
 
-            TLASNodes.push_back(n);
-        }
+    void GPURayTracing::UploadMaterial(MaterialIndex index) {
+        const LocalMaterial mat = CreateLocalMaterial(App::scene.materialBank[index]);
 
-        m_TLASBank->SetData(TLASNodes);
+        m_MaterialBank->Update(index, { &mat, 1 });
+    }
 
-        m_RayTracingShader->SetInt("BVHStartIndex", (int)0);
+    void GPURayTracing::CreateAndUploadMeshBuffers() {
+        m_BLASStartIndices.clear();
 
         std::vector<float> triangleData;
         std::vector<LocalBLASNode> blasNodes;
-        std::vector<int> startingIndices;
 
         for (size_t i = 0; i < App::scene.geometryBank.Size(); ++i) {
             Geometry& geo = App::scene.geometryBank[i];
 
             if (geo.type == Geometry::GeometryType::SPHERE) {
-                startingIndices.push_back(-1);
+                m_BLASStartIndices.push_back(-1);
                 continue;
             }
 
@@ -386,7 +736,7 @@ namespace Rutile {
 
             int startingIndex = (int)blasNodes.size();
 
-            startingIndices.push_back(startingIndex);
+            m_BLASStartIndices.push_back(startingIndex);
 
             std::vector<float> meshData{ };
 
@@ -455,6 +805,36 @@ namespace Rutile {
         m_MeshBank->SetData(triangleData);
 
         m_BLASBank->SetData(blasNodes);
+    }
+
+    void GPURayTracing::CreateAndUploadObjectBuffers() {
+        m_RayTracingShader->Bind();
+
+        std::vector<Object> objects = App::scene.objects;
+        auto nodes = TemplateBVHFactory<Object>::Construct(objects, 1);
+
+        std::vector<LocalTLASNode> TLASNodes;
+
+        for (auto node : nodes) {
+            LocalTLASNode n{ };
+
+            n.min = node.bbox.min;
+            n.max = node.bbox.max;
+
+            n.node2 = node.count;
+
+            if (node.count > 0) {
+                n.node1 = node.offset;
+            }
+            else {
+                n.node1 = node.node1;
+            }
+
+            TLASNodes.push_back(n);
+        }
+
+        m_RayTracingShader->SetInt("BVHStartIndex", (int)0);
+        m_ComputeRayTracingShader->SetInt("BVHStartIndex", (int)0);
 
         std::vector<LocalObject> localObjects{ };
         int i = 0;
@@ -474,12 +854,16 @@ namespace Rutile {
                 glm::mat4{ glm::transpose(glm::mat3{ App::scene.transformBank[object.transform].matrix }) },
                 (int)object.material,
                 geoType,
-                startingIndices[object.geometry]
+                m_BLASStartIndices[object.geometry]
             });
 
             ++i;
         }
 
+        // Runs on every transform update, so both buffers share one wait for the GPU
+        SSBOBatch::Begin();
+        m_TLASBank->SetData(TLASNodes);
         m_ObjectBank->SetData(localObjects);
+        SSBOBatch::End();
     }
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
+#include <array>
 #include <chrono>
 #include <memory>
 
@@ -7,8 +8,10 @@
 #include <gl/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "Utility/OpenGl/GPUCounter.h"
 #include "Utility/OpenGl/Shader.h"
 #include "Utility/OpenGl/SSBO.h"
+#include "Utility/RayTracing/Denoiser.h"
 #include "Utility/RayTracing/BoundingVolumeHierarchy/BVHIndex.h"
 
 namespace Rutile {
@@ -32,19 +35,86 @@ namespace Rutile {
     private:
         void ResetAccumulatedPixelData();
 
+        // Lets converged pixels be traced again, without throwing away what they have accumulated
+        void ResumeSampling();
+
+        // Reprojects what was accumulated on the next frame when temporal reprojection is on, otherwise starts over
+        void ViewChanged();
+        void CopyAccumulationToHistory();
+
+        // Uniforms that both ray tracing shaders share and that change every frame
+        void SetFrameUniforms(Shader& shader);
+
+        void TraceWithFragmentShader();
+        void TraceWithComputeShader();
+
+        // Filters the accumulation into one of the denoise textures, see Denoise.frag
+        void Denoise();
+
         void CreateAndUploadMaterialBuffer();
-        void CreateAndUploadBVHAndMeshAndObjectBuffers();
+        void UploadMaterial(MaterialIndex index); // Only rewrites the one material in the buffer
+
+        void CreateAndUploadMeshBuffers(); // Triangles and the BVH of every mesh
+        void CreateAndUploadObjectBuffers(); // Objects and the BVH over them
+
+        int m_SampleCount{ 0 };
+
+        // 64 invocations fill both 32 and 64 wide SIMD units, and square groups keep the rays of a group coherent
+        static constexpr int workgroupSize = 8;
+
+        bool m_ComputeRayTracing{ true };
+        int m_SamplesPerPixel{ 1 };
+
+        // Adaptive sampling, see Converged in GPURayTracing.frag
+        static constexpr unsigned int activePixelBinding = 5; // activePixelBuffer in GPURayTracing.frag
 
-        int m_FrameCount{ 0 };
+        bool m_AdaptiveSampling{ true };
+        int m_MinimumSamples{ 16 };
+        int m_MaximumSamples{ 4096 };
+        float m_ConvergenceThreshold{ 0.01f };
+
+        std::unique_ptr<GPUCounter> m_ActivePixelCounter;
+        bool m_Converged{ false }; // Nothing is traced until the accumulation is reset or sampling resumes
+
+        // Temporal reprojection, see ReprojectHistory in GPURayTracing.frag
+        bool m_TemporalReprojection{ true };
+        int m_HistoryLength{ 64 };
+        float m_DepthTolerance{ 0.05f };
+
+        bool m_ViewChanged{ false }; // The next trace reprojects instead of adding to the accumulation in place
+        glm::mat4 m_PreviousViewProjection{ 1.0f }; // Of the last traced frame
+        glm::vec3 m_PreviousCameraPosition{ 0.0f };
 
         unsigned int m_AccumulationFrameBuffer{ 0 };
-        unsigned int m_AccumulationTexture{ 0 };
+        unsigned int m_AccumulationTexture{ 0 };        // Sum of the samples in rgb, and their count in a
+        unsigned int m_MomentTexture{ 0 };              // Sum of the squared luminance of the samples
+        unsigned int m_PrimaryHitDistanceTexture{ 0 };  // How far the last primary ray went, 0 if it missed
         unsigned int m_AccumulationRBO{ 0 };
 
+        // Copies of the textures above from before the view changed, read while reprojecting
+        unsigned int m_HistoryAccumulationTexture{ 0 };
+        unsigned int m_HistoryMomentTexture{ 0 };
+        unsigned int m_HistoryPrimaryHitDistanceTexture{ 0 };
+
+        // Denoising
+        bool m_Denoise{ false };
+        DenoiserSettings m_DenoiserSettings;
+        bool m_DenoiseOutdated{ true }; // The denoised image is of settings or a size that changed since
+
+        // G-buffer of the primary hits, written along with the accumulation
+        unsigned int m_NormalTexture{ 0 };
+        unsigned int m_AlbedoTexture{ 0 };
+
+        // Every iteration reads from one and writes to the other
+        std::array<unsigned int, 2> m_DenoiseFrameBuffers{ };
+        std::array<unsigned int, 2> m_DenoiseTextures{ };
+
         std::chrono::time_point<std::chrono::steady_clock> m_RendererLoadTime;
 
         std::unique_ptr<Shader> m_RayTracingShader;
+        std::unique_ptr<Shader> m_ComputeRayTracingShader;
         std::unique_ptr<Shader> m_RenderingShader;
+        std::unique_ptr<Shader> m_DenoiseShader;
 
         unsigned int m_VAO{ 0 };
         unsigned int m_VBO{ 0 };
@@ -86,6 +156,10 @@ namespace Rutile {
             int triangleCount;
         };
 
+        static LocalMaterial CreateLocalMaterial(const Material& material);
+
+        std::vector<int> m_BLASStartIndices; // Per geometry, -1 for spheres
+
         std::unique_ptr<SSBO<LocalMaterial>> m_MaterialBank;
         std::unique_ptr<SSBO<LocalObject>> m_ObjectBank;
         std::unique_ptr<SSBO<float>> m_MeshBank;
@@ -0,0 +1,117 @@
+#include "ObjectCulling.h"
+
+#include "ObjectCullingAVX2.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Utility/CPUFeatures.h"
+
+namespace Rutile {
+    void ObjectBounds::Resize(size_t size) {
+        centerX.resize(size);
+        centerY.resize(size);
+        centerZ.resize(size);
+
+        extentX.resize(size);
+        extentY.resize(size);
+        extentZ.resize(size);
+    }
+
+    size_t ObjectBounds::Size() const {
+        return centerX.size();
+    }
+
+    void ObjectBounds::Set(size_t i, const glm::vec3& min, const glm::vec3& max, const glm::mat4& matrix) {
+        const glm::vec3 localCenter = (min + max) * 0.5f;
+        const glm::vec3 localExtent = (max - min) * 0.5f;
+
+        // The extent of the transformed box along each world axis is the sum of the absolute projections of its axes
+        const glm::vec3 center = glm::vec3{ matrix * glm::vec4{ localCenter, 1.0f } };
+
+        const glm::mat3 absolute{ glm::abs(glm::vec3{ matrix[0] }), glm::abs(glm::vec3{ matrix[1] }), glm::abs(glm::vec3{ matrix[2] }) };
+        const glm::vec3 extent = absolute * localExtent;
+
+        centerX[i] = center.x;
+        centerY[i] = center.y;
+        centerZ[i] = center.z;
+
+        extentX[i] = extent.x;
+        extentY[i] = extent.y;
+        extentZ[i] = extent.z;
+    }
+
+    Frustum Frustum::FromMatrix(const glm::mat4& viewProjection) {
+        // G. Gribb, K. Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix" (2001)
+        const glm::mat4 m = glm::transpose(viewProjection); // Rows of viewProjection
+
+        Frustum frustum{ };
+        frustum.planes[0] = m[3] + m[0]; // Left
+        frustum.planes[1] = m[3] - m[0]; // Right
+        frustum.planes[2] = m[3] + m[1]; // Bottom
+        frustum.planes[3] = m[3] - m[1]; // Top
+        frustum.planes[4] = m[3] + m[2]; // Near
+        frustum.planes[5] = m[3] - m[2]; // Far
+
+        return frustum;
+    }
+
+    namespace ObjectCulling {
+        void CullAgainstFrustum(const ObjectBounds& bounds, const Frustum& frustum, uint32_t bit, std::vector<uint32_t>& masks) {
+            const size_t count = bounds.Size();
+
+            size_t i = 0;
+
+            if (CPUSupportsAVX2()) {
+                i = ObjectCullingAVX2::CullAgainstFrustum(
+                    bounds.centerX.data(), bounds.centerY.data(), bounds.centerZ.data(),
+                    bounds.extentX.data(), bounds.extentY.data(), bounds.extentZ.data(),
+                    count, &frustum.planes[0].x, bit, masks.data()
+                );
+            }
+
+            for (; i < count; ++i) {
+                bool inside = true;
+
+                for (const glm::vec4& plane : frustum.planes) {
+                    const float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+                    const float radius = std::abs(plane.x) * bounds.extentX[i] + std::abs(plane.y) * bounds.extentY[i] + std::abs(plane.z) * bounds.extentZ[i];
+
+                    if (distance + radius < 0.0f) {
+                        inside = false;
+                        break;
+                    }
+                }
+
+                if (inside) {
+                    masks[i] |= bit;
+                }
+            }
+        }
+
+        void CullAgainstSphere(const ObjectBounds& bounds, glm::vec3 center, float radius, uint32_t bit, std::vector<uint32_t>& masks) {
+            const size_t count = bounds.Size();
+            const float radiusSquared = radius * radius;
+
+            size_t i = 0;
+
+            if (CPUSupportsAVX2()) {
+                i = ObjectCullingAVX2::CullAgainstSphere(
+                    bounds.centerX.data(), bounds.centerY.data(), bounds.centerZ.data(),
+                    bounds.extentX.data(), bounds.extentY.data(), bounds.extentZ.data(),
+                    count, center.x, center.y, center.z, radius, bit, masks.data()
+                );
+            }
+
+            for (; i < count; ++i) {
+                const float x = std::max(std::abs(bounds.centerX[i] - center.x) - bounds.extentX[i], 0.0f);
+                const float y = std::max(std::abs(bounds.centerY[i] - center.y) - bounds.extentY[i], 0.0f);
+                const float z = std::max(std::abs(bounds.centerZ[i] - center.z) - bounds.extentZ[i], 0.0f);
+
+                if (x * x + y * y + z * z <= radiusSquared) {
+                    masks[i] |= bit;
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
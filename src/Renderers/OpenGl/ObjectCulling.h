@@ -0,0 +1,42 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace Rutile {
+    // World space bounding boxes of every object as centers and half extents, kept as a structure of arrays so the
+    // tests in ObjectCulling can work on 8 objects at a time
+    struct ObjectBounds {
+        std::vector<float> centerX;
+        std::vector<float> centerY;
+        std::vector<float> centerZ;
+
+        std::vector<float> extentX;
+        std::vector<float> extentY;
+        std::vector<float> extentZ;
+
+        void Resize(size_t size);
+        size_t Size() const;
+
+        // Bounds of the box min, max after it is transformed by matrix
+        void Set(size_t i, const glm::vec3& min, const glm::vec3& max, const glm::mat4& matrix);
+    };
+
+    // Planes point inwards, a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all of them
+    struct Frustum {
+        std::array<glm::vec4, 6> planes;
+
+        // Works for both perspective and orthographic matrices
+        static Frustum FromMatrix(const glm::mat4& viewProjection);
+    };
+
+    namespace ObjectCulling {
+        // Sets bit in masks[i] for every object i whose bounds intersect the frustum
+        void CullAgainstFrustum(const ObjectBounds& bounds, const Frustum& frustum, uint32_t bit, std::vector<uint32_t>& masks);
+
+        // Sets bit in masks[i] for every object i whose bounds intersect the sphere
+        void CullAgainstSphere(const ObjectBounds& bounds, glm::vec3 center, float radius, uint32_t bit, std::vector<uint32_t>& masks);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "ObjectCullingAVX2.h"
+
+#include <immintrin.h>
+
+namespace Rutile {
+    namespace ObjectCullingAVX2 {
+        size_t CullAgainstFrustum(const float* centerX, const float* centerY, const float* centerZ, const float* extentX, const float* extentY, const float* extentZ, size_t count, const float* planes, uint32_t bit, uint32_t* masks) {
+            size_t i = 0;
+
+            for (; i + 8 <= count; i += 8) {
+                const __m256 cx = _mm256_loadu_ps(centerX + i);
+                const __m256 cy = _mm256_loadu_ps(centerY + i);
+                const __m256 cz = _mm256_loadu_ps(centerZ + i);
+
+                const __m256 ex = _mm256_loadu_ps(extentX + i);
+                const __m256 ey = _mm256_loadu_ps(extentY + i);
+                const __m256 ez = _mm256_loadu_ps(extentZ + i);
+
+                __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+                for (int p = 0; p < 6; ++p) {
+                    const float* plane = planes + p * 4;
+
+                    // Signed distance of the center, plus how far the box reaches towards the plane
+                    __m256 distance = _mm256_set1_ps(plane[3]);
+                    distance = _mm256_add_ps(distance, _mm256_mul_ps(cx, _mm256_set1_ps(plane[0])));
+                    distance = _mm256_add_ps(distance, _mm256_mul_ps(cy, _mm256_set1_ps(plane[1])));
+                    distance = _mm256_add_ps(distance, _mm256_mul_ps(cz, _mm256_set1_ps(plane[2])));
+
+                    __m256 radius = _mm256_mul_ps(ex, _mm256_set1_ps(plane[0] < 0.0f ? -plane[0] : plane[0]));
+                    radius = _mm256_add_ps(radius, _mm256_mul_ps(ey, _mm256_set1_ps(plane[1] < 0.0f ? -plane[1] : plane[1])));
+                    radius = _mm256_add_ps(radius, _mm256_mul_ps(ez, _mm256_set1_ps(plane[2] < 0.0f ? -plane[2] : plane[2])));
+
+                    inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+                }
+
+                const int lanes = _mm256_movemask_ps(inside);
+
+                for (int lane = 0; lane < 8; ++lane) {
+                    if (lanes & (1 << lane)) {
+                        masks[i + lane] |= bit;
+                    }
+                }
+            }
+
+            return i;
+        }
+
+        size_t CullAgainstSphere(const float* centerX, const float* centerY, const float* centerZ, const float* extentX, const float* extentY, const float* extentZ, size_t count, float sphereX, float sphereY, float sphereZ, float radius, uint32_t bit, uint32_t* masks) {
+            const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+            const __m256 radiusSquared = _mm256_set1_ps(radius * radius);
+
+            // Distance from the sphere's center to the closest point of the box along one axis
+            auto axisDistance = [&](const float* boxCenter, const float* boxExtent, float sphereCenter) {
+                const __m256 offset = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(boxCenter), _mm256_set1_ps(sphereCenter)), signMask);
+                return _mm256_max_ps(_mm256_sub_ps(offset, _mm256_loadu_ps(boxExtent)), _mm256_setzero_ps());
+            };
+
+            size_t i = 0;
+
+            for (; i + 8 <= count; i += 8) {
+                const __m256 x = axisDistance(centerX + i, extentX + i, sphereX);
+                const __m256 y = axisDistance(centerY + i, extentY + i, sphereY);
+                const __m256 z = axisDistance(centerZ + i, extentZ + i, sphereZ);
+
+                const __m256 distanceSquared = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_add_ps(_mm256_mul_ps(y, y), _mm256_mul_ps(z, z)));
+
+                const int lanes = _mm256_movemask_ps(_mm256_cmp_ps(distanceSquared, radiusSquared, _CMP_LE_OQ));
+
+                for (int lane = 0; lane < 8; ++lane) {
+                    if (lanes & (1 << lane)) {
+                        masks[i + lane] |= bit;
+                    }
+                }
+            }
+
+            return i;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace Rutile {
+    // Built with AVX2 enabled, only call these when CPUSupportsAVX2() is true. Like RasterizationAVX2 this stays clear
+    // of glm and the standard library, see there for why
+    namespace ObjectCullingAVX2 {
+        // The arrays are the ones of ObjectBounds, and planes are the 6 planes of a Frustum as (x, y, z, w). Objects are
+        // tested 8 at a time, the number tested is returned and the remaining objects are left to the caller
+        size_t CullAgainstFrustum(const float* centerX, const float* centerY, const float* centerZ, const float* extentX, const float* extentY, const float* extentZ, size_t count, const float* planes, uint32_t bit, uint32_t* masks);
+        size_t CullAgainstSphere(const float* centerX, const float* centerY, const float* centerZ, const float* extentX, const float* extentY, const float* extentZ, size_t count, float sphereX, float sphereY, float sphereZ, float radius, uint32_t bit, uint32_t* masks);
+    }
+}
\ No newline at end of file
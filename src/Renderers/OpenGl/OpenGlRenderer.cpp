@@ -2,6 +2,10 @@
 #include "Settings/App.h"
 #include "imgui.h"
 
+#include "Utility/TimeScope.h"
+
+#include <algorithm>
+#include <bit>
 #include <iostream>
 
 #include <gl/glew.h>
@@ -14,6 +18,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "Utility/events/Events.h"
+#include "Utility/OpenGl/GLCapabilities.h"
 #include "Utility/OpenGl/GLDebug.h"
 
 namespace Rutile {
@@ -51,14 +56,59 @@ namespace Rutile {
         m_CascadingShadowMapShader = std::make_unique<Shader>("assets\\shaders\\renderers\\OpenGl\\cascadingShadowMapping.vert", "assets\\shaders\\renderers\\OpenGl\\cascadingShadowMapping.frag", "assets\\shaders\\renderers\\OpenGl\\cascadingShadowMapping.geom");
         m_CascadingShadowMapVisualizationShader = std::make_unique<Shader>("assets\\shaders\\renderers\\OpenGl\\cascadingShadowMapVisualization.vert", "assets\\shaders\\renderers\\OpenGl\\cascadingShadowMapVisualization.frag");
 
+        // Solid color with its own mvp, the visualizations draw geometry that isn't part of the scene
+        m_BoundsVisualizationShader = std::make_unique<Shader>("assets\\shaders\\renderers\\OpenGl\\boundsVisualization.vert", "assets\\shaders\\renderers\\OpenGl\\boundsVisualization.frag");
+
+        ResolveUniformHandles();
+
+        // Uniform and shader storage buffers
+        m_CameraUBO = std::make_unique<UBO<CameraBlock>>(0);
+        m_LightUBO = std::make_unique<UBO<LightBlock>>(1);
+        m_CascadeUBO = std::make_unique<UBO<CascadeBlock>>(2);
+        m_PointLightShadowUBO = std::make_unique<UBO<PointLightShadowBlock>>(3);
+        m_ClusterUBO = std::make_unique<UBO<ClusterBlock>>(4);
+
+        // Rewritten every frame, so each frame in flight gets its own copy
+        m_ObjectSSBO = std::make_unique<SSBO<ObjectData>>(0, std::vector<ObjectData>{ }, framesInFlight);
+        m_PointLightSSBO = std::make_unique<SSBO<PointLightData>>(1, std::vector<PointLightData>{ }, framesInFlight);
+        m_ClusterSSBO = std::make_unique<SSBO<ClusterRange>>(2, std::vector<ClusterRange>{ }, framesInFlight);
+        m_ClusterLightIndexSSBO = std::make_unique<SSBO<unsigned int>>(3, std::vector<unsigned int>{ }, framesInFlight);
+
+        // Clustered shading
+        m_ClusterThreadPool = std::make_unique<ThreadPool<size_t>>(std::max(std::thread::hardware_concurrency(), 1u));
+
+        // Geometry
+        m_GeometryArena = std::make_unique<GeometryArena>();
+
+        // Draw lists, rebuilt every frame
+        glGenBuffers(1, &m_DrawIndirectBuffer);
+        glGenBuffers(1, &m_DrawInstanceBuffer);
+
+        glBindVertexArray(m_GeometryArena->VAO());
+        glBindBuffer(GL_ARRAY_BUFFER, m_DrawInstanceBuffer);
+
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(DrawInstance), (void*)offsetof(DrawInstance, objectIndex));
+        glVertexAttribDivisor(3, 1);
+        glEnableVertexAttribArray(3);
+
+        glVertexAttribIPointer(4, 1, GL_UNSIGNED_INT, sizeof(DrawInstance), (void*)offsetof(DrawInstance, layerMask));
+        glVertexAttribDivisor(4, 1);
+        glEnableVertexAttribArray(4);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+
         // Omnidirectional Shadow maps
         glGenFramebuffers(1, &m_OmnidirectionalShadowMapFBO);
+        glGenTextures(1, &m_PointLightShadowMaps);
 
         glBindFramebuffer(GL_FRAMEBUFFER, m_OmnidirectionalShadowMapFBO);
         glDrawBuffer(GL_NONE);
         glReadBuffer(GL_NONE);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+        CreatePointLightShadowMaps();
+
         // Cubemap Visualization
         glGenFramebuffers(1, &m_CubeMapVisualizationFBO);
         glBindFramebuffer(GL_FRAMEBUFFER, m_CubeMapVisualizationFBO);
@@ -166,6 +216,29 @@ namespace Rutile {
         if (EVENT_IS(event, WindowResize)) {
             ProjectionMatrixUpdate();
         }
+
+        if (EVENT_IS(event, CameraUpdate)) {
+            // Cascades are fitted to the camera's frustum
+            m_CascadesOutdated = true;
+        }
+
+        if (EVENT_IS(event, ObjectTransformUpdate)) {
+            const ObjectIndex index = dynamic_cast<ObjectTransformUpdate*>(event)->index;
+
+            // Forces UpdateObjectBounds to look at the object again, which invalidates the shadow maps it was and
+            // is now in. The matrix may already have been changed by the time the event arrives
+            if (index < m_ObjectBoundsMatrices.size()) {
+                m_ObjectBoundsMatrices[index] = glm::mat4{ 0.0f };
+            }
+        }
+
+        if (EVENT_IS(event, DirectionalShadowMapUpdate)) {
+            m_CascadesOutdated = true;
+        }
+
+        if (EVENT_IS(event, OmnidirectionalShadowMapUpdate)) {
+            m_PointLightShadowMapOutdated.assign(m_PointLightShadowMapOutdated.size(), true);
+        }
     }
 
     void OpenGlRenderer::Cleanup(GLFWwindow* window) {
@@ -185,12 +258,35 @@ namespace Rutile {
         glDeleteRenderbuffers(1, &m_CubeMapVisualizationRBO);
 
         // Omnidirectional Shadow maps
-        for (const auto& cubeMap : m_PointLightCubeMaps) {
-            glDeleteTextures(1, &cubeMap);
-        }
-
+        glDeleteTextures(1, &m_PointLightShadowMaps);
         glDeleteFramebuffers(1, &m_OmnidirectionalShadowMapFBO);
 
+        m_PointLightShadowMaps = 0;
+
+        // Uniform and shader storage buffers
+        m_CameraUBO.reset();
+        m_LightUBO.reset();
+        m_CascadeUBO.reset();
+        m_PointLightShadowUBO.reset();
+        m_ClusterUBO.reset();
+
+        m_ObjectSSBO.reset();
+        m_PointLightSSBO.reset();
+        m_ClusterSSBO.reset();
+        m_ClusterLightIndexSSBO.reset();
+
+        m_ClusterThreadPool.reset();
+
+        // Geometry
+        glDeleteBuffers(1, &m_DrawInstanceBuffer);
+        glDeleteBuffers(1, &m_DrawIndirectBuffer);
+
+        m_DrawInstanceBuffer = 0;
+        m_DrawIndirectBuffer = 0;
+
+        m_GeometryArena.reset();
+        m_GeometryAllocations.clear();
+
         // Shaders
         m_SolidShader.reset();
         m_PhongShader.reset();
@@ -201,10 +297,19 @@ namespace Rutile {
         m_CascadingShadowMapShader.reset();
         m_CascadingShadowMapVisualizationShader.reset();
 
+        m_BoundsVisualizationShader.reset();
+
         glfwDestroyWindow(window);
     }
 
     void OpenGlRenderer::Render() {
+        TimeScope submitTimeScope{ &m_SubmitTime };
+
+        m_DrawCallCount = 0;
+
+        m_StateCache.Invalidate();
+        m_StateCache.ResetCounters();
+
         if (App::settings.frontFace == WindingOrder::COUNTER_CLOCK_WISE) {
             glFrontFace(GL_CCW);
         } else {
@@ -256,13 +361,58 @@ namespace Rutile {
         //}
         */
 
-        RenderOmnidirectionalShadowMaps(); // TODO this should be called sparingly
+        UploadFrameData();
 
-        if (App::scene.HasDirectionalLight() && App::settings.directionalShadows && !App::settings.lockCascadeCamera) {
-            RenderCascadingShadowMaps(); // TODO this should be called sparingly
+        // The winding order changes which faces are culled in the shadow passes, and has no event of its own
+        if (App::settings.frontFace != m_ShadowMapFrontFace) {
+            m_ShadowMapFrontFace = App::settings.frontFace;
+
+            InvalidateAllShadowMaps();
+        }
+
+        if (!m_ShadowMapCaching) {
+            InvalidateAllShadowMaps();
         }
 
-        RenderScene();
+        // Bounds are updated first since moved objects invalidate shadow maps
+        UpdateObjectBounds();
+
+        const bool renderCascades = App::scene.HasDirectionalLight() && App::settings.directionalShadows && !App::settings.lockCascadeCamera && m_CascadesOutdated;
+
+        if (renderCascades) {
+            CalculateCascades();
+        }
+
+        CalculatePointLightShadows();
+
+        BuildDrawLists(renderCascades);
+
+        {
+            GPUTimeScope shadowCubeTime{ App::gpuTimer.get(), "Shadow Cubes" };
+
+            RenderOmnidirectionalShadowMaps();
+        }
+
+        if (renderCascades) {
+            GPUTimeScope cascadeTime{ App::gpuTimer.get(), "Cascades" };
+
+            RenderCascadingShadowMaps();
+
+            m_CascadesOutdated = false;
+        }
+
+        m_RenderedCascades = renderCascades;
+
+        AssignLightsToClusters();
+
+        {
+            GPUTimeScope sceneTime{ App::gpuTimer.get(), "Scene" };
+
+            RenderScene();
+        }
+
+        // The visualizations bind their own vertex arrays, and nothing may change the arena's element buffer binding
+        m_StateCache.BindVertexArray(0);
 
         if (App::settings.visualizeCascades) {
             VisualizeShadowCascades();
@@ -273,66 +423,93 @@ namespace Rutile {
         }
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        m_ObjectSSBO->EndFrame();
+        m_PointLightSSBO->EndFrame();
+        m_ClusterSSBO->EndFrame();
+        m_ClusterLightIndexSSBO->EndFrame();
     }
 
-    void OpenGlRenderer::RenderOmnidirectionalShadowMaps() {
-        if (App::settings.culledFaceDuringOmnidirectionalShadowMapping == GeometricFace::FRONT) {
-            glCullFace(GL_FRONT);
-        } else {
-            glCullFace(GL_BACK);
-        }
+    void OpenGlRenderer::CalculatePointLightShadows() {
+        m_PointLightShadowTransforms.resize(m_ShadowedPointLightCount);
 
-        LightIndex pointLightIndex = 0;
-        for (const auto& pointLight : App::scene.pointLights) {
-            float aspect = (float)m_OmnidirectionalShadowMapWidth / (float)m_OmnidirectionalShadowMapHeight;
-            glm::mat4 shadowMapProjection = glm::perspective(glm::radians(90.0f), aspect, pointLight.shadowMapNearPlane, pointLight.shadowMapFarPlane);
+        PointLightShadowBlock shadows{ };
+        bool outdated = false;
 
-            glm::vec3 lightPosition = pointLight.position;
+        for (LightIndex lightIndex = 0; lightIndex < m_ShadowedPointLightCount; ++lightIndex) {
+            if (!m_PointLightShadowMapOutdated[lightIndex]) {
+                continue;
+            }
 
-            std::vector<glm::mat4> shadowTransforms;
-            shadowTransforms.push_back(shadowMapProjection *
-                glm::lookAt(lightPosition, lightPosition + glm::vec3{ 1.0,  0.0,  0.0 }, glm::vec3{ 0.0, -1.0,  0.0 }));
-            shadowTransforms.push_back(shadowMapProjection *
-                glm::lookAt(lightPosition, lightPosition + glm::vec3{ -1.0,  0.0,  0.0 }, glm::vec3{ 0.0, -1.0,  0.0 }));
-            shadowTransforms.push_back(shadowMapProjection *
-                glm::lookAt(lightPosition, lightPosition + glm::vec3{ 0.0,  1.0,  0.0 }, glm::vec3{ 0.0,  0.0,  1.0 }));
-            shadowTransforms.push_back(shadowMapProjection *
-                glm::lookAt(lightPosition, lightPosition + glm::vec3{ 0.0, -1.0,  0.0 }, glm::vec3{ 0.0,  0.0, -1.0 }));
-            shadowTransforms.push_back(shadowMapProjection *
-                glm::lookAt(lightPosition, lightPosition + glm::vec3{ 0.0,  0.0,  1.0 }, glm::vec3{ 0.0, -1.0,  0.0 }));
-            shadowTransforms.push_back(shadowMapProjection *
-                glm::lookAt(lightPosition, lightPosition + glm::vec3{ 0.0,  0.0, -1.0 }, glm::vec3{ 0.0, -1.0,  0.0 }));
+            const PointLight& pointLight = App::scene.pointLights[lightIndex];
 
-            glViewport(0, 0, m_OmnidirectionalShadowMapWidth, m_OmnidirectionalShadowMapHeight);
-            glBindFramebuffer(GL_FRAMEBUFFER, m_OmnidirectionalShadowMapFBO);
+            m_PointLightShadowTransforms[lightIndex] = PointLightShadowTransforms(pointLight);
 
-            glBindTexture(GL_TEXTURE_CUBE_MAP, m_PointLightCubeMaps[pointLightIndex]);
-            glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_PointLightCubeMaps[pointLightIndex], 0);
+            for (size_t face = 0; face < 6; ++face) {
+                shadows.shadowMatrices[lightIndex * 6 + face] = m_PointLightShadowTransforms[lightIndex][face];
+            }
 
-            glClear(GL_DEPTH_BUFFER_BIT);
-            m_OmnidirectionalShadowMappingShader->Bind();
+            shadows.lightPositions[lightIndex] = glm::vec4{ pointLight.position, pointLight.shadowMapFarPlane };
 
-            // Render
-            for (const auto& object : App::scene.objects) {
-                m_OmnidirectionalShadowMappingShader->SetMat4("model", App::scene.transformBank[object.transform].matrix);
+            outdated = true;
+        }
 
-                for (int i = 0; i < 6; ++i) {
-                    m_OmnidirectionalShadowMappingShader->SetMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
-                }
+        // Cached lights aren't drawn, so their part of the block doesn't matter
+        if (outdated) {
+            m_PointLightShadowUBO->SetData(shadows);
+        }
+    }
 
-                m_OmnidirectionalShadowMappingShader->SetVec3("lightPosition", lightPosition);
-                m_OmnidirectionalShadowMappingShader->SetFloat("farPlane", pointLight.shadowMapFarPlane);
+    void OpenGlRenderer::RenderOmnidirectionalShadowMaps() {
+        m_RenderedCubeMapCount = 0;
+
+        // Only the cube maps that are drawn again are cleared, the rest of the array keeps its cached depth
+        constexpr float clearDepth = 1.0f;
+
+        // Without clear texture the depth is uploaded, filled in once the first cube map is cleared
+        const bool clearTexture = GLCapabilities::ClearTexture();
+        std::vector<float> clearDepths;
 
-                glBindVertexArray(m_VAOs[object.geometry]);
-                glDrawElements(GL_TRIANGLES, (int)App::scene.geometryBank[object.geometry].indices.size(), GL_UNSIGNED_INT, nullptr);
+        for (LightIndex lightIndex = 0; lightIndex < m_ShadowedPointLightCount; ++lightIndex) {
+            if (!m_PointLightShadowMapOutdated[lightIndex]) {
+                continue;
             }
 
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            ++pointLightIndex;
+            m_PointLightShadowMapOutdated[lightIndex] = false;
+            ++m_RenderedCubeMapCount;
+
+            if (clearTexture) {
+                glClearTexSubImage(m_PointLightShadowMaps, 0, 0, 0, static_cast<int>(lightIndex * 6), m_OmnidirectionalShadowMapWidth, m_OmnidirectionalShadowMapHeight, 6, GL_DEPTH_COMPONENT, GL_FLOAT, &clearDepth);
+            } else {
+                if (clearDepths.empty()) {
+                    clearDepths.resize((size_t)m_OmnidirectionalShadowMapWidth * (size_t)m_OmnidirectionalShadowMapHeight * 6, clearDepth);
+                }
+
+                m_StateCache.BindTexture(0, GL_TEXTURE_CUBE_MAP_ARRAY, m_PointLightShadowMaps);
+                glTexSubImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, static_cast<int>(lightIndex * 6), m_OmnidirectionalShadowMapWidth, m_OmnidirectionalShadowMapHeight, 6, GL_DEPTH_COMPONENT, GL_FLOAT, clearDepths.data());
+            }
+        }
+
+        if (m_RenderedCubeMapCount == 0) {
+            return;
+        }
+
+        if (App::settings.culledFaceDuringOmnidirectionalShadowMapping == GeometricFace::FRONT) {
+            m_StateCache.CullFace(GL_FRONT);
+        } else {
+            m_StateCache.CullFace(GL_BACK);
         }
+
+        m_StateCache.Viewport(0, 0, m_OmnidirectionalShadowMapWidth, m_OmnidirectionalShadowMapHeight);
+        m_StateCache.BindFramebuffer(m_OmnidirectionalShadowMapFBO);
+
+        m_StateCache.UseProgram(m_OmnidirectionalShadowMappingShader->Handle());
+
+        // Every object and light pair is an instance, the geometry shader sends it to the faces it is visible in
+        DrawObjects(m_PointLightDrawList);
     }
 
-    void OpenGlRenderer::RenderCascadingShadowMaps() {
+    void OpenGlRenderer::CalculateCascades() {
         float distance = abs(App::settings.farPlane - App::settings.nearPlane);
 
         // There should be one more plane than cascades
@@ -433,280 +610,635 @@ namespace Rutile {
             m_LightSpaceMatrices.push_back(lightViewProjection);
         }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, m_CascadingShadowMapFBO);
-
-        glViewport(0, 0, m_CascadingShadowMapWidth, m_CascadingShadowMapHeight);
-        glClear(GL_DEPTH_BUFFER_BIT);
+        UploadCascadeData();
+    }
 
-        m_CascadingShadowMapShader->Bind();
+    void OpenGlRenderer::RenderCascadingShadowMaps() {
+        if (App::settings.culledFaceDuringDirectionalShadowMapping == GeometricFace::FRONT) {
+            m_StateCache.CullFace(GL_FRONT);
+        } else {
+            m_StateCache.CullFace(GL_BACK);
+        }
 
-        for (const auto& object : App::scene.objects) {
-            m_CascadingShadowMapShader->SetMat4("model", App::scene.transformBank[object.transform].matrix);
+        m_StateCache.BindFramebuffer(m_CascadingShadowMapFBO);
 
-            for (int i = 0; i < m_CascadeCount; ++i) {
-                m_CascadingShadowMapShader->SetMat4("lightSpaceMatrices[" + std::to_string(i) + "]", m_LightSpaceMatrices[i]);
-            }
+        m_StateCache.Viewport(0, 0, m_CascadingShadowMapWidth, m_CascadingShadowMapHeight);
+        glClear(GL_DEPTH_BUFFER_BIT);
 
-            glBindVertexArray(m_VAOs[object.geometry]);
-            glDrawElements(GL_TRIANGLES, (int)App::scene.geometryBank[object.geometry].indices.size(), GL_UNSIGNED_INT, nullptr);
-        }
+        m_StateCache.UseProgram(m_CascadingShadowMapShader->Handle());
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        DrawObjects(m_CascadeDrawList);
     }
 
     void OpenGlRenderer::RenderScene() {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, App::screenWidth, App::screenHeight);
+        m_StateCache.BindFramebuffer(0);
+        m_StateCache.Viewport(0, 0, App::screenWidth, App::screenHeight);
 
         glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         if (App::settings.culledFaceDuringRendering == GeometricFace::FRONT) {
-            glCullFace(GL_FRONT);
+            m_StateCache.CullFace(GL_FRONT);
         }
         else {
-            glCullFace(GL_BACK);
+            m_StateCache.CullFace(GL_BACK);
         }
 
-        for (const auto& object : App::scene.objects) {
-            Shader* shaderProgram = nullptr;
+        // Everything that changes per object lives in m_ObjectSSBO, so the shader and its uniforms are set once
+        Shader* shaderProgram = nullptr;
 
-            Transform& transform = App::scene.transformBank[object.transform];
+        switch (App::settings.materialType) {
+            case MaterialType::SOLID: {
+                shaderProgram = m_SolidShader.get();
+                m_StateCache.UseProgram(shaderProgram->Handle());
 
-            Material mat = App::scene.materialBank[object.material];
+                break;
+            }
+            case MaterialType::PHONG: {
+                shaderProgram = m_PhongShader.get();
+                m_StateCache.UseProgram(shaderProgram->Handle());
 
-            switch (App::settings.materialType) {
-                case MaterialType::SOLID: {
-                    shaderProgram = m_SolidShader.get();
-                    shaderProgram->Bind();
+                const PhongUniforms& uniforms = m_PhongUniforms;
 
-                    // Material
-                    shaderProgram->SetVec4("color", glm::vec4{ mat.solid.color, 1.0f });
+                // Directional Light
+                if (App::scene.HasDirectionalLight()) {
+                    shaderProgram->Set(uniforms.directionalShadows, App::settings.directionalShadows);
 
-                    break;
+                    m_StateCache.BindTexture(4, GL_TEXTURE_2D_ARRAY, m_CascadingShadowMapTexture);
+                    shaderProgram->Set(uniforms.cascadingShadowMap, 4);
+                } else {
+                    shaderProgram->Set(uniforms.directionalShadows, false);
                 }
-                case MaterialType::PHONG: {
-                    shaderProgram = m_PhongShader.get();
-                    shaderProgram->Bind();
 
-                    // Material
-                    shaderProgram->SetVec3("phong.ambient", mat.phong.ambient);
-                    shaderProgram->SetVec3("phong.diffuse", mat.phong.diffuse);
-                    shaderProgram->SetVec3("phong.specular", mat.phong.specular);
+                // Point Lights
+                m_StateCache.BindTexture(0, GL_TEXTURE_CUBE_MAP_ARRAY, m_PointLightShadowMaps);
+                shaderProgram->Set(uniforms.pointLightShadowMaps, 0);
 
-                    shaderProgram->SetFloat("phong.shininess", mat.phong.shininess);
+                shaderProgram->Set(uniforms.clusteredShading, m_ClusteredShading);
 
-                    // Lighting
-                    shaderProgram->SetMat4("model", transform.matrix);
+                // Omnidirectional Shadow map Settings
+                shaderProgram->Set(uniforms.omnidirectionalShadowMaps, App::settings.omnidirectionalShadowMaps);
 
-                    shaderProgram->SetVec3("cameraPosition", App::camera.position);
+                shaderProgram->Set(uniforms.omnidirectionalShadowMapBias, App::settings.omnidirectionalShadowMapBias);
 
-                    // Lights
+                shaderProgram->Set(uniforms.omnidirectionalShadowMapPCFMode, (int)App::settings.omnidirectionalShadowMapPCFMode);
 
-                    // Directional Light
-                    if (App::scene.HasDirectionalLight()) {
-                        shaderProgram->SetBool("haveDirectionalLight", true);
+                shaderProgram->Set(uniforms.omnidirectionalShadowMapSampleCount, App::settings.omnidirectionalShadowMapSampleCount);
 
-                        shaderProgram->SetVec3("directionalLight.direction", App::scene.directionalLight.direction);
+                shaderProgram->Set(uniforms.omnidirectionalShadowMapDiskRadiusMode, (int)App::settings.omnidirectionalShadowMapDiskRadiusMode);
+                shaderProgram->Set(uniforms.omnidirectionalShadowMapDiskRadius, App::settings.omnidirectionalShadowMapDiskRadius);
 
-                        shaderProgram->SetVec3("directionalLight.ambient", App::scene.directionalLight.ambient);
-                        shaderProgram->SetVec3("directionalLight.diffuse", App::scene.directionalLight.diffuse);
-                        shaderProgram->SetVec3("directionalLight.specular", App::scene.directionalLight.specular);
+                break;
+            }
+        }
 
-                        shaderProgram->SetBool("directionalShadows", App::settings.directionalShadows);
+        DrawObjects(m_SceneDrawList);
+    }
 
-                        shaderProgram->SetMat4("view", App::camera.View()); // TODO might need to cache viewMatrix
+    void OpenGlRenderer::UploadFrameData() {
+        // Camera
+        CameraBlock camera{ };
+        camera.projection = m_Projection;
+        camera.view = App::camera.View();
+        camera.position = App::camera.position;
 
-                        shaderProgram->SetInt("cascadeCount", m_CascadeCount);
+        m_CameraUBO->SetData(camera);
 
-                        int i = 0;
-                        for (const float& plane : m_CascadingFrustumPlanes) {
-                            shaderProgram->SetFloat("cascadeFrustumPlanes[" + std::to_string(i) + "]", plane);
+        // Lights
+        LightBlock lights{ };
 
-                            ++i;
-                        }
+        if (App::scene.HasDirectionalLight()) {
+            lights.haveDirectionalLight = 1;
 
-                        i = 0;
-                        for (const glm::mat4& mat : m_LightSpaceMatrices) {
-                            shaderProgram->SetMat4("lightSpaceMatrices[" + std::to_string(i) + "]", mat);
-                            ++i;
-                        }
+            lights.directionalLight.direction = App::scene.directionalLight.direction;
+            lights.directionalLight.ambient = App::scene.directionalLight.ambient;
+            lights.directionalLight.diffuse = App::scene.directionalLight.diffuse;
+            lights.directionalLight.specular = App::scene.directionalLight.specular;
+        }
 
-                        shaderProgram->SetFloat("farPlane", App::settings.farPlane);
+        lights.pointLightCount = static_cast<int>(App::scene.pointLights.size());
+        lights.shadowedPointLightCount = static_cast<int>(m_ShadowedPointLightCount);
 
-                        glActiveTexture(GL_TEXTURE4);
-                        glBindTexture(GL_TEXTURE_2D_ARRAY, m_CascadingShadowMapTexture);
-                        shaderProgram->SetInt("cascadingShadowMap", 4);
+        m_LightUBO->SetData(lights);
 
-                    } else {
-                        shaderProgram->SetBool("haveDirectionalLight", false);
-                        shaderProgram->SetBool("directionalShadows",   false);
-                    }
+        // Point lights, any number of them
+        std::vector<PointLightData> pointLights{ };
+        pointLights.reserve(App::scene.pointLights.size());
+
+        for (const PointLight& pointLight : App::scene.pointLights) {
+            PointLightData light{ };
+
+            light.position = pointLight.position;
+
+            light.constant = pointLight.constant;
+            light.linear = pointLight.linear;
+            light.quadratic = pointLight.quadratic;
+
+            light.ambient = pointLight.ambient;
+            light.diffuse = pointLight.diffuse;
+            light.specular = pointLight.specular;
+
+            light.farPlane = pointLight.shadowMapFarPlane;
+
+            pointLights.push_back(light);
+        }
+
+        m_PointLightSSBO->SetData(pointLights);
+
+        // Objects
+        std::vector<ObjectData> objects{ };
+        objects.reserve(App::scene.objects.size());
+
+        for (const auto& object : App::scene.objects) {
+            const Material& mat = App::scene.materialBank[object.material];
+
+            ObjectData data{ };
+            data.model = App::scene.transformBank[object.transform].matrix;
+
+            data.solidColor = glm::vec4{ mat.solid.color, 1.0f };
+
+            data.phongAmbient = glm::vec4{ mat.phong.ambient, 0.0f };
+            data.phongDiffuse = glm::vec4{ mat.phong.diffuse, 0.0f };
+            data.phongSpecular = glm::vec4{ mat.phong.specular, mat.phong.shininess };
+
+            objects.push_back(data);
+        }
+
+        m_ObjectSSBO->SetData(objects);
+    }
+
+    void OpenGlRenderer::UploadCascadeData() {
+        CascadeBlock cascades{ };
 
-                    // Point Lights
-                    shaderProgram->SetInt("pointLightCount", static_cast<int>(App::scene.pointLights.size()));
-                    LightIndex lightIndex = 0;
-                    for (const auto& pointLight : App::scene.pointLights) {
-                        std::string prefix = "pointLights[" + std::to_string(lightIndex) + "].";
-
-                        shaderProgram->SetVec3(prefix + "position", pointLight.position);
-
-                        shaderProgram->SetFloat(prefix + "constant", pointLight.constant);
-                        shaderProgram->SetFloat(prefix + "linear", pointLight.linear);
-                        shaderProgram->SetFloat(prefix + "quadratic", pointLight.quadratic);
-
-                        shaderProgram->SetVec3(prefix + "ambient", pointLight.ambient);
-                        shaderProgram->SetVec3(prefix + "diffuse", pointLight.diffuse);
-                        shaderProgram->SetVec3(prefix + "specular", pointLight.specular);
-
-                        shaderProgram->SetFloat(prefix + "farPlane", pointLight.shadowMapFarPlane);
-
-                        glActiveTexture(GL_TEXTURE0 + static_cast<int>(lightIndex));
-                        glBindTexture(GL_TEXTURE_CUBE_MAP, m_PointLightCubeMaps[lightIndex]);
-                        switch (lightIndex) {
-                        case 0:
-                            shaderProgram->SetInt("pointLightCubeMap0", static_cast<int>(lightIndex));
-                            break;
-                        case 1:
-                            shaderProgram->SetInt("pointLightCubeMap1", static_cast<int>(lightIndex));
-                            break;
-                        case 2:
-                            shaderProgram->SetInt("pointLightCubeMap2", static_cast<int>(lightIndex));
-                            break;
-                        case 3:
-                            shaderProgram->SetInt("pointLightCubeMap3", static_cast<int>(lightIndex));
-                            break;
-                        }
-                        ++lightIndex;
+        for (size_t i = 0; i < m_LightSpaceMatrices.size() && i < cascades.lightSpaceMatrices.size(); ++i) {
+            cascades.lightSpaceMatrices[i] = m_LightSpaceMatrices[i];
+        }
+
+        for (size_t i = 0; i < m_CascadingFrustumPlanes.size() && i < cascades.cascadeFrustumPlanes.size(); ++i) {
+            cascades.cascadeFrustumPlanes[i].x = m_CascadingFrustumPlanes[i];
+        }
+
+        cascades.cascadeCount = m_CascadeCount;
+        cascades.farPlane = App::settings.farPlane;
+
+        m_CascadeUBO->SetData(cascades);
+    }
+
+    void OpenGlRenderer::CalculateClusterBounds() {
+        const glm::mat4 inverseProjection = glm::inverse(m_Projection);
+
+        m_ClusterBounds.resize((size_t)clusterCountX * clusterCountY * clusterCountZ);
+
+        for (unsigned int z = 0; z < clusterCountZ; ++z) {
+            // Exponential slices keep clusters close to cubes as they get further from the camera
+            const float depthRatio = App::settings.farPlane / App::settings.nearPlane;
+            const float nearDepth = App::settings.nearPlane * std::pow(depthRatio, (float)z / (float)clusterCountZ);
+            const float farDepth = App::settings.nearPlane * std::pow(depthRatio, (float)(z + 1) / (float)clusterCountZ);
+
+            for (unsigned int y = 0; y < clusterCountY; ++y) {
+                for (unsigned int x = 0; x < clusterCountX; ++x) {
+                    glm::vec3 min{ std::numeric_limits<float>::max() };
+                    glm::vec3 max{ std::numeric_limits<float>::lowest() };
+
+                    // The tile's corners on the near plane, pushed out along their view rays to both ends of the slice
+                    for (unsigned int corner = 0; corner < 4; ++corner) {
+                        const float ndcX = -1.0f + 2.0f * (float)(x + (corner & 1u)) / (float)clusterCountX;
+                        const float ndcY = -1.0f + 2.0f * (float)(y + (corner >> 1u)) / (float)clusterCountY;
+
+                        glm::vec4 point = inverseProjection * glm::vec4{ ndcX, ndcY, -1.0f, 1.0f };
+                        const glm::vec3 ray = glm::vec3{ point / point.w } / -(point.z / point.w);
+
+                        min = glm::min(min, glm::min(ray * nearDepth, ray * farDepth));
+                        max = glm::max(max, glm::max(ray * nearDepth, ray * farDepth));
                     }
 
-                    // Omnidirectional Shadow map Settings
-                    shaderProgram->SetBool("omnidirectionalShadowMaps", App::settings.omnidirectionalShadowMaps);
+                    m_ClusterBounds[x + clusterCountX * (y + clusterCountY * z)] = std::make_pair(min, max);
+                }
+            }
+        }
+
+        ClusterBlock cluster{ };
+        cluster.gridSize = glm::uvec4{ clusterCountX, clusterCountY, clusterCountZ, 0 };
+        cluster.screenSize = glm::vec2{ (float)App::screenWidth, (float)App::screenHeight };
+        cluster.nearPlane = App::settings.nearPlane;
+        cluster.farPlane = App::settings.farPlane;
+
+        m_ClusterUBO->SetData(cluster);
+    }
+
+    void OpenGlRenderer::AssignLightsToClusters() {
+        TimeScope lightAssignmentTimeScope{ &m_LightAssignmentTime };
+
+        // Only the phong shader reads the clusters
+        if (!m_ClusteredShading || App::settings.materialType != MaterialType::PHONG) {
+            return;
+        }
+
+        if (m_ClusterBoundsOutdated) {
+            CalculateClusterBounds();
+
+            m_ClusterBoundsOutdated = false;
+        }
+
+        // Every light as a sphere in view space
+        const glm::mat4 view = App::camera.View();
+
+        m_ClusterLights.clear();
+        m_ClusterLights.reserve(App::scene.pointLights.size());
 
-                    shaderProgram->SetFloat("omnidirectionalShadowMapBias", App::settings.omnidirectionalShadowMapBias);
+        for (const PointLight& pointLight : App::scene.pointLights) {
+            ClusterLight light{ };
+            light.center = glm::vec3{ view * glm::vec4{ pointLight.position, 1.0f } };
+            light.radius = PointLightRange(pointLight);
 
-                    shaderProgram->SetInt("omnidirectionalShadowMapPCFMode", (int)App::settings.omnidirectionalShadowMapPCFMode);
+            const float depth = -light.center.z;
+            light.firstSlice = ClusterSlice(depth - light.radius);
+            light.lastSlice = depth + light.radius < App::settings.nearPlane ? -1 : ClusterSlice(depth + light.radius);
+
+            m_ClusterLights.push_back(light);
+        }
+
+        // Slices don't share any clusters, so each of them is filled in on its own thread
+        m_ClusterRanges.resize(m_ClusterBounds.size());
+        m_SliceLightIndices.resize(clusterCountZ);
+
+        for (size_t slice = 0; slice < clusterCountZ; ++slice) {
+            m_ClusterThreadPool->QueueJob([this](size_t slice) { AssignLightsToSlice(slice); }, slice);
+        }
 
-                    shaderProgram->SetInt("omnidirectionalShadowMapSampleCount", App::settings.omnidirectionalShadowMapSampleCount);
+        m_ClusterThreadPool->WaitForCompletion();
 
-                    shaderProgram->SetInt("omnidirectionalShadowMapDiskRadiusMode", (int)App::settings.omnidirectionalShadowMapDiskRadiusMode);
-                    shaderProgram->SetFloat("omnidirectionalShadowMapDiskRadius", App::settings.omnidirectionalShadowMapDiskRadius);
+        // Merge the slices into a single list
+        m_ClusterLightIndices.clear();
 
-                    break;
+        for (size_t slice = 0; slice < clusterCountZ; ++slice) {
+            const unsigned int sliceOffset = static_cast<unsigned int>(m_ClusterLightIndices.size());
+
+            for (size_t cluster = slice * clusterCountX * clusterCountY; cluster < (slice + 1) * clusterCountX * clusterCountY; ++cluster) {
+                m_ClusterRanges[cluster].offset += sliceOffset;
+            }
+
+            m_ClusterLightIndices.insert(m_ClusterLightIndices.end(), m_SliceLightIndices[slice].begin(), m_SliceLightIndices[slice].end());
+        }
+
+        m_ClusterSSBO->SetData(m_ClusterRanges);
+        m_ClusterLightIndexSSBO->SetData(m_ClusterLightIndices);
+    }
+
+    void OpenGlRenderer::AssignLightsToSlice(size_t slice) {
+        std::vector<unsigned int>& indices = m_SliceLightIndices[slice];
+        indices.clear();
+
+        // Lights reaching this slice at all
+        std::vector<unsigned int> sliceLights{ };
+        for (size_t i = 0; i < m_ClusterLights.size(); ++i) {
+            if (m_ClusterLights[i].firstSlice <= (int)slice && (int)slice <= m_ClusterLights[i].lastSlice) {
+                sliceLights.push_back(static_cast<unsigned int>(i));
+            }
+        }
+
+        for (size_t cluster = slice * clusterCountX * clusterCountY; cluster < (slice + 1) * clusterCountX * clusterCountY; ++cluster) {
+            const auto& [min, max] = m_ClusterBounds[cluster];
+
+            ClusterRange& range = m_ClusterRanges[cluster];
+            range.offset = static_cast<unsigned int>(indices.size());
+
+            for (unsigned int lightIndex : sliceLights) {
+                const ClusterLight& light = m_ClusterLights[lightIndex];
+
+                const glm::vec3 distance = glm::max(glm::max(min - light.center, light.center - max), glm::vec3{ 0.0f });
+
+                if (glm::dot(distance, distance) <= light.radius * light.radius) {
+                    indices.push_back(lightIndex);
                 }
             }
 
-            /*
-             *
-            switch (m_MaterialTypes[i]) {
-                case MaterialType::SOLID: {
-                    Solid* solid = dynamic_cast<Solid*>(m_Materials[i]);
+            range.count = static_cast<unsigned int>(indices.size()) - range.offset;
+        }
+    }
+
+    float OpenGlRenderer::PointLightRange(const PointLight& pointLight) const {
+        const float intensity = std::max({
+            pointLight.ambient.r,  pointLight.ambient.g,  pointLight.ambient.b,
+            pointLight.diffuse.r,  pointLight.diffuse.g,  pointLight.diffuse.b,
+            pointLight.specular.r, pointLight.specular.g, pointLight.specular.b
+        });
+
+        // Solve intensity / (constant + linear * d + quadratic * d^2) = 1 / 256 for d
+        const float c = pointLight.constant - intensity * 256.0f;
+
+        if (pointLight.quadratic > 0.0f) {
+            const float discriminant = pointLight.linear * pointLight.linear - 4.0f * pointLight.quadratic * c;
+            return std::max((-pointLight.linear + std::sqrt(std::max(discriminant, 0.0f))) / (2.0f * pointLight.quadratic), 0.0f);
+        }
+
+        if (pointLight.linear > 0.0f) {
+            return std::max(-c / pointLight.linear, 0.0f);
+        }
+
+        // Never fades out
+        return std::numeric_limits<float>::max();
+    }
 
-                    shaderProgram = m_SolidShader.get();
-                    shaderProgram->Bind();
+    int OpenGlRenderer::ClusterSlice(float depth) const {
+        if (depth <= App::settings.nearPlane) {
+            return 0;
+        }
 
-                    m_SolidShader->SetVec3("color", solid->color);
-                    break;
+        if (depth >= App::settings.farPlane) {
+            return (int)clusterCountZ - 1;
+        }
+
+        const int slice = (int)(std::log(depth / App::settings.nearPlane) * (float)clusterCountZ / std::log(App::settings.farPlane / App::settings.nearPlane));
+
+        return std::min(slice, (int)clusterCountZ - 1);
+    }
+
+    OpenGlRenderer::DrawList OpenGlRenderer::BuildDrawList(const std::vector<uint32_t>& masks) {
+        return BuildDrawList(std::span{ &masks, 1 });
+    }
+
+    OpenGlRenderer::DrawList OpenGlRenderer::BuildDrawList(std::span<const std::vector<uint32_t>> maskSets) {
+        DrawList drawList{ };
+        drawList.firstCommand = m_DrawCommands.size();
+
+        for (GeometryIndex geometry = 0; geometry < m_ObjectsByGeometry.size(); ++geometry) {
+            const size_t firstInstance = m_DrawInstances.size();
+
+            for (const std::vector<uint32_t>& masks : maskSets) {
+                for (ObjectIndex objectIndex : m_ObjectsByGeometry[geometry]) {
+                    if (masks[objectIndex] != 0) {
+                        m_DrawInstances.push_back(DrawInstance{ static_cast<unsigned int>(objectIndex), masks[objectIndex] });
+                    }
                 }
-                case MaterialType::PHONG: {
-                    Phong* phong = dynamic_cast<Phong*>(m_Materials[i]);
+            }
 
-                    shaderProgram = m_PhongShader.get();
-                    shaderProgram->Bind();
+            if (m_DrawInstances.size() == firstInstance) {
+                continue;
+            }
 
-                    m_PhongShader->SetVec3("phong.ambient", phong->ambient);
-                    m_PhongShader->SetVec3("phong.diffuse", phong->diffuse);
-                    m_PhongShader->SetVec3("phong.specular", phong->specular);
+            AppendDrawCommand(geometry, firstInstance, drawList);
+        }
 
-                    m_PhongShader->SetFloat("phong.shininess", phong->shininess);
+        return drawList;
+    }
 
-                    shaderProgram->SetMat4("model", m_Transforms[i]->matrix);
+    OpenGlRenderer::DrawList OpenGlRenderer::BuildSortedDrawList(const std::vector<uint32_t>& masks) {
+        m_DrawItems.clear();
 
-                    m_PhongShader->SetVec3("cameraPosition", App::camera.position);
+        const uint64_t shader = static_cast<uint64_t>(App::settings.materialType);
 
-                    m_PhongShader->SetMat4("lightSpaceMatrix", m_LightSpaceMatrix);
+        for (ObjectIndex objectIndex = 0; objectIndex < masks.size(); ++objectIndex) {
+            if (masks[objectIndex] == 0) {
+                continue;
+            }
 
-                    // Lighting
-                    m_PhongShader->SetInt("pointLightCount", static_cast<int>(m_PointLights.size()));
-                    for (size_t j = 0; j < m_PointLights.size(); ++j) {
-                        if (m_PointLights[j] == nullptr) {
-                            continue;
-                        }
+            const glm::vec3 center{ m_ObjectBounds.centerX[objectIndex], m_ObjectBounds.centerY[objectIndex], m_ObjectBounds.centerZ[objectIndex] };
+            const glm::vec3 offset = center - App::camera.position;
 
-                        std::string prefix = "pointLights[" + std::to_string(j) + "].";
+            // Non negative floats sort the same as their bit patterns
+            const uint64_t depth = std::bit_cast<uint32_t>(glm::dot(offset, offset));
+            const uint64_t geometry = static_cast<uint64_t>(App::scene.objects[objectIndex].geometry) & 0xFFFFFF;
 
-                        m_PhongShader->SetVec3(prefix + "position", m_PointLights[j]->position);
+            m_DrawItems.push_back(DrawItem{ (shader << 56) | (geometry << 32) | depth, objectIndex });
+        }
 
-                        m_PhongShader->SetFloat(prefix + "constant", m_PointLights[j]->constant);
-                        m_PhongShader->SetFloat(prefix + "linear", m_PointLights[j]->linear);
-                        m_PhongShader->SetFloat(prefix + "quadratic", m_PointLights[j]->quadratic);
+        std::sort(m_DrawItems.begin(), m_DrawItems.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
 
+        DrawList drawList{ };
+        drawList.firstCommand = m_DrawCommands.size();
 
-                        m_PhongShader->SetVec3(prefix + "ambient", m_PointLights[j]->ambient);
-                        m_PhongShader->SetVec3(prefix + "diffuse", m_PointLights[j]->diffuse);
-                        m_PhongShader->SetVec3(prefix + "specular", m_PointLights[j]->specular);
+        // Consecutive items with the same geometry become instances of one command
+        for (size_t i = 0; i < m_DrawItems.size();) {
+            const GeometryIndex geometry = App::scene.objects[m_DrawItems[i].objectIndex].geometry;
+            const size_t firstInstance = m_DrawInstances.size();
 
+            for (; i < m_DrawItems.size() && App::scene.objects[m_DrawItems[i].objectIndex].geometry == geometry; ++i) {
+                const ObjectIndex objectIndex = m_DrawItems[i].objectIndex;
+                m_DrawInstances.push_back(DrawInstance{ static_cast<unsigned int>(objectIndex), masks[objectIndex] });
+            }
 
-                        prefix = "omnidirectionalShadowMaps[" + std::to_string(j) + "]";
+            AppendDrawCommand(geometry, firstInstance, drawList);
+        }
 
-                        glActiveTexture(GL_TEXTURE0 + (unsigned int)j);
-                        glBindTexture(GL_TEXTURE_CUBE_MAP, m_PointLightCubeMaps[j]);
-                        m_PhongShader->SetInt(prefix, (int)j);
+        return drawList;
+    }
 
-                        m_PhongShader->SetFloat("farPlane", 25.0f); // TODO
-                    }
+    void OpenGlRenderer::AppendDrawCommand(GeometryIndex geometry, size_t firstInstance, DrawList& drawList) {
+        const GeometryArena::Allocation& allocation = m_GeometryAllocations[geometry];
 
-                    glActiveTexture(GL_TEXTURE0 + 5);
-                    glBindTexture(GL_TEXTURE_2D, m_ShadowMapTexture);
+        DrawElementsIndirectCommand command{ };
+        command.count = static_cast<unsigned int>(allocation.indexCount);
+        command.instanceCount = static_cast<unsigned int>(m_DrawInstances.size() - firstInstance);
+        command.firstIndex = static_cast<unsigned int>(allocation.firstIndex);
+        command.baseVertex = static_cast<int>(allocation.firstVertex);
+        command.baseInstance = static_cast<unsigned int>(firstInstance);
 
-                    m_PhongShader->SetInt("shadowMap", 0 + 5);
+        m_DrawCommands.push_back(command);
 
-                    if (m_DirectionalLight) {
-                        m_PhongShader->SetVec3("directionalLight.direction", m_DirectionalLight->direction);
+        drawList.instanceCount += command.instanceCount;
+        drawList.commandCount = m_DrawCommands.size() - drawList.firstCommand;
+    }
 
-                        m_PhongShader->SetVec3("directionalLight.ambient", m_DirectionalLight->ambient);
-                        m_PhongShader->SetVec3("directionalLight.diffuse", m_DirectionalLight->diffuse);
-                        m_PhongShader->SetVec3("directionalLight.specular", m_DirectionalLight->specular);
-                    }
+    void OpenGlRenderer::BuildDrawLists(bool renderCascades) {
+        TimeScope cullingTimeScope{ &m_CullingTime };
 
-                    m_PhongShader->SetInt("spotLightCount", static_cast<int>(m_SpotLights.size()));
+        const size_t objectCount = App::scene.objects.size();
 
-                    for (size_t j = 0; j < m_SpotLights.size(); ++j) {
-                        if (m_SpotLights[j] == nullptr) {
-                            continue;
-                        }
+        m_DrawCommands.clear();
+        m_DrawInstances.clear();
 
-                        std::string prefix = "spotLights[" + std::to_string(j) + "].";
+        // Scene
+        if (m_Culling) {
+            m_CullingMasks.assign(objectCount, 0);
+            ObjectCulling::CullAgainstFrustum(m_ObjectBounds, Frustum::FromMatrix(m_Projection * App::camera.View()), 1, m_CullingMasks);
+        } else {
+            m_CullingMasks.assign(objectCount, 1);
+        }
+
+        m_SceneDrawList = m_SortDraws ? BuildSortedDrawList(m_CullingMasks) : BuildDrawList(m_CullingMasks);
+        m_SceneCulledObjects = objectCount - m_SceneDrawList.instanceCount;
 
-                        m_PhongShader->SetVec3(prefix + "position", m_SpotLights[j]->position);
-                        m_PhongShader->SetVec3(prefix + "direction", m_SpotLights[j]->direction);
+        // Cascades, one bit per cascade
+        m_CascadeCulledObjects = 0;
+        m_CascadeCulledLayers = 0;
 
-                        m_PhongShader->SetFloat(prefix + "cutOff", m_SpotLights[j]->cutOff);
-                        m_PhongShader->SetFloat(prefix + "outerCutOff", m_SpotLights[j]->outerCutOff);
+        if (renderCascades) {
+            const uint32_t allCascades = (1u << m_CascadeCount) - 1u;
 
-                        m_PhongShader->SetFloat(prefix + "constant", m_SpotLights[j]->constant);
-                        m_PhongShader->SetFloat(prefix + "linear", m_SpotLights[j]->linear);
-                        m_PhongShader->SetFloat(prefix + "quadratic", m_SpotLights[j]->quadratic);
+            if (m_Culling) {
+                m_CullingMasks.assign(objectCount, 0);
 
-                        m_PhongShader->SetVec3(prefix + "ambient", m_SpotLights[j]->ambient);
-                        m_PhongShader->SetVec3(prefix + "diffuse", m_SpotLights[j]->diffuse);
-                        m_PhongShader->SetVec3(prefix + "specular", m_SpotLights[j]->specular);
+                for (size_t i = 0; i < m_LightSpaceMatrices.size(); ++i) {
+                    ObjectCulling::CullAgainstFrustum(m_ObjectBounds, Frustum::FromMatrix(m_LightSpaceMatrices[i]), 1u << i, m_CullingMasks);
+                }
+            } else {
+                m_CullingMasks.assign(objectCount, allCascades);
+            }
+
+            for (uint32_t mask : m_CullingMasks) {
+                m_CascadeCulledLayers += (size_t)m_CascadeCount - (size_t)std::popcount(mask);
+            }
+
+            m_CascadeDrawList = BuildDrawList(m_CullingMasks);
+            m_CascadeCulledObjects = objectCount - m_CascadeDrawList.instanceCount;
+        }
+
+        // Point lights, bits 0 to 5 are the cube faces and the light's index is above them. All outdated lights go
+        // into one draw list so that each geometry is drawn once for all of them
+        m_PointLightCulledObjects = 0;
+        m_PointLightCulledLayers = 0;
+
+        constexpr uint32_t allFaces = (1u << 6) - 1u;
+        constexpr uint32_t inRange = 1u << 6;
+
+        size_t maskSetCount = 0;
+
+        for (LightIndex lightIndex = 0; lightIndex < m_ShadowedPointLightCount; ++lightIndex) {
+            const PointLight& pointLight = App::scene.pointLights[lightIndex];
+
+            // The cached cube map is used
+            if (!m_PointLightShadowMapOutdated[lightIndex]) {
+                continue;
+            }
+
+            if (m_PointLightCullingMasks.size() <= maskSetCount) {
+                m_PointLightCullingMasks.emplace_back();
+            }
+
+            std::vector<uint32_t>& masks = m_PointLightCullingMasks[maskSetCount++];
+
+            const uint32_t light = static_cast<uint32_t>(lightIndex) << pointLightIndexShift;
+
+            if (m_Culling) {
+                masks.assign(objectCount, 0);
+
+                ObjectCulling::CullAgainstSphere(m_ObjectBounds, pointLight.position, pointLight.shadowMapFarPlane, inRange, masks);
+
+                for (uint32_t face = 0; face < 6; ++face) {
+                    ObjectCulling::CullAgainstFrustum(m_ObjectBounds, Frustum::FromMatrix(m_PointLightShadowTransforms[lightIndex][face]), 1u << face, masks);
+                }
+
+                for (uint32_t& mask : masks) {
+                    mask = (mask & inRange) ? (mask & allFaces) : 0;
+
+                    m_PointLightCulledLayers += 6 - (size_t)std::popcount(mask);
+
+                    if (mask == 0) {
+                        ++m_PointLightCulledObjects;
+                    } else {
+                        mask |= light;
                     }
-                    break;
                 }
+            } else {
+                masks.assign(objectCount, allFaces | light);
             }
+        }
+
+        m_PointLightDrawList = BuildDrawList(std::span{ m_PointLightCullingMasks.data(), maskSetCount });
 
-            */
+        // Upload, orphaning the previous frame's buffers
+        glBindBuffer(GL_ARRAY_BUFFER, m_DrawInstanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<int>(m_DrawInstances.size()) * sizeof(DrawInstance), m_DrawInstances.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-            glm::mat4 mvp = m_Projection * App::camera.View() * App::scene.transformBank[object.transform].matrix;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_DrawIndirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, static_cast<int>(m_DrawCommands.size()) * sizeof(DrawElementsIndirectCommand), m_DrawCommands.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    void OpenGlRenderer::DrawObjects(const DrawList& drawList) {
+        if (drawList.commandCount == 0) {
+            return;
+        }
 
-            shaderProgram->SetMat4("mvp", mvp);
+        m_StateCache.BindVertexArray(m_GeometryArena->VAO());
 
-            glBindVertexArray(m_VAOs[object.geometry]);
-            glDrawElements(GL_TRIANGLES, (int)App::scene.geometryBank[object.geometry].indices.size(), GL_UNSIGNED_INT, nullptr);
+        if (m_MultiDrawIndirect) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_DrawIndirectBuffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(drawList.firstCommand * sizeof(DrawElementsIndirectCommand)), static_cast<GLsizei>(drawList.commandCount), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+            ++m_DrawCallCount;
+        } else {
+            for (size_t i = drawList.firstCommand; i < drawList.firstCommand + drawList.commandCount; ++i) {
+                const DrawElementsIndirectCommand& command = m_DrawCommands[i];
+
+                glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, (int)command.count, GL_UNSIGNED_INT, (void*)(command.firstIndex * sizeof(Index)), (int)command.instanceCount, command.baseVertex, command.baseInstance);
+
+                ++m_DrawCallCount;
+            }
         }
     }
 
+    void OpenGlRenderer::UpdateObjectBounds() {
+        const size_t previousCount = m_ObjectBounds.Size();
+
+        m_ObjectBounds.Resize(App::scene.objects.size());
+        m_ObjectBoundsMatrices.resize(App::scene.objects.size(), glm::mat4{ 0.0f });
+
+        // Transform updates are compared against the matrix directly, so bounds are never a frame behind
+        for (ObjectIndex i = 0; i < App::scene.objects.size(); ++i) {
+            const Object& object = App::scene.objects[i];
+            const glm::mat4& matrix = App::scene.transformBank[object.transform].matrix;
+
+            if (matrix == m_ObjectBoundsMatrices[i]) {
+                continue;
+            }
+
+            // Shadow maps the object was in before it moved
+            if (i < previousCount) {
+                InvalidatePointLightShadowMaps(i);
+            }
+
+            const auto& [min, max] = m_GeometryBounds[object.geometry];
+            m_ObjectBounds.Set(i, min, max, matrix);
+
+            m_ObjectBoundsMatrices[i] = matrix;
+
+            // And the ones it is in now
+            InvalidatePointLightShadowMaps(i);
+
+            m_CascadesOutdated = true;
+        }
+    }
+
+    void OpenGlRenderer::InvalidatePointLightShadowMaps(size_t objectIndex) {
+        const glm::vec3 center{ m_ObjectBounds.centerX[objectIndex], m_ObjectBounds.centerY[objectIndex], m_ObjectBounds.centerZ[objectIndex] };
+        const glm::vec3 extent{ m_ObjectBounds.extentX[objectIndex], m_ObjectBounds.extentY[objectIndex], m_ObjectBounds.extentZ[objectIndex] };
+
+        for (LightIndex i = 0; i < App::scene.pointLights.size(); ++i) {
+            const PointLight& pointLight = App::scene.pointLights[i];
+
+            const glm::vec3 distance = glm::max(glm::abs(center - pointLight.position) - extent, glm::vec3{ 0.0f });
+
+            if (glm::dot(distance, distance) <= pointLight.shadowMapFarPlane * pointLight.shadowMapFarPlane) {
+                m_PointLightShadowMapOutdated[i] = true;
+            }
+        }
+    }
+
+    void OpenGlRenderer::InvalidateAllShadowMaps() {
+        m_PointLightShadowMapOutdated.assign(App::scene.pointLights.size(), true);
+        m_CascadesOutdated = true;
+    }
+
+    std::array<glm::mat4, 6> OpenGlRenderer::PointLightShadowTransforms(const PointLight& pointLight) const {
+        float aspect = (float)m_OmnidirectionalShadowMapWidth / (float)m_OmnidirectionalShadowMapHeight;
+        glm::mat4 shadowMapProjection = glm::perspective(glm::radians(90.0f), aspect, pointLight.shadowMapNearPlane, pointLight.shadowMapFarPlane);
+
+        glm::vec3 lightPosition = pointLight.position;
+
+        return {
+            shadowMapProjection * glm::lookAt(lightPosition, lightPosition + glm::vec3{  1.0,  0.0,  0.0 }, glm::vec3{ 0.0, -1.0,  0.0 }),
+            shadowMapProjection * glm::lookAt(lightPosition, lightPosition + glm::vec3{ -1.0,  0.0,  0.0 }, glm::vec3{ 0.0, -1.0,  0.0 }),
+            shadowMapProjection * glm::lookAt(lightPosition, lightPosition + glm::vec3{  0.0,  1.0,  0.0 }, glm::vec3{ 0.0,  0.0,  1.0 }),
+            shadowMapProjection * glm::lookAt(lightPosition, lightPosition + glm::vec3{  0.0, -1.0,  0.0 }, glm::vec3{ 0.0,  0.0, -1.0 }),
+            shadowMapProjection * glm::lookAt(lightPosition, lightPosition + glm::vec3{  0.0,  0.0,  1.0 }, glm::vec3{ 0.0, -1.0,  0.0 }),
+            shadowMapProjection * glm::lookAt(lightPosition, lightPosition + glm::vec3{  0.0,  0.0, -1.0 }, glm::vec3{ 0.0, -1.0,  0.0 })
+        };
+    }
+
     std::vector<glm::vec4> OpenGlRenderer::GetFrustumCornersInWorldSpace(const glm::mat4& frustum) {
         glm::mat4 invFrustum = glm::inverse(frustum);
 
@@ -727,18 +1259,76 @@ namespace Rutile {
     void OpenGlRenderer::ProjectionMatrixUpdate() {
         m_Projection = glm::mat4{ 1.0f };
         m_Projection = glm::perspective(glm::radians(App::settings.fieldOfView), (float)App::screenWidth / (float)App::screenHeight, App::settings.nearPlane, App::settings.farPlane);
+
+        m_CascadesOutdated = true;
+        m_ClusterBoundsOutdated = true;
     }
 
-    void OpenGlRenderer::LoadScene() {
-        // Lights
+    void OpenGlRenderer::SignalDirectionalLightUpdate() {
+        m_CascadesOutdated = true;
+    }
 
-        // Cleanup old Point Lights
-        for (const auto& cubeMap : m_PointLightCubeMaps) {
-            glDeleteTextures(1, &cubeMap);
+    void OpenGlRenderer::SignalPointLightUpdate(LightIndex i) {
+        if (i < m_PointLightShadowMapOutdated.size()) {
+            m_PointLightShadowMapOutdated[i] = true;
         }
+    }
+
+    void OpenGlRenderer::SignalDirectionalShadowMapUpdate() {
+        m_CascadesOutdated = true;
+    }
+
+    void OpenGlRenderer::ResolveUniformHandles() {
+        PhongUniforms& phong = m_PhongUniforms;
+
+        phong.directionalShadows = m_PhongShader->GetUniform<bool>("directionalShadows");
+        phong.cascadingShadowMap = m_PhongShader->GetUniform<int>("cascadingShadowMap");
+
+        phong.omnidirectionalShadowMaps = m_PhongShader->GetUniform<bool>("omnidirectionalShadowMaps");
+        phong.omnidirectionalShadowMapBias = m_PhongShader->GetUniform<float>("omnidirectionalShadowMapBias");
+        phong.omnidirectionalShadowMapPCFMode = m_PhongShader->GetUniform<int>("omnidirectionalShadowMapPCFMode");
+        phong.omnidirectionalShadowMapSampleCount = m_PhongShader->GetUniform<int>("omnidirectionalShadowMapSampleCount");
+        phong.omnidirectionalShadowMapDiskRadiusMode = m_PhongShader->GetUniform<int>("omnidirectionalShadowMapDiskRadiusMode");
+        phong.omnidirectionalShadowMapDiskRadius = m_PhongShader->GetUniform<float>("omnidirectionalShadowMapDiskRadius");
+
+        phong.pointLightShadowMaps = m_PhongShader->GetUniform<int>("pointLightShadowMaps");
+
+        phong.clusteredShading = m_PhongShader->GetUniform<bool>("clusteredShading");
+    }
+
+    void OpenGlRenderer::CreatePointLightShadowMaps() {
+        // Lights past maxShadowedPointLights are lit without shadows
+        m_ShadowedPointLightCount = std::min(App::scene.pointLights.size(), maxShadowedPointLights);
+
+        // At least one cube map so the texture and framebuffer stay complete in scenes without point lights
+        const int layerCount = 6 * static_cast<int>(std::max(m_ShadowedPointLightCount, (size_t)1));
+
+        glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, m_PointLightShadowMaps);
+        glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_DEPTH_COMPONENT, m_OmnidirectionalShadowMapWidth, m_OmnidirectionalShadowMapHeight, layerCount, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+
+        // Layered, the geometry shader picks the light and face with gl_Layer
+        glBindFramebuffer(GL_FRAMEBUFFER, m_OmnidirectionalShadowMapFBO);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_PointLightShadowMaps, 0);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "ERROR: Omnidirectional shadow map framebuffer is not complete" << std::endl;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        InvalidateAllShadowMaps();
+    }
 
-        m_PointLightCubeMaps.clear();
+    void OpenGlRenderer::LoadScene() {
+        // Lights
 
+        // Cleanup old Point Lights
         m_OmnidirectionalShadowMapVisualizationHorizontalOffsets.clear();
         m_OmnidirectionalShadowMapVisualizationVerticalOffsets.clear();
 
@@ -749,28 +1339,9 @@ namespace Rutile {
         m_CubeMapVisualizationTextures.clear();
 
         // Create new Point Lights
-        LightIndex pointLightIndex = 0;
-        for (const auto& pointLight : App::scene.pointLights) {
-            // Cube map
-            unsigned int cubeMap;
-
-            glGenTextures(1, &cubeMap);
-
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
-            for (int i = 0; i < 6; ++i) {
-                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, m_OmnidirectionalShadowMapWidth,
-                    m_OmnidirectionalShadowMapHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-            }
-
-            glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-
-            m_PointLightCubeMaps.push_back(cubeMap);
+        CreatePointLightShadowMaps();
 
+        for (size_t i = 0; i < App::scene.pointLights.size(); ++i) {
             // Cube map Visualization
             unsigned int cubeMapVisualizationTexture;
 
@@ -783,8 +1354,6 @@ namespace Rutile {
             m_CubeMapVisualizationTextures.push_back(cubeMapVisualizationTexture);
 
             glBindTexture(GL_TEXTURE_2D, 0);
-
-            ++pointLightIndex;
         }
 
         m_OmnidirectionalShadowMapVisualizationHorizontalOffsets.resize(App::scene.pointLights.size());
@@ -793,58 +1362,56 @@ namespace Rutile {
         // Geometry
 
         // Clean up old Geometry
-        glDeleteBuffers(     static_cast<GLsizei>(m_EBOs.size()), m_EBOs.data());
-        glDeleteBuffers(     static_cast<GLsizei>(m_VBOs.size()), m_VBOs.data());
-        glDeleteVertexArrays(static_cast<GLsizei>(m_VAOs.size()), m_VAOs.data());
+        for (const auto& allocation : m_GeometryAllocations) {
+            m_GeometryArena->Remove(allocation);
+        }
 
-        m_VAOs.clear();
-        m_VBOs.clear();
-        m_EBOs.clear();
+        m_GeometryAllocations.clear();
+        m_GeometryBounds.clear();
 
+        // Upload every geometry into the arena
         const size_t geometryCount = App::scene.geometryBank.Size();
 
-        m_VAOs.resize(geometryCount);
-        m_VBOs.resize(geometryCount);
-        m_EBOs.resize(geometryCount);
-
-        glGenVertexArrays(static_cast<GLsizei>(geometryCount), m_VAOs.data());
-        glGenBuffers(     static_cast<GLsizei>(geometryCount), m_VBOs.data());
-        glGenBuffers(     static_cast<GLsizei>(geometryCount), m_EBOs.data());
+        m_GeometryAllocations.reserve(geometryCount);
+        m_GeometryBounds.reserve(geometryCount);
 
         for (size_t i = 0; i < geometryCount; ++i) {
             const Geometry& geo = App::scene.geometryBank[i];
 
-            std::vector<Vertex> vertices = geo.vertices;
-            std::vector<Index> indices   = geo.indices;
+            m_GeometryAllocations.push_back(m_GeometryArena->Add(geo));
 
-            glBindVertexArray(m_VAOs[i]);
+            glm::vec3 min{ std::numeric_limits<float>::max() };
+            glm::vec3 max{ std::numeric_limits<float>::lowest() };
 
-            glBindBuffer(GL_ARRAY_BUFFER, m_VBOs[i]);
-            glBufferData(GL_ARRAY_BUFFER, static_cast<int>(vertices.size()) * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+            for (const auto& vertex : geo.vertices) {
+                min = glm::min(min, vertex.position);
+                max = glm::max(max, vertex.position);
+            }
 
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBOs[i]);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<int>(indices.size()) * sizeof(Index), indices.data(), GL_STATIC_DRAW);
+            if (geo.vertices.empty()) {
+                min = max = glm::vec3{ 0.0f };
+            }
 
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
-            glEnableVertexAttribArray(0);
+            m_GeometryBounds.emplace_back(min, max);
+        }
 
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-            glEnableVertexAttribArray(1);
+        // Objects sharing a geometry become instances of one draw command, see BuildDrawList
+        m_ObjectsByGeometry.assign(geometryCount, { });
+        for (ObjectIndex i = 0; i < App::scene.objects.size(); ++i) {
+            m_ObjectsByGeometry[App::scene.objects[i].geometry].push_back(i);
+        }
 
-            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
-            glEnableVertexAttribArray(2);
+        // Bounds are recalculated from scratch for the new scene
+        m_ObjectBoundsMatrices.clear();
 
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
-            glBindVertexArray(0);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        }
+        InvalidateAllShadowMaps();
     }
 
     void OpenGlRenderer::ProvideLightVisualization(LightIndex lightIndex) {
         if (ImGui::TreeNode("Shadow Map##pointLight")) {
             ImGui::Text("Texture");
-            ImGui::DragInt(("Shadow Map Width##pointLight" + std::to_string(lightIndex)).c_str(), &m_OmnidirectionalShadowMapWidth);
-            ImGui::DragInt(("Shadow Map Height##pointLight" + std::to_string(lightIndex)).c_str(), &m_OmnidirectionalShadowMapHeight);
+            if (ImGui::DragInt(("Shadow Map Width##pointLight" + std::to_string(lightIndex)).c_str(), &m_OmnidirectionalShadowMapWidth))   { CreatePointLightShadowMaps(); }
+            if (ImGui::DragInt(("Shadow Map Height##pointLight" + std::to_string(lightIndex)).c_str(), &m_OmnidirectionalShadowMapHeight)) { CreatePointLightShadowMaps(); }
 
             ImGui::Text("Depth map");
 
@@ -867,8 +1434,8 @@ namespace Rutile {
     void OpenGlRenderer::ProvideCSMVisualization() {
         if (ImGui::TreeNode("Shadow Map##dirLight")) {
 
-            ImGui::DragFloat("Frustum Plane Minimum Multiplier", &m_ZMinMultiplier, 0.1f, 0.0f, 100.0f);
-            ImGui::DragFloat("Frustum Plane Maximum Multiplier", &m_ZMaxMultiplier, 0.1f, 0.0f, 100.0f);
+            if (ImGui::DragFloat("Frustum Plane Minimum Multiplier", &m_ZMinMultiplier, 0.1f, 0.0f, 100.0f)) { m_CascadesOutdated = true; }
+            if (ImGui::DragFloat("Frustum Plane Maximum Multiplier", &m_ZMaxMultiplier, 0.1f, 0.0f, 100.0f)) { m_CascadesOutdated = true; }
 
             ImGui::DragInt("Cascade Visualization Width##cascadeVisualization", &m_CascadeVisualizationWidth, 1.0f, 0, 4096);
             ImGui::DragInt("Cascade Visualization Height##cascadeVisualization", &m_CascadeVisualizationHeight, 1.0f, 0, 4096);
@@ -876,6 +1443,8 @@ namespace Rutile {
             if (ImGui::DragInt("Number of Layers##cascadeVisualization", &m_CascadeCount, 0.01f, 1, m_MaxCascadeCount)) {
                 glBindTexture(GL_TEXTURE_2D_ARRAY, m_CascadingShadowMapTexture);
                 glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, m_CascadingShadowMapWidth, m_CascadingShadowMapHeight, (int)m_CascadeCount, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+
+                m_CascadesOutdated = true;
             }
 
             if (m_CascadeCount != 1) {
@@ -889,6 +1458,78 @@ namespace Rutile {
         }
     }
 
+    void OpenGlRenderer::ProvideTimingStatistics() {
+        ImGui::Separator();
+
+        const auto submitTime = std::chrono::duration_cast<std::chrono::nanoseconds>(m_SubmitTime);
+        ImGui::Text(("CPU Submit Time: " + std::to_string((double)submitTime.count() / 1000000.0) + "ms").c_str());
+
+        const auto cullingTime = std::chrono::duration_cast<std::chrono::nanoseconds>(m_CullingTime);
+        ImGui::Text(("Culling Time: " + std::to_string((double)cullingTime.count() / 1000000.0) + "ms").c_str());
+
+        const auto lightAssignmentTime = std::chrono::duration_cast<std::chrono::nanoseconds>(m_LightAssignmentTime);
+        ImGui::Text(("Light Assignment Time: " + std::to_string((double)lightAssignmentTime.count() / 1000000.0) + "ms").c_str());
+
+        ImGui::Text(("Draw Calls: " + std::to_string(m_DrawCallCount)).c_str());
+        ImGui::Text(("Draw Commands: " + std::to_string(m_DrawCommands.size())).c_str());
+
+        ImGui::Separator();
+
+        // Issued and skipped by m_StateCache this frame
+        const GLStateCache::Counters& counters = m_StateCache.GetCounters();
+
+        auto stateCounterText = [](const std::string& name, const GLStateCache::StateCounter& counter) {
+            ImGui::Text((name + ": " + std::to_string(counter.issued) + " issued, " + std::to_string(counter.skipped) + " skipped").c_str());
+        };
+
+        stateCounterText("Program Binds", counters.programs);
+        stateCounterText("Vertex Array Binds", counters.vertexArrays);
+        stateCounterText("Framebuffer Binds", counters.framebuffers);
+        stateCounterText("Texture Binds", counters.textures);
+        stateCounterText("Cull Face Changes", counters.cullFaces);
+        stateCounterText("Viewport Changes", counters.viewports);
+
+        ImGui::Separator();
+
+        ImGui::Text(("Objects Culled From Scene: " + std::to_string(m_SceneCulledObjects)).c_str());
+        ImGui::Text(("Objects Culled From All Cascades: " + std::to_string(m_CascadeCulledObjects)).c_str());
+        ImGui::Text(("Cascade Layers Culled: " + std::to_string(m_CascadeCulledLayers)).c_str());
+        ImGui::Text(("Objects Outside Point Light Range: " + std::to_string(m_PointLightCulledObjects)).c_str());
+        ImGui::Text(("Cube Map Faces Culled: " + std::to_string(m_PointLightCulledLayers)).c_str());
+
+        ImGui::Separator();
+
+        ImGui::Text(("Cube Maps Rendered: " + std::to_string(m_RenderedCubeMapCount) + " / " + std::to_string(App::scene.pointLights.size())).c_str());
+        ImGui::Text(m_RenderedCascades ? "Cascades Rendered: Yes" : "Cascades Rendered: No");
+
+        ImGui::Separator();
+
+        ImGui::Text(("Cluster Light Indices: " + std::to_string(m_ClusterLightIndices.size())).c_str());
+        ImGui::Text(("Shadowed Point Lights: " + std::to_string(m_ShadowedPointLightCount) + " / " + std::to_string(App::scene.pointLights.size())).c_str());
+    }
+
+    void OpenGlRenderer::ProvideLocalRendererSettings() {
+        // Otherwise every geometry is its own instanced draw call
+        ImGui::Checkbox("Multi Draw Indirect", &m_MultiDrawIndirect);
+
+        ImGui::Checkbox("Culling", &m_Culling);
+
+        // Scene objects are drawn grouped by geometry and front to back
+        ImGui::Checkbox("Sort Draws", &m_SortDraws);
+
+        // Otherwise every fragment loops over every point light
+        ImGui::Checkbox("Clustered Shading", &m_ClusteredShading);
+
+        // Shadow maps are only rendered again once a light, object or the camera (for cascades) changes
+        ImGui::Checkbox("Shadow Map Caching", &m_ShadowMapCaching);
+
+        ImGui::Separator();
+
+        ImGui::Text("Geometry Arena");
+        ImGui::Text(("Vertices: " + std::to_string(m_GeometryArena->UsedVertexCount()) + " / " + std::to_string(m_GeometryArena->VertexCapacity())).c_str());
+        ImGui::Text(("Indices: " + std::to_string(m_GeometryArena->UsedIndexCount()) + " / " + std::to_string(m_GeometryArena->IndexCapacity())).c_str());
+    }
+
     void OpenGlRenderer::VisualizeCubeMap(LightIndex lightIndex) {
         glBindFramebuffer(GL_FRAMEBUFFER, m_CubeMapVisualizationFBO);
 
@@ -945,9 +1586,10 @@ namespace Rutile {
         m_CubeMapVisualizationShader->SetFloat("verticalModifier", m_OmnidirectionalShadowMapVisualizationHorizontalOffsets[lightIndex]);
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, m_PointLightCubeMaps[lightIndex]);
+        glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, m_PointLightShadowMaps);
 
-        m_CubeMapVisualizationShader->SetInt("cubeMap", 0);
+        m_CubeMapVisualizationShader->SetInt("cubeMaps", 0);
+        m_CubeMapVisualizationShader->SetInt("layer", static_cast<int>(lightIndex));
 
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, (int)indices.size(), GL_UNSIGNED_INT, nullptr);
@@ -1087,10 +1729,10 @@ namespace Rutile {
             glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (void*)0);
             glEnableVertexAttribArray(0);
 
-            m_SolidShader->Bind();
+            m_BoundsVisualizationShader->Bind();
 
-            m_SolidShader->SetMat4("mvp", m_Projection * App::camera.View());
-            m_SolidShader->SetVec4("color", glm::vec4{ colors[i], 0.5f });
+            m_BoundsVisualizationShader->SetMat4("mvp", m_Projection * App::camera.View());
+            m_BoundsVisualizationShader->SetVec4("color", glm::vec4{ colors[i], 0.5f });
 
             glBindVertexArray(VAO);
             glDrawElements(GL_TRIANGLES, (int)indices.size(), GL_UNSIGNED_INT, nullptr);
@@ -1196,10 +1838,10 @@ namespace Rutile {
             glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (void*)0);
             glEnableVertexAttribArray(0);
 
-            m_SolidShader->Bind();
+            m_BoundsVisualizationShader->Bind();
 
-            m_SolidShader->SetMat4("mvp", m_Projection * App::camera.View());
-            m_SolidShader->SetVec4("color", glm::vec4{ colors[i], 0.5f });
+            m_BoundsVisualizationShader->SetMat4("mvp", m_Projection * App::camera.View());
+            m_BoundsVisualizationShader->SetVec4("color", glm::vec4{ colors[i], 0.5f });
 
             glBindVertexArray(VAO);
             glDrawElements(GL_TRIANGLES, (int)indices.size(), GL_UNSIGNED_INT, nullptr);
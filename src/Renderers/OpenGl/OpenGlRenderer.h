@@ -1,13 +1,25 @@
 #pragma once
 
+#include <array>
+#include <chrono>
 #include <memory>
+#include <span>
 
 #include "../Renderer.h"
 
 #include <gl/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "Settings/SettingsEnums.h"
+
+#include "Utility/OpenGl/GeometryArena.h"
+#include "Utility/OpenGl/GLStateCache.h"
 #include "Utility/OpenGl/Shader.h"
+#include "Utility/OpenGl/SSBO.h"
+#include "Utility/OpenGl/UBO.h"
+#include "Utility/ThreadPool.h"
+
+#include "ObjectCulling.h"
 
 namespace Rutile {
 	class OpenGlRenderer : public Renderer {
@@ -31,8 +43,10 @@ namespace Rutile {
         void Notify(Event* event) override;
 
     private:
+        void CalculatePointLightShadows();
         void RenderOmnidirectionalShadowMaps();
 
+        void CalculateCascades();
         void RenderCascadingShadowMaps();
 
         void RenderScene();
@@ -43,11 +57,19 @@ namespace Rutile {
         // Events
         void ProjectionMatrixUpdate() override;
 
+        void SignalDirectionalLightUpdate() override;
+        void SignalPointLightUpdate(LightIndex i) override;
+
+        void SignalDirectionalShadowMapUpdate() override;
+
 
         void ProvideLightVisualization(LightIndex lightIndex) override;
 
         void ProvideCSMVisualization() override;
 
+        void ProvideTimingStatistics() override;
+        void ProvideLocalRendererSettings() override;
+
     private:
 
         glm::mat4 m_Projection { 1.0f };
@@ -62,6 +84,177 @@ namespace Rutile {
         std::unique_ptr<Shader> m_CascadingShadowMapShader;
         std::unique_ptr<Shader> m_CascadingShadowMapVisualizationShader;
 
+        std::unique_ptr<Shader> m_BoundsVisualizationShader;
+
+        // Uniforms that aren't part of a uniform block, resolved once after the shaders are created
+        void ResolveUniformHandles();
+
+        struct PhongUniforms {
+            UniformHandle<bool> directionalShadows;
+            UniformHandle<int> cascadingShadowMap;
+
+            UniformHandle<bool> omnidirectionalShadowMaps;
+            UniformHandle<float> omnidirectionalShadowMapBias;
+            UniformHandle<int> omnidirectionalShadowMapPCFMode;
+            UniformHandle<int> omnidirectionalShadowMapSampleCount;
+            UniformHandle<int> omnidirectionalShadowMapDiskRadiusMode;
+            UniformHandle<float> omnidirectionalShadowMapDiskRadius;
+
+            UniformHandle<int> pointLightShadowMaps;
+
+            UniformHandle<bool> clusteredShading;
+        } m_PhongUniforms;
+
+        // Per frame data, these match the std140 uniform blocks in phong.vert, phong.frag, cascadingShadowMapping.geom
+        // and omnidirectionalShadowMapping.geom
+        struct CameraBlock {
+            glm::mat4 projection;
+            glm::mat4 view;
+            glm::vec3 position;
+            float padding;
+        };
+
+        struct LightBlock {
+            struct DirectionalLight {
+                glm::vec3 direction;
+                float padding0;
+                glm::vec3 ambient;
+                float padding1;
+                glm::vec3 diffuse;
+                float padding2;
+                glm::vec3 specular;
+                float padding3;
+            };
+
+            DirectionalLight directionalLight;
+
+            int pointLightCount;
+            int haveDirectionalLight;
+            int shadowedPointLightCount;
+            float padding;
+        };
+
+        static constexpr int maxCascadeCount = 10; // MAX_CASCADE_COUNT in phong.frag and cascadingShadowMapping.geom
+
+        struct CascadeBlock {
+            std::array<glm::mat4, maxCascadeCount> lightSpaceMatrices;
+            std::array<glm::vec4, maxCascadeCount + 1> cascadeFrustumPlanes; // std140 pads every float in an array to 16 bytes, only x is used
+
+            int cascadeCount;
+            float farPlane;
+            float padding[2];
+        };
+
+        static constexpr size_t maxShadowedPointLights = 16; // MAX_SHADOWED_POINT_LIGHTS in omnidirectionalShadowMapping.geom and .frag
+
+        struct PointLightShadowBlock {
+            std::array<glm::mat4, maxShadowedPointLights * 6> shadowMatrices; // Six faces per light
+            std::array<glm::vec4, maxShadowedPointLights> lightPositions;     // w is the far plane
+        };
+
+        // Clustered shading, the view frustum is split into a grid of clusters with exponentially growing slices along
+        // z, and every cluster gets the list of point lights that reach it. phong.frag only evaluates the lights of
+        // the cluster its fragment is in
+        static constexpr unsigned int clusterCountX = 16;
+        static constexpr unsigned int clusterCountY = 9;
+        static constexpr unsigned int clusterCountZ = 24;
+
+        struct ClusterBlock {
+            glm::uvec4 gridSize; // w is unused
+            glm::vec2 screenSize;
+            float nearPlane;
+            float farPlane;
+        };
+
+        static_assert(sizeof(CameraBlock) == 144, "CameraBlock must match the std140 layout of Camera");
+        static_assert(sizeof(LightBlock) == 80, "LightBlock must match the std140 layout of Lights");
+        static_assert(sizeof(ClusterBlock) == 32, "ClusterBlock must match the std140 layout of ClusterGrid");
+        static_assert(sizeof(CascadeBlock) == 832, "CascadeBlock must match the std140 layout of Cascades");
+        static_assert(sizeof(PointLightShadowBlock) == 6400, "PointLightShadowBlock must match the std140 layout of PointLightShadows");
+
+        // Per object data, indexed by the object index vertex attribute of each draw
+        struct ObjectData {
+            glm::mat4 model;
+
+            glm::vec4 solidColor;
+
+            glm::vec4 phongAmbient;
+            glm::vec4 phongDiffuse;
+            glm::vec4 phongSpecular; // w is the shininess
+        };
+
+        // Per point light data, matches the std430 layout of PointLights in phong.frag
+        struct PointLightData {
+            glm::vec3 position;
+            float constant;
+            float linear;
+            float quadratic;
+            float padding0[2];
+            glm::vec3 ambient;
+            float padding1;
+            glm::vec3 diffuse;
+            float padding2;
+            glm::vec3 specular;
+            float farPlane;
+        };
+
+        static_assert(sizeof(PointLightData) == 80, "PointLightData must match the std430 layout of PointLight in phong.frag");
+
+        // Range of m_ClusterLightIndices belonging to one cluster
+        struct ClusterRange {
+            unsigned int offset;
+            unsigned int count;
+        };
+
+        void UploadFrameData();
+        void UploadCascadeData();
+
+        std::unique_ptr<UBO<CameraBlock>> m_CameraUBO;
+        std::unique_ptr<UBO<LightBlock>> m_LightUBO;
+        std::unique_ptr<UBO<CascadeBlock>> m_CascadeUBO;
+        std::unique_ptr<UBO<PointLightShadowBlock>> m_PointLightShadowUBO;
+        std::unique_ptr<UBO<ClusterBlock>> m_ClusterUBO;
+
+        static constexpr size_t framesInFlight = 3; // Regions of the storage buffers that are rewritten every frame
+
+        std::unique_ptr<SSBO<ObjectData>> m_ObjectSSBO;
+        std::unique_ptr<SSBO<PointLightData>> m_PointLightSSBO;
+        std::unique_ptr<SSBO<ClusterRange>> m_ClusterSSBO;
+        std::unique_ptr<SSBO<unsigned int>> m_ClusterLightIndexSSBO;
+
+        // Clustered shading
+        void CalculateClusterBounds(); // View space bounds of every cluster, these only depend on the projection
+        void AssignLightsToClusters();
+        void AssignLightsToSlice(size_t slice);
+
+        // Distance at which the light's attenuation brings it below what an 8 bit channel can show
+        float PointLightRange(const PointLight& pointLight) const;
+        int ClusterSlice(float depth) const;
+
+        // A point light's sphere of influence in view space, and the slices it overlaps
+        struct ClusterLight {
+            glm::vec3 center;
+            float radius;
+
+            int firstSlice;
+            int lastSlice;
+        };
+
+        std::vector<std::pair<glm::vec3, glm::vec3>> m_ClusterBounds; // Indexed by x + clusterCountX * (y + clusterCountY * z)
+        bool m_ClusterBoundsOutdated{ true };
+
+        std::vector<ClusterLight> m_ClusterLights;
+
+        // Every slice is assigned on its own thread, indices are relative to the slice until they are merged
+        std::unique_ptr<ThreadPool<size_t>> m_ClusterThreadPool;
+        std::vector<std::vector<unsigned int>> m_SliceLightIndices;
+
+        std::vector<ClusterRange> m_ClusterRanges;
+        std::vector<unsigned int> m_ClusterLightIndices;
+
+        bool m_ClusteredShading{ true }; // Otherwise every fragment evaluates every point light
+
+
         // Omnidirectional Shadow maps
         std::vector<float> m_OmnidirectionalShadowMapVisualizationHorizontalOffsets{ 0.0f };
         std::vector<float> m_OmnidirectionalShadowMapVisualizationVerticalOffsets{ 0.0f };
@@ -71,7 +264,14 @@ namespace Rutile {
         int m_OmnidirectionalShadowMapWidth{ 1024 };
         int m_OmnidirectionalShadowMapHeight{ 1024 };
 
-        std::vector<unsigned int> m_PointLightCubeMaps;
+        // Every point light's shadow map is a cube map in one cube map array, light i owns layers 6 * i to 6 * i + 5.
+        // All outdated lights are rendered by a single draw, see BuildDrawLists
+        void CreatePointLightShadowMaps();
+
+        unsigned int m_PointLightShadowMaps{ 0 };
+        size_t m_ShadowedPointLightCount{ 0 };
+
+        std::vector<std::array<glm::mat4, 6>> m_PointLightShadowTransforms; // Only up to date for outdated lights
 
         unsigned int m_CubeMapVisualizationFBO{ 0 };
         unsigned int m_CubeMapVisualizationRBO{ 0 };
@@ -91,7 +291,7 @@ namespace Rutile {
         int m_CascadingShadowMapHeight{ 1024 };
 
         int m_CascadeCount{ 5 };
-        int m_MaxCascadeCount{ 10 };
+        int m_MaxCascadeCount{ maxCascadeCount };
 
         unsigned int m_ShadowCascadesVisualizationFBO{ 0 };
         unsigned int m_ShadowCascadesVisualizationRBO{ 0 };
@@ -118,9 +318,125 @@ namespace Rutile {
         // Objects
         size_t m_ObjectCount;
 
-        std::vector<unsigned int> m_VAOs;
-        std::vector<unsigned int> m_VBOs;
-        std::vector<unsigned int> m_EBOs;
+        // All geometry is packed into a single vertex and index buffer, kept between scenes so loading a scene only
+        // has to upload its geometry
+        std::unique_ptr<GeometryArena> m_GeometryArena;
+        std::vector<GeometryArena::Allocation> m_GeometryAllocations; // Indexed by GeometryIndex
+
+        // Layout defined by glMultiDrawElementsIndirect
+        struct DrawElementsIndirectCommand {
+            unsigned int count;
+            unsigned int instanceCount;
+            unsigned int firstIndex;
+            int baseVertex;
+            unsigned int baseInstance;
+        };
+
+        // Read once per instance as attributes 3 and 4, layerMask tells the geometry shaders of the shadow passes
+        // which layers the object is visible in. In the point light pass every instance is an object and light pair,
+        // the bits from pointLightIndexShift up hold the light's index
+        struct DrawInstance {
+            unsigned int objectIndex;
+            unsigned int layerMask;
+        };
+
+        static constexpr uint32_t pointLightIndexShift = 8; // Matches omnidirectionalShadowMapping.geom
+
+        // Range of m_DrawCommands used by one pass
+        struct DrawList {
+            size_t firstCommand{ 0 };
+            size_t commandCount{ 0 };
+
+            size_t instanceCount{ 0 };
+        };
+
+        // Appends one command per geometry with at least one object that has a non zero mask, every such object
+        // becomes an instance of it. With several mask sets an object becomes one instance per set it is non zero in
+        DrawList BuildDrawList(const std::vector<uint32_t>& masks);
+        DrawList BuildDrawList(std::span<const std::vector<uint32_t>> maskSets);
+
+        // Same as BuildDrawList, but the objects are ordered by their DrawItem keys first
+        DrawList BuildSortedDrawList(const std::vector<uint32_t>& masks);
+
+        // Appends a command drawing the instances from firstInstance to the end of m_DrawInstances with geometry
+        void AppendDrawCommand(GeometryIndex geometry, size_t firstInstance, DrawList& drawList);
+
+        // From the most significant bits down: shader, geometry and the squared distance to the camera. Sorting by it
+        // keeps each geometry's instances together and draws them front to back so early depth testing can reject
+        // hidden fragments
+        struct DrawItem {
+            uint64_t key;
+            ObjectIndex objectIndex;
+        };
+
+        std::vector<DrawItem> m_DrawItems;
+
+        bool m_SortDraws{ true };
+
+        // Culls the objects for every pass of this frame and uploads the resulting draw lists
+        void BuildDrawLists(bool renderCascades);
+
+        // Draws every object in the list with the currently bound shader
+        void DrawObjects(const DrawList& drawList);
+
+        std::vector<std::vector<ObjectIndex>> m_ObjectsByGeometry;
+
+        std::vector<DrawElementsIndirectCommand> m_DrawCommands;
+        std::vector<DrawInstance> m_DrawInstances;
+
+        unsigned int m_DrawIndirectBuffer{ 0 };
+        unsigned int m_DrawInstanceBuffer{ 0 };
+
+        DrawList m_SceneDrawList{ };
+        DrawList m_CascadeDrawList{ };
+        DrawList m_PointLightDrawList{ }; // Every outdated point light
+
+        bool m_MultiDrawIndirect{ true }; // Otherwise every command is issued as its own instanced draw
+
+        // Programs, vertex arrays, framebuffers, textures, the culled face and the viewport of the passes in Render all
+        // go through here. It is invalidated at the start of every frame since the GUI changes state on its own
+        GLStateCache m_StateCache;
+
+        // Shadow map caching, a shadow map is only rendered again once something it depends on has changed
+        void InvalidatePointLightShadowMaps(size_t objectIndex); // Invalidates every point light whose range reaches the object's bounds
+        void InvalidateAllShadowMaps();
+
+        std::vector<bool> m_PointLightShadowMapOutdated;
+        bool m_CascadesOutdated{ true };
+
+        WindingOrder m_ShadowMapFrontFace{ };
+
+        bool m_ShadowMapCaching{ true };
+
+        // Culling
+        void UpdateObjectBounds();
+
+        std::array<glm::mat4, 6> PointLightShadowTransforms(const PointLight& pointLight) const;
+
+        std::vector<std::pair<glm::vec3, glm::vec3>> m_GeometryBounds; // Local space min and max, indexed by GeometryIndex
+
+        ObjectBounds m_ObjectBounds;
+        std::vector<glm::mat4> m_ObjectBoundsMatrices; // Matrix each object's bounds were last calculated with
+
+        std::vector<uint32_t> m_CullingMasks;
+        std::vector<std::vector<uint32_t>> m_PointLightCullingMasks; // One set per outdated point light
+
+        bool m_Culling{ true };
+
+        // Statistics
+        size_t m_DrawCallCount{ 0 };
+        std::chrono::duration<double> m_SubmitTime{ 0.0 };
+        std::chrono::duration<double> m_CullingTime{ 0.0 };
+        std::chrono::duration<double> m_LightAssignmentTime{ 0.0 };
+
+        size_t m_SceneCulledObjects{ 0 };
+        size_t m_CascadeCulledObjects{ 0 };   // Objects outside of every cascade
+        size_t m_CascadeCulledLayers{ 0 };    // Object and cascade pairs that were skipped
+        size_t m_PointLightCulledObjects{ 0 }; // Objects outside of a light's range, summed over all lights
+        size_t m_PointLightCulledLayers{ 0 };  // Object and cube face pairs that were skipped
+
+        size_t m_RenderedCubeMapCount{ 0 };
+        bool m_RenderedCascades{ false };
 
         // Shadow Map
         //unsigned int m_DepthMapFBO;
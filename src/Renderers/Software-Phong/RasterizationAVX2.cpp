@@ -0,0 +1,38 @@
+#include "RasterizationAVX2.h"
+
+#include <immintrin.h>
+
+namespace Rutile {
+    namespace RasterizationAVX2 {
+        bool RasterizeSpan(const float* edges, const bool* topLeftEdges, const float* depthPlane, float firstPixelX, float pixelY, int count, bool fullyCovered, bool depthTest, uint32_t triangleIndex, float* depthRow, uint32_t* triangleIndexRow) {
+            const __m256 pixelX = _mm256_add_ps(_mm256_set1_ps(firstPixelX), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+            const __m256 zero = _mm256_setzero_ps();
+
+            // Lanes past count fall outside of the span, and possibly outside of the buffers
+            __m256 mask = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+
+            if (!fullyCovered) {
+                for (int i = 0; i < 3; ++i) {
+                    const float* edge = edges + i * 3;
+
+                    const __m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(edge[0]), pixelX), _mm256_set1_ps(edge[1] * pixelY + edge[2]));
+
+                    const __m256 inside = topLeftEdges[i] ? _mm256_cmp_ps(value, zero, _CMP_GE_OQ) : _mm256_cmp_ps(value, zero, _CMP_GT_OQ);
+                    mask = _mm256_and_ps(mask, inside);
+                }
+            }
+
+            const __m256 depth = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(depthPlane[0]), pixelX), _mm256_set1_ps(depthPlane[1] * pixelY + depthPlane[2]));
+
+            if (depthTest) {
+                const __m256 bufferDepth = _mm256_maskload_ps(depthRow, _mm256_castps_si256(mask));
+                mask = _mm256_and_ps(mask, _mm256_cmp_ps(depth, bufferDepth, _CMP_LT_OQ));
+            }
+
+            _mm256_maskstore_ps(depthRow, _mm256_castps_si256(mask), depth);
+            _mm256_maskstore_epi32((int*)triangleIndexRow, _mm256_castps_si256(mask), _mm256_set1_epi32((int)triangleIndex));
+
+            return _mm256_movemask_ps(mask) != 0;
+        }
+    }
+}
\ No newline at end of file
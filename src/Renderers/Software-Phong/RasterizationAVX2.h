@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+
+namespace Rutile {
+    // Built with AVX2 enabled, only call these when CPUSupportsAVX2() is true. This file and its translation unit stay
+    // clear of glm and the standard library, so that no inline function built with AVX2 can end up being the copy the
+    // linker keeps for the rest of the program
+    namespace RasterizationAVX2 {
+        // SoftwarePhong::RasterizeSpan for 8 pixels of a row. edges holds the 3 edge functions and depthPlane the depth
+        // plane as (a, b, c) triples, firstPixelX and pixelY are the center of the first pixel, and depthRow and
+        // triangleIndexRow point at it. Returns true if any pixel was written
+        bool RasterizeSpan(const float* edges, const bool* topLeftEdges, const float* depthPlane, float firstPixelX, float pixelY, int count, bool fullyCovered, bool depthTest, uint32_t triangleIndex, float* depthRow, uint32_t* triangleIndexRow);
+    }
+}
\ No newline at end of file
@@ -1,8 +1,17 @@
 #include "SoftwarePhong.h"
 
+#include "imgui.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <sstream>
+
+#include "RasterizationAVX2.h"
 
 #include "Settings/App.h"
+#include "Utility/CPUFeatures.h"
+#include "Utility/TimeScope.h"
+#include "Utility/events/Events.h"
 #include "Utility/OpenGl/GLDebug.h"
 
 namespace Rutile {
@@ -104,124 +113,799 @@ namespace Rutile {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        return window;
+        m_ThreadPool = std::make_unique<RasterizationThreadPool>(std::max(std::thread::hardware_concurrency(), 1u));
+
+        ResizeFramebuffer();
 
+        return window;
     }
 
     void SoftwarePhong::Cleanup(GLFWwindow* window) {
+        m_ThreadPool.reset();
+
         glDeleteTextures(1, &m_ScreenTexture);
 
         glfwDestroyWindow(window);
     }
 
     void SoftwarePhong::Render() {
-        std::vector<glm::vec4> imageData;
-        imageData.resize((size_t)App::screenWidth * (size_t)App::screenHeight);
+        RasterizeFrame();
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, m_ColorBuffer.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_ScreenTexture);
+
+        glUseProgram(m_ShaderProgram);
+        glBindVertexArray(m_VAO);
+        glDrawElements(GL_TRIANGLES, (int)indices.size(), GL_UNSIGNED_INT, nullptr);
+    }
+
+    void SoftwarePhong::Notify(Event* event) {
+        if (EVENT_IS(event, WindowResize)) {
+            ResizeFramebuffer();
+            ProjectionMatrixUpdate();
+
+            glViewport(0, 0, App::screenWidth, App::screenHeight);
+        }
+        if (EVENT_IS(event, CameraUpdate)) {
+            m_ViewProjectionOutdated = true;
+        }
+        if (EVENT_IS(event, ObjectTransformUpdate)) {
+            const ObjectIndex index = dynamic_cast<ObjectTransformUpdate*>(event)->index;
+
+            if (index < m_VertexCache.size()) {
+                m_VertexCache[index].worldOutdated = true;
+            }
+        }
+    }
+
+    void SoftwarePhong::LoadScene() {
+        m_VertexCache.clear();
+        m_VertexCache.resize(App::scene.objects.size());
+    }
+
+    void SoftwarePhong::ProjectionMatrixUpdate() {
+        m_Projection = glm::perspective(glm::radians(App::settings.fieldOfView), (float)App::screenWidth / (float)App::screenHeight, App::settings.nearPlane, App::settings.farPlane);
+
+        m_ViewProjectionOutdated = true;
+    }
 
-        using DepthType = float;
-        std::vector<DepthType> depthBuffer;
-        depthBuffer.resize((size_t)App::screenWidth * (size_t)App::screenHeight);
+    void SoftwarePhong::ProvideTimingStatistics() {
+        ImGui::Separator();
 
-        // For each triangle in the scene:
-            // Transform it into screen space
-            // Find what pixels it occupys
-            // Find the triangles depth at each pixels -> depth buffer
-        // For each pixel compare it to the depth buffer, for each pixel that is closest run the fragment shader
+        const auto geometryTime = std::chrono::duration_cast<std::chrono::nanoseconds>(m_GeometryTime);
+        ImGui::Text(("Vertex Transformation and Clipping Time: " + std::to_string((double)geometryTime.count() / 1000000.0) + "ms").c_str());
 
-        // Bottom left of screen is (0, 0) and top right is (1, 1)
-        const float pixelWidth = 1.0f / (float)App::screenWidth;
-        const float pixelHeight = 1.0f / (float)App::screenHeight;
+        const auto binningTime = std::chrono::duration_cast<std::chrono::nanoseconds>(m_BinningTime);
+        ImGui::Text(("Binning Time: " + std::to_string((double)binningTime.count() / 1000000.0) + "ms").c_str());
 
-        glm::vec3 min{ std::numeric_limits<float>::max() };
-        glm::vec3 max{ -std::numeric_limits<float>::max() };
+        const auto rasterizationTime = std::chrono::duration_cast<std::chrono::nanoseconds>(m_RasterizationTime);
+        ImGui::Text(("Rasterization Time: " + std::to_string((double)rasterizationTime.count() / 1000000.0) + "ms").c_str());
 
-        // Iterates over all objects
-        for (auto& obj : App::scene.objects) {
-            Geometry& geo = App::scene.geometryBank[obj.geometry];
-            auto& vert = geo.vertices;
-            auto& inds = geo.indices;
+        ImGui::Separator();
 
-            Transform& transform = App::scene.transformBank[obj.transform];
-            transform.CalculateMatrix(); // TODO super ineficient
+        ImGui::Text(("Vertices Transformed: " + std::to_string(m_TransformedVertexCount)).c_str());
+        ImGui::Text(("Triangles After Clipping: " + std::to_string(m_Triangles.size())).c_str());
 
-            // TODO super ineficient
-            glm::mat4 proj = glm::perspective(glm::radians(App::settings.fieldOfView), (float)App::screenWidth / (float)App::screenHeight, App::settings.nearPlane, App::settings.farPlane);
+        size_t rejectedBlocks = 0;
+        size_t partialBlocks = 0;
+        size_t coveredBlocks = 0;
+        for (const auto& tile : m_Tiles) {
+            rejectedBlocks += tile.rejectedBlocks;
+            partialBlocks += tile.partialBlocks;
+            coveredBlocks += tile.coveredBlocks;
+        }
 
-            glm::mat4 mvp = proj * App::camera.View() * transform.matrix;
+        ImGui::Text(("Blocks Rejected: " + std::to_string(rejectedBlocks)).c_str());
+        ImGui::Text(("Blocks Partially Covered: " + std::to_string(partialBlocks)).c_str());
+        ImGui::Text(("Blocks Fully Covered: " + std::to_string(coveredBlocks)).c_str());
 
-            // Iterates over all triangles
-            for (size_t i = 0; i < inds.size(); i += 3) {
-                Vertex v1 = vert[inds[i + 0]];
-                Vertex v2 = vert[inds[i + 1]];
-                Vertex v3 = vert[inds[i + 2]];
+        ImGui::Separator();
 
-                v1.position = glm::vec3{ mvp * glm::vec4{ v1.position.x, v1.position.y, v1.position.z, 1.0 } };
-                v2.position = glm::vec3{ mvp * glm::vec4{ v2.position.x, v2.position.y, v2.position.z, 1.0 } };
-                v3.position = glm::vec3{ mvp * glm::vec4{ v3.position.x, v3.position.y, v3.position.z, 1.0 } };
+        size_t occludedTriangles = 0;
+        size_t occludedBlocks = 0;
+        size_t shadedPixels = 0;
+        for (const auto& tile : m_Tiles) {
+            occludedTriangles += tile.occludedTriangles;
+            occludedBlocks += tile.occludedBlocks;
+            shadedPixels += tile.shadedPixels;
+        }
 
-                min = glm::min(glm::min(glm::min(v1.position, v2.position), v3.position), min);
-                max = glm::max(glm::max(glm::max(v1.position, v2.position), v3.position), max);
+        ImGui::Text(("Triangles Occluded per Tile: " + std::to_string(occludedTriangles)).c_str());
+        ImGui::Text(("Blocks Occluded: " + std::to_string(occludedBlocks)).c_str());
+        ImGui::Text(("Pixels Shaded: " + std::to_string(shadedPixels)).c_str());
+    }
 
-                glm::ivec2 p1 = glm::ivec2{ (int)std::floor(v1.position.x / pixelWidth), (int)std::floor(v1.position.y / pixelHeight) };
-                glm::ivec2 p2 = glm::ivec2{ (int)std::floor(v2.position.x / pixelWidth), (int)std::floor(v2.position.y / pixelHeight) };
-                glm::ivec2 p3 = glm::ivec2{ (int)std::floor(v3.position.x / pixelWidth), (int)std::floor(v3.position.y / pixelHeight) };
+    void SoftwarePhong::ProvideLocalRendererSettings() {
+        if (ImGui::DragInt("Tile Size", &m_TileSize, (float)blockSize, blockSize, 256)) {
+            m_TileSize = std::clamp(m_TileSize / blockSize * blockSize, blockSize, 256);
 
-                //glm::ivec2 min{ App::screenWidth, App::screenHeight };
-                //glm::ivec2 max{ 0, 0 };
+            ResizeFramebuffer();
+        }
 
-                //if (p1.x > max.x) max.x = p1.x;
-                //if (p2.x > max.x) max.x = p2.x;
-                //if (p3.x > max.x) max.x = p3.x;
+        ImGui::Text(("Tile Count: " + std::to_string(m_Tiles.size())).c_str());
 
-                //if (p1.y > max.y) max.y = p1.y;
-                //if (p2.y > max.y) max.y = p2.y;
-                //if (p3.y > max.y) max.y = p3.y;
+        if (CPUSupportsAVX2()) {
+            ImGui::Checkbox("AVX2 Coverage Tests", &m_AVX2CoverageTests);
+        } else {
+            ImGui::Text("Coverage Tests: Scalar, the CPU does not support AVX2");
+        }
 
-                //if (p1.x < min.x) min.x = p1.x;
-                //if (p2.x < min.x) min.x = p2.x;
-                //if (p3.x < min.x) min.x = p3.x;
+        ImGui::Separator();
 
-                //if (p1.y < min.y) min.y = p1.y;
-                //if (p2.y < min.y) min.y = p2.y;
-                //if (p3.y < min.y) min.y = p3.y;
+        ImGui::DragInt("Benchmark Frame Count", &m_BenchmarkFrameCount, 1.0f, 1, 10000);
 
-                //for (int x = min.x; x < max.x; ++x) {
-                //    for (int y = min.y; y < max.y; ++y) {
-                //        depthBuffer[x + y * App::screenWidth] = 1.0;
-                //    }
-                //}
+        if (ImGui::Button("Run Rasterization Benchmark")) {
+            RunRasterizationBenchmark();
+        }
+
+        if (!m_BenchmarkReport.empty()) {
+            ImGui::TextUnformatted(m_BenchmarkReport.c_str());
+        }
+    }
+
+    void SoftwarePhong::RasterizeFrame() {
+        {
+            TimeScope geometryTime{ &m_GeometryTime };
+            TransformAndClip();
+        }
+
+        {
+            TimeScope binningTime{ &m_BinningTime };
+            BinTriangles();
+        }
+
+        {
+            TimeScope rasterizationTime{ &m_RasterizationTime };
+
+            for (auto& tile : m_Tiles) {
+                m_ThreadPool->QueueJob([this](Tile* tile) { RasterizeTile(*tile); ShadeTile(*tile); }, &tile);
             }
+
+            m_ThreadPool->WaitForCompletion();
         }
+    }
 
-        std::cout << "min: (" << min.x << ", " << min.y << ", " << min.z << ")" << std::endl;
-        std::cout << "max: (" << max.x << ", " << max.y << ", " << max.z << ")" << std::endl;
+    void SoftwarePhong::RunRasterizationBenchmark() {
+        Scene previousScene = std::move(App::scene);
+        const Camera previousCamera = App::camera;
+        const bool previousUpdateCameraVectors = App::updateCameraVectors;
 
-        for (int y = 0; y < App::screenHeight; ++y) {
-            for (int x = 0; x < App::screenWidth; ++x) {
-                imageData[x + y * App::screenWidth] = glm::vec4{ depthBuffer[x + y * App::screenWidth], depthBuffer[x + y * App::screenWidth], depthBuffer[x + y * App::screenWidth], 1.0 };
-                imageData[x + y * App::screenWidth] = glm::vec4{ (float)y / (float)App::screenHeight, 0.0, 0.0, 1.0 };
+        // Also moves the camera to look at the dragon
+        App::scene = SceneManager::GetScene(SceneType::DRAGON_80K);
+
+        for (const auto& object : App::scene.objects) {
+            App::scene.transformBank[object.transform].CalculateMatrix();
+        }
+
+        App::camera.frontVector.x = cos(glm::radians(App::camera.yaw)) * cos(glm::radians(App::camera.pitch));
+        App::camera.frontVector.y = sin(glm::radians(App::camera.pitch));
+        App::camera.frontVector.z = sin(glm::radians(App::camera.yaw)) * cos(glm::radians(App::camera.pitch));
+        App::camera.frontVector = glm::normalize(App::camera.frontVector);
+        App::camera.rightVector = glm::normalize(glm::cross(App::camera.frontVector, App::camera.upVector));
+
+        LoadScene();
+        m_ViewProjectionOutdated = true;
+
+        size_t triangleCount = 0;
+        for (const auto& object : App::scene.objects) {
+            triangleCount += App::scene.geometryBank[object.geometry].indices.size() / 3;
+        }
+
+        std::chrono::duration<double> geometryTime{ };
+        std::chrono::duration<double> binningTime{ };
+        std::chrono::duration<double> rasterizationTime{ };
+
+        for (int i = 0; i < m_BenchmarkFrameCount; ++i) {
+            RasterizeFrame();
+
+            geometryTime += m_GeometryTime;
+            binningTime += m_BinningTime;
+            rasterizationTime += m_RasterizationTime;
+        }
+
+        const double seconds = (geometryTime + binningTime + rasterizationTime).count();
+        const double frameCount = (double)m_BenchmarkFrameCount;
+
+        std::stringstream report{ };
+        report << "80K Triangle Dragon, " << App::screenWidth << "x" << App::screenHeight << ", " << m_BenchmarkFrameCount << " frames:\n";
+        report << "    Triangles: " << triangleCount << " submitted, " << m_Triangles.size() << " after clipping and culling\n";
+        report << "    Vertex transformation and clipping: " << geometryTime.count() * 1000.0 / frameCount << "ms\n";
+        report << "    Binning: " << binningTime.count() * 1000.0 / frameCount << "ms\n";
+        report << "    Rasterization: " << rasterizationTime.count() * 1000.0 / frameCount << "ms\n";
+        report << "    " << (double)triangleCount * frameCount / seconds / 1000000.0 << " MTriangles/s";
+
+        m_BenchmarkReport = report.str();
+
+        App::scene = std::move(previousScene);
+        App::camera = previousCamera;
+        App::updateCameraVectors = previousUpdateCameraVectors;
+
+        LoadScene();
+        m_ViewProjectionOutdated = true;
+    }
+
+    void SoftwarePhong::ResizeFramebuffer() {
+        const size_t pixelCount = (size_t)App::screenWidth * (size_t)App::screenHeight;
+
+        m_ColorBuffer.resize(pixelCount);
+        m_DepthBuffer.resize(pixelCount);
+        m_TriangleIndexBuffer.resize(pixelCount);
+
+        m_BlockCountX = (App::screenWidth + blockSize - 1) / blockSize;
+        m_BlockDepthBounds.resize((size_t)m_BlockCountX * (size_t)((App::screenHeight + blockSize - 1) / blockSize));
+
+        m_TileCountX = (App::screenWidth  + m_TileSize - 1) / m_TileSize;
+        m_TileCountY = (App::screenHeight + m_TileSize - 1) / m_TileSize;
+
+        m_Tiles.clear();
+        m_Tiles.resize((size_t)m_TileCountX * (size_t)m_TileCountY);
+
+        for (int y = 0; y < m_TileCountY; ++y) {
+            for (int x = 0; x < m_TileCountX; ++x) {
+                Tile& tile = m_Tiles[x + y * m_TileCountX];
+
+                tile.min = glm::ivec2{ x * m_TileSize, y * m_TileSize };
+                tile.max = glm::min(tile.min + glm::ivec2{ m_TileSize }, glm::ivec2{ App::screenWidth, App::screenHeight });
             }
         }
+    }
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, imageData.data());
-        glGenerateMipmap(GL_TEXTURE_2D);
+    void SoftwarePhong::UpdateVertexCache() {
+        m_TransformedVertexCount = 0;
 
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+        if (m_VertexCache.size() != App::scene.objects.size()) {
+            m_VertexCache.clear();
+            m_VertexCache.resize(App::scene.objects.size());
+        }
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_ScreenTexture);
+        // Events are only distributed at the start of the next frame, so changes made during this frame are caught
+        // by comparing against the matrices the cache was built with
+        const glm::mat4 view = App::camera.View();
+        if (view != m_View) {
+            m_ViewProjectionOutdated = true;
+        }
 
-        glUseProgram(m_ShaderProgram);
-        glBindVertexArray(m_VAO);
-        glDrawElements(GL_TRIANGLES, (int)indices.size(), GL_UNSIGNED_INT, nullptr);
+        if (m_ViewProjectionOutdated) {
+            m_View = view;
+            m_ViewProjection = m_Projection * m_View;
+
+            for (auto& cache : m_VertexCache) {
+                cache.clipOutdated = true;
+            }
+
+            m_ViewProjectionOutdated = false;
+        }
+
+        for (size_t objectIndex = 0; objectIndex < App::scene.objects.size(); ++objectIndex) {
+            TransformedObject& cache = m_VertexCache[objectIndex];
+            const Object& object = App::scene.objects[objectIndex];
+
+            const glm::mat4& model = App::scene.transformBank[object.transform].matrix;
+            if (model != cache.model) {
+                cache.worldOutdated = true;
+            }
+
+            if (!cache.worldOutdated && !cache.clipOutdated) {
+                continue;
+            }
+
+            const std::vector<Vertex>& vertices = App::scene.geometryBank[object.geometry].vertices;
+            const size_t vertexCount = vertices.size();
+
+            if (cache.worldOutdated) {
+                cache.model = model;
+
+                cache.worldX.resize(vertexCount);
+                cache.worldY.resize(vertexCount);
+                cache.worldZ.resize(vertexCount);
+
+                for (size_t i = 0; i < vertexCount; ++i) {
+                    const glm::vec3 position = glm::vec3{ model * glm::vec4{ vertices[i].position, 1.0f } };
+
+                    cache.worldX[i] = position.x;
+                    cache.worldY[i] = position.y;
+                    cache.worldZ[i] = position.z;
+                }
+
+                cache.worldOutdated = false;
+            }
+
+            // Clip positions are built from the cached world positions, so moving the camera never touches the model matrix
+            const glm::mat4& m = m_ViewProjection;
+
+            cache.clipX.resize(vertexCount);
+            cache.clipY.resize(vertexCount);
+            cache.clipZ.resize(vertexCount);
+            cache.clipW.resize(vertexCount);
+
+            for (size_t i = 0; i < vertexCount; ++i) {
+                const float x = cache.worldX[i];
+                const float y = cache.worldY[i];
+                const float z = cache.worldZ[i];
+
+                cache.clipX[i] = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+                cache.clipY[i] = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+                cache.clipZ[i] = m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2];
+                cache.clipW[i] = m[0][3] * x + m[1][3] * y + m[2][3] * z + m[3][3];
+            }
+
+            cache.clipOutdated = false;
+
+            m_TransformedVertexCount += vertexCount;
+        }
     }
 
-    void SoftwarePhong::Notify(Event* event) {
+    void SoftwarePhong::TransformAndClip() {
+        UpdateVertexCache();
+
+        m_Triangles.clear();
+
+        // Sutherland-Hodgman against the near (z >= -w) and far (z <= w) planes, x and y are left to the guard band
+        // since the bounding box of each triangle is clamped to the screen anyway
+        std::vector<ClipVertex> polygon;
+        std::vector<ClipVertex> clippedPolygon;
+
+        auto clipAgainstPlane = [&](auto distance) {
+            clippedPolygon.clear();
+
+            for (size_t i = 0; i < polygon.size(); ++i) {
+                const ClipVertex& current = polygon[i];
+                const ClipVertex& next = polygon[(i + 1) % polygon.size()];
+
+                const float currentDistance = distance(current.clipPosition);
+                const float nextDistance = distance(next.clipPosition);
+
+                if (currentDistance >= 0.0f) {
+                    clippedPolygon.push_back(current);
+                }
 
+                if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f)) {
+                    const float t = currentDistance / (currentDistance - nextDistance);
+
+                    clippedPolygon.push_back(ClipVertex{
+                        glm::mix(current.clipPosition,  next.clipPosition,  t),
+                        glm::mix(current.worldPosition, next.worldPosition, t),
+                        glm::mix(current.normal,        next.normal,        t)
+                    });
+                }
+            }
+
+            std::swap(polygon, clippedPolygon);
+        };
+
+        for (size_t objectIndex = 0; objectIndex < App::scene.objects.size(); ++objectIndex) {
+            const Object& object = App::scene.objects[objectIndex];
+            const Geometry& geometry = App::scene.geometryBank[object.geometry];
+            const TransformedObject& cache = m_VertexCache[objectIndex];
+
+            auto fetchVertex = [&](Index index) {
+                return ClipVertex{
+                    glm::vec4{ cache.clipX[index], cache.clipY[index], cache.clipZ[index], cache.clipW[index] },
+                    glm::vec3{ cache.worldX[index], cache.worldY[index], cache.worldZ[index] },
+                    geometry.vertices[index].normal // Left untransformed, same as phong.vert
+                };
+            };
+
+            for (size_t i = 0; i + 2 < geometry.indices.size(); i += 3) {
+                const ClipVertex v0 = fetchVertex(geometry.indices[i + 0]);
+                const ClipVertex v1 = fetchVertex(geometry.indices[i + 1]);
+                const ClipVertex v2 = fetchVertex(geometry.indices[i + 2]);
+
+                auto insideNear = [](const glm::vec4& p) { return p.z >= -p.w; };
+                auto insideFar  = [](const glm::vec4& p) { return p.z <=  p.w; };
+
+                if (insideNear(v0.clipPosition) && insideNear(v1.clipPosition) && insideNear(v2.clipPosition) &&
+                    insideFar (v0.clipPosition) && insideFar (v1.clipPosition) && insideFar (v2.clipPosition)) {
+
+                    SetupTriangle(v0, v1, v2, object.material);
+                    continue;
+                }
+
+                polygon.assign({ v0, v1, v2 });
+
+                clipAgainstPlane([](const glm::vec4& p) { return p.w + p.z; });
+                clipAgainstPlane([](const glm::vec4& p) { return p.w - p.z; });
+
+                for (size_t j = 1; j + 1 < polygon.size(); ++j) {
+                    SetupTriangle(polygon[0], polygon[j], polygon[j + 1], object.material);
+                }
+            }
+        }
     }
 
-    void SoftwarePhong::LoadScene() {
+    void SoftwarePhong::SetupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, MaterialIndex material) {
+        std::array<const ClipVertex*, 3> vertices{ &v0, &v1, &v2 };
+
+        std::array<glm::vec2, 3> screenPositions;
+        glm::vec3 depths;
+        glm::vec3 inverseWs;
+
+        for (int i = 0; i < 3; ++i) {
+            const glm::vec4& clipPosition = vertices[i]->clipPosition;
+
+            inverseWs[i] = 1.0f / clipPosition.w;
+
+            const glm::vec3 ndc = glm::vec3{ clipPosition } * inverseWs[i];
+
+            // Bottom left of the screen is (0, 0), same as the texture it ends up in
+            screenPositions[i] = glm::vec2{
+                (ndc.x * 0.5f + 0.5f) * (float)App::screenWidth,
+                (ndc.y * 0.5f + 0.5f) * (float)App::screenHeight
+            };
+
+            depths[i] = ndc.z * 0.5f + 0.5f;
+        }
+
+        const glm::vec2 e1 = screenPositions[1] - screenPositions[0];
+        const glm::vec2 e2 = screenPositions[2] - screenPositions[0];
+        float area = e1.x * e2.y - e1.y * e2.x; // Twice the signed area, positive when counter clockwise
+
+        if (area == 0.0f) {
+            return;
+        }
+
+        const bool counterClockWise = area > 0.0f;
+        const bool frontFacing = counterClockWise == (App::settings.frontFace == WindingOrder::COUNTER_CLOCK_WISE);
+
+        if (frontFacing == (App::settings.culledFaceDuringRendering == GeometricFace::FRONT)) {
+            return;
+        }
+
+        // Everything below assumes counter clockwise
+        if (!counterClockWise) {
+            std::swap(vertices[1], vertices[2]);
+            std::swap(screenPositions[1], screenPositions[2]);
+            std::swap(depths[1], depths[2]);
+            std::swap(inverseWs[1], inverseWs[2]);
+
+            area = -area;
+        }
+
+        const glm::vec2 min = glm::min(glm::min(screenPositions[0], screenPositions[1]), screenPositions[2]);
+        const glm::vec2 max = glm::max(glm::max(screenPositions[0], screenPositions[1]), screenPositions[2]);
+
+        // Pixel centers are at (x + 0.5, y + 0.5)
+        const glm::vec2 screenMax{ (float)App::screenWidth - 1.0f, (float)App::screenHeight - 1.0f };
+        const glm::vec2 minPixel = glm::clamp(glm::ceil(min - 0.5f), glm::vec2{ 0.0f }, screenMax);
+        const glm::vec2 maxPixel = glm::clamp(glm::floor(max - 0.5f), glm::vec2{ 0.0f }, screenMax);
+
+        if (max.x < 0.5f || max.y < 0.5f || min.x > screenMax.x + 0.5f || min.y > screenMax.y + 0.5f || minPixel.x > maxPixel.x || minPixel.y > maxPixel.y) {
+            return;
+        }
+
+        RasterTriangle triangle{ };
+
+        for (int i = 0; i < 3; ++i) {
+            const glm::vec2& a = screenPositions[(i + 1) % 3];
+            const glm::vec2& b = screenPositions[(i + 2) % 3];
+
+            triangle.edges[i] = glm::vec3{ a.y - b.y, b.x - a.x, a.x * b.y - a.y * b.x };
+
+            // With counter clockwise winding and y pointing up, top edges point left and left edges point down
+            const bool topEdge = a.y == b.y && b.x < a.x;
+            const bool leftEdge = b.y < a.y;
+
+            triangle.topLeftEdges[i] = topEdge || leftEdge;
+
+            triangle.worldPositions[i] = vertices[i]->worldPosition;
+            triangle.normals[i] = vertices[i]->normal;
+        }
+
+        const float inverseArea = 1.0f / area;
+        triangle.depthPlane = (triangle.edges[0] * depths[0] + triangle.edges[1] * depths[1] + triangle.edges[2] * depths[2]) * inverseArea;
+        triangle.inverseWs = inverseWs;
+
+        triangle.minDepth = std::min(std::min(depths[0], depths[1]), depths[2]);
+        triangle.maxDepth = std::max(std::max(depths[0], depths[1]), depths[2]);
+
+        triangle.min = glm::ivec2{ minPixel };
+        triangle.max = glm::ivec2{ maxPixel };
+
+        triangle.material = material;
+
+        m_Triangles.push_back(triangle);
+    }
+
+    void SoftwarePhong::BinTriangles() {
+        for (auto& tile : m_Tiles) {
+            tile.triangles.clear();
+        }
+
+        for (uint32_t i = 0; i < (uint32_t)m_Triangles.size(); ++i) {
+            const RasterTriangle& triangle = m_Triangles[i];
+
+            const glm::ivec2 minTile = triangle.min / m_TileSize;
+            const glm::ivec2 maxTile = triangle.max / m_TileSize;
+
+            for (int y = minTile.y; y <= maxTile.y; ++y) {
+                for (int x = minTile.x; x <= maxTile.x; ++x) {
+                    m_Tiles[x + y * m_TileCountX].triangles.push_back(i);
+                }
+            }
+        }
+    }
+
+    void SoftwarePhong::RasterizeTile(Tile& tile) {
+        for (int y = tile.min.y; y < tile.max.y; ++y) {
+            const size_t rowStart = (size_t)tile.min.x + (size_t)y * (size_t)App::screenWidth;
+            const size_t rowLength = (size_t)(tile.max.x - tile.min.x);
+
+            std::fill_n(m_DepthBuffer.begin() + rowStart, rowLength, 1.0f);
+            std::fill_n(m_TriangleIndexBuffer.begin() + rowStart, rowLength, noTriangle);
+        }
+
+        for (int blockY = tile.min.y; blockY < tile.max.y; blockY += blockSize) {
+            for (int blockX = tile.min.x; blockX < tile.max.x; blockX += blockSize) {
+                m_BlockDepthBounds[blockX / blockSize + (blockY / blockSize) * m_BlockCountX] = glm::vec2{ 1.0f };
+            }
+        }
+
+        tile.rejectedBlocks = 0;
+        tile.partialBlocks = 0;
+        tile.coveredBlocks = 0;
+
+        tile.maxDepth = 1.0f;
+        tile.maxDepthOutdated = false;
+
+        tile.occludedTriangles = 0;
+        tile.occludedBlocks = 0;
+
+        // Triangles are in submission order, so pixels with equal depth keep the first triangle like glDepthFunc(GL_LESS)
+        for (const uint32_t triangleIndex : tile.triangles) {
+            const RasterTriangle& triangle = m_Triangles[triangleIndex];
+
+            if (tile.maxDepthOutdated) {
+                tile.maxDepth = 0.0f;
+
+                for (int blockY = tile.min.y; blockY < tile.max.y; blockY += blockSize) {
+                    for (int blockX = tile.min.x; blockX < tile.max.x; blockX += blockSize) {
+                        tile.maxDepth = std::max(tile.maxDepth, m_BlockDepthBounds[blockX / blockSize + (blockY / blockSize) * m_BlockCountX].y);
+                    }
+                }
+
+                tile.maxDepthOutdated = false;
+            }
+
+            // Everything the triangle could cover in this tile is already closer
+            if (triangle.minDepth >= tile.maxDepth) {
+                ++tile.occludedTriangles;
+                continue;
+            }
+
+            const glm::ivec2 min = glm::max(triangle.min, tile.min);
+            const glm::ivec2 max = glm::min(triangle.max, tile.max - 1);
+
+            // Tiles start on a block boundary
+            for (int blockY = min.y - (min.y - tile.min.y) % blockSize; blockY <= max.y; blockY += blockSize) {
+                for (int blockX = min.x - (min.x - tile.min.x) % blockSize; blockX <= max.x; blockX += blockSize) {
+                    // Edge functions and depth are linear, so their extremes over the block are at its corners
+                    const glm::vec3 blockCorner{ (float)blockX + 0.5f, (float)blockY + 0.5f, 1.0f };
+                    const float blockExtent = (float)(blockSize - 1);
+
+                    auto minOverBlock = [&](const glm::vec3& plane) { return glm::dot(plane, blockCorner) + std::min(plane.x * blockExtent, 0.0f) + std::min(plane.y * blockExtent, 0.0f); };
+                    auto maxOverBlock = [&](const glm::vec3& plane) { return glm::dot(plane, blockCorner) + std::max(plane.x * blockExtent, 0.0f) + std::max(plane.y * blockExtent, 0.0f); };
+
+                    bool outside = false;
+                    bool fullyCovered = true;
+
+                    for (const auto& edge : triangle.edges) {
+                        outside |= maxOverBlock(edge) < 0.0f;
+                        fullyCovered &= minOverBlock(edge) > 0.0f;
+                    }
+
+                    if (outside) {
+                        ++tile.rejectedBlocks;
+                        continue;
+                    }
+
+                    const glm::vec2& blockDepthBounds = m_BlockDepthBounds[blockX / blockSize + (blockY / blockSize) * m_BlockCountX];
+
+                    const float triangleMinDepth = std::max(minOverBlock(triangle.depthPlane), triangle.minDepth);
+                    const float triangleMaxDepth = std::min(maxOverBlock(triangle.depthPlane), triangle.maxDepth);
+
+                    if (triangleMinDepth >= blockDepthBounds.y) {
+                        ++tile.occludedBlocks;
+                        continue;
+                    }
+
+                    if (fullyCovered) {
+                        ++tile.coveredBlocks;
+                    } else {
+                        ++tile.partialBlocks;
+                    }
+
+                    // In front of everything in the block, the depth buffer doesn't need to be read
+                    const bool depthTest = triangleMaxDepth >= blockDepthBounds.x;
+
+                    const int firstX = std::max(blockX, min.x);
+                    const int lastX = std::min(blockX + blockSize - 1, max.x);
+
+                    bool written = false;
+                    for (int y = std::max(blockY, min.y); y <= std::min(blockY + blockSize - 1, max.y); ++y) {
+                        written |= RasterizeSpan(triangle, triangleIndex, firstX, lastX - firstX + 1, y, fullyCovered, depthTest);
+                    }
+
+                    if (written) {
+                        UpdateBlockDepthBounds(blockX, blockY, tile);
+                        tile.maxDepthOutdated = true;
+                    }
+                }
+            }
+        }
+    }
+
+    // Rasterizes up to blockSize pixels of a single row starting at x, 8 pixels at a time with AVX2
+    bool SoftwarePhong::RasterizeSpan(const RasterTriangle& triangle, uint32_t triangleIndex, int x, int count, int y, bool fullyCovered, bool depthTest) {
+        const size_t rowStart = (size_t)x + (size_t)y * (size_t)App::screenWidth;
+        const float pixelY = (float)y + 0.5f;
+
+        if (m_AVX2CoverageTests) {
+            static_assert(blockSize == 8, "The AVX2 path handles exactly 8 pixels per row");
+
+            return RasterizationAVX2::RasterizeSpan(
+                &triangle.edges[0].x, triangle.topLeftEdges.data(), &triangle.depthPlane.x,
+                (float)x + 0.5f, pixelY, count, fullyCovered, depthTest, triangleIndex,
+                m_DepthBuffer.data() + rowStart, m_TriangleIndexBuffer.data() + rowStart
+            );
+        }
+
+        bool written = false;
+
+        for (int i = 0; i < count; ++i) {
+            const glm::vec3 pixelCenter{ (float)(x + i) + 0.5f, pixelY, 1.0f };
+
+            bool inside = true;
+
+            if (!fullyCovered) {
+                for (int j = 0; j < 3; ++j) {
+                    const float edge = glm::dot(triangle.edges[j], pixelCenter);
+
+                    inside &= edge > 0.0f || (edge == 0.0f && triangle.topLeftEdges[j]);
+                }
+            }
+
+            const float depth = glm::dot(triangle.depthPlane, pixelCenter);
+
+            if (inside && (!depthTest || depth < m_DepthBuffer[rowStart + i])) {
+                m_DepthBuffer[rowStart + i] = depth;
+                m_TriangleIndexBuffer[rowStart + i] = triangleIndex;
+
+                written = true;
+            }
+        }
+
+        return written;
+    }
+
+    void SoftwarePhong::UpdateBlockDepthBounds(int blockX, int blockY, const Tile& tile) {
+        glm::vec2 bounds{ 1.0f, 0.0f };
+
+        for (int y = blockY; y < std::min(blockY + blockSize, tile.max.y); ++y) {
+            for (int x = blockX; x < std::min(blockX + blockSize, tile.max.x); ++x) {
+                const float depth = m_DepthBuffer[(size_t)x + (size_t)y * (size_t)App::screenWidth];
+
+                bounds.x = std::min(bounds.x, depth);
+                bounds.y = std::max(bounds.y, depth);
+            }
+        }
+
+        m_BlockDepthBounds[blockX / blockSize + (blockY / blockSize) * m_BlockCountX] = bounds;
+    }
+
+    // Visibility is resolved at this point, so every pixel is shaded at most once
+    void SoftwarePhong::ShadeTile(Tile& tile) {
+        const glm::vec4 clearColor{ 0.5f, 0.5f, 0.5f, 1.0f };
+
+        tile.shadedPixels = 0;
+
+        for (int y = tile.min.y; y < tile.max.y; ++y) {
+            // The edge values of the triangle in the last pixel, stepped along the row while it stays the same triangle
+            uint32_t previousTriangleIndex = noTriangle;
+            glm::vec3 edgeValues{ 0.0f };
+            glm::vec3 edgeSteps{ 0.0f };
+
+            for (int x = tile.min.x; x < tile.max.x; ++x) {
+                const size_t pixelIndex = (size_t)x + (size_t)y * (size_t)App::screenWidth;
+                const uint32_t triangleIndex = m_TriangleIndexBuffer[pixelIndex];
+
+                if (triangleIndex == noTriangle) {
+                    m_ColorBuffer[pixelIndex] = clearColor;
+                    previousTriangleIndex = noTriangle;
+                    continue;
+                }
+
+                const RasterTriangle& triangle = m_Triangles[triangleIndex];
+
+                if (triangleIndex == previousTriangleIndex) {
+                    edgeValues += edgeSteps;
+                } else {
+                    const glm::vec3 pixelCenter{ (float)x + 0.5f, (float)y + 0.5f, 1.0f };
+
+                    edgeValues = glm::vec3{
+                        glm::dot(triangle.edges[0], pixelCenter),
+                        glm::dot(triangle.edges[1], pixelCenter),
+                        glm::dot(triangle.edges[2], pixelCenter)
+                    };
+                    edgeSteps = glm::vec3{ triangle.edges[0].x, triangle.edges[1].x, triangle.edges[2].x };
+
+                    previousTriangleIndex = triangleIndex;
+                }
+
+                // Perspective correct interpolation, the edge values are the barycentrics scaled by twice the area
+                // which cancels out in the division
+                glm::vec3 perspectiveWeights = edgeValues * triangle.inverseWs;
+                perspectiveWeights /= perspectiveWeights.x + perspectiveWeights.y + perspectiveWeights.z;
+
+                const glm::vec3 fragPosition =
+                    perspectiveWeights.x * triangle.worldPositions[0] +
+                    perspectiveWeights.y * triangle.worldPositions[1] +
+                    perspectiveWeights.z * triangle.worldPositions[2];
+
+                const glm::vec3 normal =
+                    perspectiveWeights.x * triangle.normals[0] +
+                    perspectiveWeights.y * triangle.normals[1] +
+                    perspectiveWeights.z * triangle.normals[2];
+
+                m_ColorBuffer[pixelIndex] = glm::vec4{ ShadePhong(App::scene.materialBank[triangle.material].phong, fragPosition, normal), 1.0f };
+
+                ++tile.shadedPixels;
+            }
+        }
+    }
+
+    // Same as phong.frag without shadows
+    glm::vec3 SoftwarePhong::ShadePhong(const Material::Phong& phong, glm::vec3 fragPosition, glm::vec3 normal) const {
+        glm::vec3 result{ 0.0f };
+
+        const glm::vec3 norm = glm::normalize(normal);
+        const glm::vec3 viewDir = glm::normalize(App::camera.position - fragPosition);
+
+        for (const auto& light : App::scene.pointLights) {
+            const glm::vec3 lightDirection = glm::normalize(light.position - fragPosition);
+
+            const float diff = std::max(glm::dot(norm, lightDirection), 0.0f);
+
+            const glm::vec3 reflectDirection = glm::reflect(-lightDirection, norm);
+            const float spec = std::pow(std::max(glm::dot(viewDir, reflectDirection), 0.0f), phong.shininess);
+
+            const float lightDistance = glm::length(light.position - fragPosition);
+            const float attenuation = 1.0f / (light.constant + light.linear * lightDistance + light.quadratic * (lightDistance * lightDistance));
+
+            const glm::vec3 ambient = light.ambient * phong.ambient;
+            const glm::vec3 diffuse = light.diffuse * diff * phong.diffuse;
+            const glm::vec3 specular = light.specular * spec * phong.specular;
+
+            result += (ambient + diffuse + specular) * attenuation;
+        }
+
+        if (App::scene.HasDirectionalLight()) {
+            const DirectionalLight& light = App::scene.directionalLight;
+
+            const glm::vec3 lightDirection = glm::normalize(-light.direction);
+
+            const float diff = std::max(glm::dot(norm, lightDirection), 0.0f);
+
+            const glm::vec3 reflectDirection = glm::reflect(-lightDirection, norm);
+            const float spec = std::pow(std::max(glm::dot(viewDir, reflectDirection), 0.0f), phong.shininess);
+
+            const glm::vec3 ambient = light.ambient * phong.ambient;
+            const glm::vec3 diffuse = light.diffuse * diff * phong.diffuse;
+            const glm::vec3 specular = light.specular * spec * phong.specular;
+
+            result += ambient + diffuse + specular;
+        }
 
+        // Linear to gamma
+        return glm::vec3{
+            result.r > 0.0f ? std::sqrt(result.r) : 0.0f,
+            result.g > 0.0f ? std::sqrt(result.g) : 0.0f,
+            result.b > 0.0f ? std::sqrt(result.b) : 0.0f
+        };
     }
 }
\ No newline at end of file
@@ -1,10 +1,17 @@
 #pragma once
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string>
 
 #include "renderers/Renderer.h"
 
 #include <gl/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "Utility/CPUFeatures.h"
+#include "Utility/ThreadPool.h"
+
 namespace Rutile {
     class SoftwarePhong : public Renderer {
     public:
@@ -16,7 +23,142 @@ namespace Rutile {
 
         void LoadScene() override;
 
+        void ProjectionMatrixUpdate() override;
+
+        // GUI
+        void ProvideTimingStatistics() override;
+        void ProvideLocalRendererSettings() override;
+
     private:
+        struct ClipVertex {
+            glm::vec4 clipPosition;
+            glm::vec3 worldPosition;
+            glm::vec3 normal;
+        };
+
+        // A triangle after clipping and the viewport transform, ready to be rasterized
+        struct RasterTriangle {
+            // Coefficients (a, b, c) of the edge function a * x + b * y + c for the edge opposite each vertex,
+            // all three are positive inside of the triangle
+            std::array<glm::vec3, 3> edges;
+            std::array<bool, 3> topLeftEdges; // Pixels exactly on a top or left edge belong to this triangle
+
+            // Plane equations in the same form as the edges, so depth and 1 / w can be evaluated at any pixel directly
+            glm::vec3 depthPlane;
+            glm::vec3 inverseWs;
+
+            float minDepth;
+            float maxDepth;
+
+            std::array<glm::vec3, 3> worldPositions;
+            std::array<glm::vec3, 3> normals;
+
+            // Inclusive pixel bounds, clamped to the screen
+            glm::ivec2 min;
+            glm::ivec2 max;
+
+            MaterialIndex material;
+        };
+
+        struct Tile {
+            // Pixel bounds, max is exclusive
+            glm::ivec2 min;
+            glm::ivec2 max;
+
+            std::vector<uint32_t> triangles; // Indices into m_Triangles, in submission order
+
+            // Outcome of the coverage test of each blockSize^2 block a triangle's bounding box overlapped
+            size_t rejectedBlocks{ 0 };
+            size_t partialBlocks{ 0 };
+            size_t coveredBlocks{ 0 };
+
+            // Hierarchical Z, the farthest depth stored anywhere in the tile
+            float maxDepth{ 1.0f };
+            bool maxDepthOutdated{ false };
+
+            size_t occludedTriangles{ 0 };
+            size_t occludedBlocks{ 0 };
+            size_t shadedPixels{ 0 };
+        };
+
+        // Triangles are rasterized in blockSize x blockSize blocks, whole blocks are rejected or accepted from their
+        // corners and only partially covered blocks test individual pixels. Tiles are always a multiple of this size.
+        static constexpr int blockSize = 8;
+
+        static constexpr uint32_t noTriangle = 0xFFFFFFFF;
+
+        // Tests 8 pixels of a row at a time with RasterizationAVX2, only when the CPU supports it
+        bool m_AVX2CoverageTests{ CPUSupportsAVX2() };
+
+        using RasterizationThreadPool = ThreadPool<Tile*>;
+
+        void ResizeFramebuffer();
+
+        void UpdateVertexCache();
+        void TransformAndClip();
+        void SetupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, MaterialIndex material);
+        void BinTriangles();
+        void RasterizeTile(Tile& tile);
+        bool RasterizeSpan(const RasterTriangle& triangle, uint32_t triangleIndex, int x, int count, int y, bool fullyCovered, bool depthTest); // Returns true if any pixel was written
+        void UpdateBlockDepthBounds(int blockX, int blockY, const Tile& tile);
+        void ShadeTile(Tile& tile);
+
+        void RasterizeFrame();
+
+        glm::vec3 ShadePhong(const Material::Phong& phong, glm::vec3 fragPosition, glm::vec3 normal) const;
+
+        std::unique_ptr<RasterizationThreadPool> m_ThreadPool;
+
+        glm::mat4 m_Projection{ 1.0f };
+        glm::mat4 m_View{ 1.0f };
+        glm::mat4 m_ViewProjection{ 1.0f };
+        bool m_ViewProjectionOutdated{ true };
+
+        // Post transform vertex cache, every vertex of an object is transformed once and reused until the object or the
+        // camera changes. Kept as a structure of arrays so that the transformation loops vectorize.
+        struct TransformedObject {
+            glm::mat4 model{ 1.0f }; // Matrix the world positions were built with
+
+            std::vector<float> worldX, worldY, worldZ;
+            std::vector<float> clipX, clipY, clipZ, clipW;
+
+            bool worldOutdated{ true };
+            bool clipOutdated{ true };
+        };
+
+        std::vector<TransformedObject> m_VertexCache; // One per object
+        size_t m_TransformedVertexCount{ 0 }; // Vertices transformed during the last frame
+
+        int m_TileSize{ 64 };
+        int m_TileCountX{ 0 };
+        int m_TileCountY{ 0 };
+        std::vector<Tile> m_Tiles;
+
+        std::vector<RasterTriangle> m_Triangles;
+
+        std::vector<glm::vec4> m_ColorBuffer;
+        std::vector<float> m_DepthBuffer;
+
+        // Shading is deferred until every triangle in a tile has been rasterized, in the meantime each pixel only
+        // stores the closest triangle so far
+        std::vector<uint32_t> m_TriangleIndexBuffer;
+
+        // Nearest and farthest depth of every blockSize^2 block of the depth buffer
+        int m_BlockCountX{ 0 };
+        std::vector<glm::vec2> m_BlockDepthBounds;
+
+        // Timing Statistics
+        std::chrono::duration<double> m_GeometryTime{ };
+        std::chrono::duration<double> m_BinningTime{ };
+        std::chrono::duration<double> m_RasterizationTime{ };
+
+        // Rasterization benchmark, renders the 80K triangle dragon without presenting it
+        void RunRasterizationBenchmark();
+
+        int m_BenchmarkFrameCount{ 100 };
+
+        std::string m_BenchmarkReport{ };
+
         // Presenting Image
         unsigned int m_ShaderProgram{ 0 };
 
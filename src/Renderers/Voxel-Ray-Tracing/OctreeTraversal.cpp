@@ -0,0 +1,478 @@
+#include "OctreeTraversal.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+
+#include "Utility/Random.h"
+#include "Utility/TimeScope.h"
+
+namespace Rutile {
+    namespace OctreeTraversal {
+        // Same as MIN_RAY_DISTANCE in VoxelRayTracing.frag
+        constexpr float minRayDistance = 0.00007f;
+
+        Ray::Ray(glm::vec3 origin, glm::vec3 direction)
+            : origin(origin), direction(direction), inverseDirection(1.0f / direction) { }
+
+        // HitAABB3 in VoxelRayTracing.frag
+        bool HitAABB(const Ray& ray, const VoxelRayTracing::Voxel& voxel, float& distance) {
+            const glm::vec3 t0Temp = (voxel.minBound - ray.origin) * ray.inverseDirection;
+            const glm::vec3 t1Temp = (voxel.maxBound - ray.origin) * ray.inverseDirection;
+
+            const glm::vec3 t0 = glm::min(t0Temp, t1Temp);
+            const glm::vec3 t1 = glm::max(t0Temp, t1Temp);
+
+            const float tNear = std::max(t0.x, std::max(t0.y, t0.z));
+            const float tFar = std::min(t1.x, std::min(t1.y, t1.z));
+
+            distance = tNear;
+
+            return tFar >= tNear && tFar > 0.0f;
+        }
+
+        // HitAABB2 in VoxelRayTracing.frag
+        bool HitLeaf(const Ray& ray, const VoxelRayTracing::Voxel& voxel, HitInfo& hitInfo) {
+            const glm::vec3 t0Temp = (voxel.minBound - ray.origin) * ray.inverseDirection;
+            const glm::vec3 t1Temp = (voxel.maxBound - ray.origin) * ray.inverseDirection;
+
+            const glm::vec3 t0 = glm::min(t0Temp, t1Temp);
+            const glm::vec3 t1 = glm::max(t0Temp, t1Temp);
+
+            const float tNear = std::max(t0.x, std::max(t0.y, t0.z));
+            const float tFar = std::min(t1.x, std::min(t1.y, t1.z));
+
+            if (tFar < tNear || tFar <= 0.0f || tNear <= minRayDistance) {
+                return false;
+            }
+
+            hitInfo.distance = tNear;
+            hitInfo.position = ray.origin + ray.direction * tNear;
+
+            if (tNear == t0.x) {
+                hitInfo.normal = glm::vec3{ ray.inverseDirection.x > 0.0f ? -1.0f : 1.0f, 0.0f, 0.0f };
+            }
+            else if (tNear == t0.y) {
+                hitInfo.normal = glm::vec3{ 0.0f, ray.inverseDirection.y > 0.0f ? -1.0f : 1.0f, 0.0f };
+            }
+            else {
+                hitInfo.normal = glm::vec3{ 0.0f, 0.0f, ray.inverseDirection.z > 0.0f ? -1.0f : 1.0f };
+            }
+
+            return true;
+        }
+
+        // HitBrick in VoxelRayTracing.frag, only updates hitInfo if a cell closer than hitInfo.distance is hit
+        bool HitBrick(const Ray& ray, const VoxelRayTracing::Voxel& voxel, const VoxelBrick& brick, const BrickAttributes& brickAttributes, HitInfo& hitInfo) {
+            const glm::vec3 t0Temp = (voxel.minBound - ray.origin) * ray.inverseDirection;
+            const glm::vec3 t1Temp = (voxel.maxBound - ray.origin) * ray.inverseDirection;
+
+            const glm::vec3 t0 = glm::min(t0Temp, t1Temp);
+            const glm::vec3 t1 = glm::max(t0Temp, t1Temp);
+
+            const float tNear = std::max(t0.x, std::max(t0.y, t0.z));
+            const float tFar = std::min(t1.x, std::min(t1.y, t1.z));
+
+            if (tFar < tNear || tFar <= 0.0f) {
+                return false;
+            }
+
+            glm::vec3 normal;
+            if (tNear == t0.x) {
+                normal = glm::vec3{ ray.inverseDirection.x > 0.0f ? -1.0f : 1.0f, 0.0f, 0.0f };
+            }
+            else if (tNear == t0.y) {
+                normal = glm::vec3{ 0.0f, ray.inverseDirection.y > 0.0f ? -1.0f : 1.0f, 0.0f };
+            }
+            else {
+                normal = glm::vec3{ 0.0f, 0.0f, ray.inverseDirection.z > 0.0f ? -1.0f : 1.0f };
+            }
+
+            const float cellSize = (voxel.maxBound.x - voxel.minBound.x) / (float)VoxelBrick::size;
+
+            float t = std::max(tNear, 0.0f);
+            const glm::vec3 entryPoint = ray.origin + ray.direction * t;
+
+            glm::ivec3 cell = glm::clamp(glm::ivec3{ glm::floor((entryPoint - voxel.minBound) / cellSize) }, glm::ivec3{ 0 }, glm::ivec3{ VoxelBrick::size - 1 });
+            const glm::ivec3 cellStep = glm::ivec3{ glm::sign(ray.direction) };
+
+            const glm::vec3 tDelta = glm::abs(glm::vec3{ cellSize } * ray.inverseDirection);
+            glm::vec3 tMax = (voxel.minBound + (glm::vec3{ cell } + glm::max(glm::vec3{ cellStep }, glm::vec3{ 0.0f })) * cellSize - ray.origin) * ray.inverseDirection;
+
+            for (int axis = 0; axis < 3; ++axis) {
+                if (cellStep[axis] == 0) {
+                    tMax[axis] = std::numeric_limits<float>::max();
+                }
+            }
+
+            for (int i = 0; i < 3 * VoxelBrick::size; ++i) {
+                if (t > hitInfo.distance) {
+                    return false;
+                }
+
+                const int cellIndex = VoxelBrick::CellIndex(cell.x, cell.y, cell.z);
+                if (t > minRayDistance && brick.IsFilled(cellIndex)) {
+                    hitInfo.distance = t;
+                    hitInfo.position = ray.origin + ray.direction * t;
+                    hitInfo.normal = normal;
+                    hitInfo.material = brick.GetMaterial(brickAttributes, cellIndex);
+
+                    return true;
+                }
+
+                if (tMax.x < tMax.y && tMax.x < tMax.z) {
+                    t = tMax.x;
+                    tMax.x += tDelta.x;
+                    cell.x += cellStep.x;
+                    normal = glm::vec3{ -(float)cellStep.x, 0.0f, 0.0f };
+                }
+                else if (tMax.y < tMax.z) {
+                    t = tMax.y;
+                    tMax.y += tDelta.y;
+                    cell.y += cellStep.y;
+                    normal = glm::vec3{ 0.0f, -(float)cellStep.y, 0.0f };
+                }
+                else {
+                    t = tMax.z;
+                    tMax.z += tDelta.z;
+                    cell.z += cellStep.z;
+                    normal = glm::vec3{ 0.0f, 0.0f, -(float)cellStep.z };
+                }
+
+                if (glm::any(glm::lessThan(cell, glm::ivec3{ 0 })) || glm::any(glm::greaterThanEqual(cell, glm::ivec3{ VoxelBrick::size }))) {
+                    return false;
+                }
+            }
+
+            return false;
+        }
+
+        bool StackTraversal(const Voxels& voxels, const Bricks& bricks, const BrickAttributes& brickAttributes, int rootIndex, const Ray& ray, HitInfo& hitInfo, Stats& stats) {
+            struct DistIndex {
+                float dist;
+                int index;
+            };
+
+            hitInfo = HitInfo{ };
+            bool hitSomething = false;
+
+            float dist;
+            ++stats.boxChecks;
+            if (!HitAABB(ray, voxels[rootIndex], dist)) {
+                return false;
+            }
+
+            std::array<DistIndex, 128> stack{ };
+            int stackSize = 0;
+
+            stack[stackSize++] = DistIndex{ dist, rootIndex };
+
+            while (stackSize > 0) {
+                const DistIndex element = stack[--stackSize];
+                const VoxelRayTracing::Voxel& voxel = voxels[element.index];
+
+                ++stats.nodesVisited;
+
+                if (element.dist > hitInfo.distance) {
+                    continue;
+                }
+
+                if (voxel.hasKids) {
+                    std::array<DistIndex, 8> children{ };
+                    int childCount = 0;
+
+                    int childIndex = voxel.k0;
+                    for (int i = 0; i < 8; ++i) {
+                        if ((voxel.childMask & (1 << i)) == 0) continue;
+
+                        float childDist;
+                        ++stats.boxChecks;
+                        if (HitAABB(ray, voxels[childIndex], childDist)) {
+                            children[childCount++] = DistIndex{ childDist, childIndex };
+                        }
+
+                        ++childIndex;
+                    }
+
+                    // Furthest first, so that the closest child is on top of the stack
+                    std::sort(children.begin(), children.begin() + childCount, [](const DistIndex& a, const DistIndex& b) { return a.dist > b.dist; });
+
+                    for (int i = 0; i < childCount; ++i) {
+                        stack[stackSize++] = children[i];
+                    }
+                }
+                else if (voxel.shouldDraw) {
+                    HitInfo candidate{ };
+                    ++stats.boxChecks;
+                    if (HitLeaf(ray, voxel, candidate) && candidate.distance < hitInfo.distance) {
+                        hitInfo = candidate;
+                        hitInfo.material = voxel.k0;
+                        hitSomething = true;
+                    }
+                }
+                else if (voxel.brick != -1) {
+                    ++stats.boxChecks;
+                    if (HitBrick(ray, voxel, bricks[voxel.brick], brickAttributes, hitInfo)) {
+                        hitSomething = true;
+                    }
+                }
+            }
+
+            return hitSomething;
+        }
+
+        // Revelles et al. number the children with x = 4, y = 2, z = 1, where as the octree uses x = 1, z = 2, y = 4
+        int RevellesToOctant(int node) {
+            return ((node >> 2) & 1) | ((node & 1) << 1) | (((node >> 1) & 1) << 2);
+        }
+
+        int ChildIndex(const VoxelRayTracing::Voxel& voxel, int octant) {
+            if ((voxel.childMask & (1 << octant)) == 0) {
+                return -1;
+            }
+
+            return voxel.k0 + std::popcount((unsigned int)(voxel.childMask & ((1 << octant) - 1)));
+        }
+
+        // The child the ray enters first, found from the plane it enters the parent through
+        int FirstNode(glm::vec3 t0, glm::vec3 tm) {
+            int node = 0;
+
+            if (t0.x > t0.y && t0.x > t0.z) { // YZ plane
+                if (tm.y < t0.x) node |= 2;
+                if (tm.z < t0.x) node |= 1;
+            }
+            else if (t0.y > t0.z) { // XZ plane
+                if (tm.x < t0.y) node |= 4;
+                if (tm.z < t0.y) node |= 1;
+            }
+            else { // XY plane
+                if (tm.x < t0.z) node |= 4;
+                if (tm.y < t0.z) node |= 2;
+            }
+
+            return node;
+        }
+
+        // The child the ray moves into after leaving node through its closest exit plane, 8 if it leaves the parent
+        int NextNode(glm::vec3 t1, int node) {
+            if (t1.x < t1.y && t1.x < t1.z) {
+                return (node & 4) ? 8 : node | 4;
+            }
+            if (t1.y < t1.z) {
+                return (node & 2) ? 8 : node | 2;
+            }
+            return (node & 1) ? 8 : node | 1;
+        }
+
+        struct ParametricState {
+            const Voxels& voxels;
+            const Bricks& bricks;
+            const BrickAttributes& brickAttributes;
+            const Ray& ray;
+
+            int mirrorMask; // Axes the ray was mirrored along, in Revelles numbering
+
+            HitInfo& hitInfo;
+            Stats& stats;
+        };
+
+        bool ProcessSubtree(glm::vec3 t0, glm::vec3 t1, int voxelIndex, ParametricState& state) {
+            if (voxelIndex == -1 || t1.x < 0.0f || t1.y < 0.0f || t1.z < 0.0f) {
+                return false;
+            }
+
+            const VoxelRayTracing::Voxel& voxel = state.voxels[voxelIndex];
+
+            ++state.stats.nodesVisited;
+
+            if (!voxel.hasKids) {
+                if (voxel.brick != -1) {
+                    ++state.stats.boxChecks;
+                    return HitBrick(state.ray, voxel, state.bricks[voxel.brick], state.brickAttributes, state.hitInfo);
+                }
+
+                if (!voxel.shouldDraw) {
+                    return false;
+                }
+
+                const float tNear = std::max(t0.x, std::max(t0.y, t0.z));
+
+                // Matches HitLeaf, a ray starting inside (or on the surface of) a voxel does not hit it
+                if (tNear <= minRayDistance) {
+                    return false;
+                }
+
+                state.hitInfo.distance = tNear;
+                state.hitInfo.position = state.ray.origin + state.ray.direction * tNear;
+                state.hitInfo.material = voxel.k0;
+
+                if (tNear == t0.x) {
+                    state.hitInfo.normal = glm::vec3{ state.ray.direction.x > 0.0f ? -1.0f : 1.0f, 0.0f, 0.0f };
+                }
+                else if (tNear == t0.y) {
+                    state.hitInfo.normal = glm::vec3{ 0.0f, state.ray.direction.y > 0.0f ? -1.0f : 1.0f, 0.0f };
+                }
+                else {
+                    state.hitInfo.normal = glm::vec3{ 0.0f, 0.0f, state.ray.direction.z > 0.0f ? -1.0f : 1.0f };
+                }
+
+                return true;
+            }
+
+            const glm::vec3 tm = 0.5f * (t0 + t1);
+
+            int node = FirstNode(t0, tm);
+            while (node < 8) {
+                const glm::vec3 childT0{ (node & 4) ? tm.x : t0.x, (node & 2) ? tm.y : t0.y, (node & 1) ? tm.z : t0.z };
+                const glm::vec3 childT1{ (node & 4) ? t1.x : tm.x, (node & 2) ? t1.y : tm.y, (node & 1) ? t1.z : tm.z };
+
+                ++state.stats.boxChecks;
+                if (ProcessSubtree(childT0, childT1, ChildIndex(voxel, RevellesToOctant(node ^ state.mirrorMask)), state)) {
+                    return true;
+                }
+
+                node = NextNode(childT1, node);
+            }
+
+            return false;
+        }
+
+        bool ParametricTraversal(const Voxels& voxels, const Bricks& bricks, const BrickAttributes& brickAttributes, int rootIndex, const Ray& ray, HitInfo& hitInfo, Stats& stats) {
+            hitInfo = HitInfo{ };
+
+            const VoxelRayTracing::Voxel& root = voxels[rootIndex];
+
+            // The algorithm assumes every component of the direction is positive, so negative axes are mirrored about
+            // the center of the root and the children are flipped to match with mirrorMask.
+            glm::vec3 origin = ray.origin;
+            glm::vec3 direction = ray.direction;
+            int mirrorMask = 0;
+
+            constexpr std::array<int, 3> axisBits{ 4, 2, 1 };
+            for (int axis = 0; axis < 3; ++axis) {
+                if (direction[axis] < 0.0f) {
+                    origin[axis] = root.minBound[axis] + root.maxBound[axis] - origin[axis];
+                    direction[axis] = -direction[axis];
+                    mirrorMask |= axisBits[axis];
+                }
+
+                // Avoids infinities in the midpoint of the parameters for rays parallel to an axis
+                direction[axis] = std::max(direction[axis], 1e-8f);
+            }
+
+            const glm::vec3 t0 = (root.minBound - origin) / direction;
+            const glm::vec3 t1 = (root.maxBound - origin) / direction;
+
+            ++stats.boxChecks;
+            if (std::max(t0.x, std::max(t0.y, t0.z)) >= std::min(t1.x, std::min(t1.y, t1.z))) {
+                return false;
+            }
+
+            ParametricState state{ voxels, bricks, brickAttributes, ray, mirrorMask, hitInfo, stats };
+
+            return ProcessSubtree(t0, t1, rootIndex, state);
+        }
+
+        double BenchmarkResult::RaysPerSecond() const {
+            return seconds > 0.0 ? (double)(primaryRays + secondaryRays) / seconds : 0.0;
+        }
+
+        double BenchmarkResult::NodesVisitedPerRay() const {
+            const size_t rays = primaryRays + secondaryRays;
+
+            return rays > 0 ? (double)stats.nodesVisited / (double)rays : 0.0;
+        }
+
+        std::vector<BenchmarkResult> Benchmark(const Voxels& voxels, const Bricks& bricks, const BrickAttributes& brickAttributes, int rootIndex, const glm::mat4& inverseView, const glm::mat4& inverseProjection, glm::vec3 cameraPosition, int width, int height) {
+            if (voxels.empty()) {
+                return { };
+            }
+
+            // Primary rays are generated the same way as in VoxelRayTracing.frag, without the jitter
+            std::vector<Ray> rays{ };
+            rays.reserve((size_t)width * (size_t)height);
+
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    const glm::vec2 clipSpacePixelPosition = glm::vec2{ ((float)x + 0.5f) / (float)width, ((float)y + 0.5f) / (float)height } * 2.0f - 1.0f;
+
+                    const glm::vec4 target = inverseProjection * glm::vec4{ clipSpacePixelPosition, 1.0f, 1.0f };
+                    const glm::vec3 direction = glm::normalize(glm::vec3{ inverseView * glm::vec4{ glm::normalize(glm::vec3{ target } / target.w), 0.0f } });
+
+                    rays.emplace_back(cameraPosition, direction);
+                }
+            }
+
+            const size_t primaryRayCount = rays.size();
+
+            // Secondary rays are a single diffuse bounce off of each primary hit
+            for (size_t i = 0; i < primaryRayCount; ++i) {
+                HitInfo hitInfo{ };
+                Stats stats{ };
+
+                if (StackTraversal(voxels, bricks, brickAttributes, rootIndex, rays[i], hitInfo, stats)) {
+                    glm::vec3 direction = hitInfo.normal + RandomUnitVec3();
+                    if (glm::dot(direction, direction) < 1e-12f) {
+                        direction = hitInfo.normal;
+                    }
+
+                    rays.emplace_back(hitInfo.position, glm::normalize(direction));
+                }
+            }
+
+            using Traversal = bool(*)(const Voxels&, const Bricks&, const BrickAttributes&, int, const Ray&, HitInfo&, Stats&);
+
+            const std::array<std::pair<std::string, Traversal>, 2> traversals{
+                std::pair<std::string, Traversal>{ "Stack", StackTraversal },
+                std::pair<std::string, Traversal>{ "Parametric (Revelles)", ParametricTraversal }
+            };
+
+            std::vector<BenchmarkResult> results{ };
+            std::vector<HitInfo> referenceHits{ };
+
+            for (const auto& [name, traversal] : traversals) {
+                BenchmarkResult result{ };
+                result.name = name;
+                result.primaryRays = primaryRayCount;
+                result.secondaryRays = rays.size() - primaryRayCount;
+
+                std::vector<HitInfo> hits(rays.size());
+
+                std::chrono::duration<double> time{ };
+                {
+                    TimeScope timeScope{ &time };
+
+                    for (size_t i = 0; i < rays.size(); ++i) {
+                        if (traversal(voxels, bricks, brickAttributes, rootIndex, rays[i], hits[i], result.stats)) {
+                            ++result.hits;
+                        }
+                    }
+                }
+                result.seconds = time.count();
+
+                // The first traversal is the reference every other one is checked against
+                if (referenceHits.empty()) {
+                    referenceHits = hits;
+                }
+                else {
+                    for (size_t i = 0; i < rays.size(); ++i) {
+                        const bool referenceHit = referenceHits[i].material != -1;
+                        const bool hit = hits[i].material != -1;
+
+                        if (referenceHit != hit) {
+                            ++result.mismatches;
+                        }
+                        else if (hit && std::abs(referenceHits[i].distance - hits[i].distance) > 1e-3f * std::max(1.0f, referenceHits[i].distance)) {
+                            ++result.mismatches;
+                        }
+                    }
+                }
+
+                results.push_back(result);
+            }
+
+            return results;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "VoxelRayTracing.h"
+
+namespace Rutile {
+    // CPU versions of the octree traversal used in VoxelRayTracing.frag, so that the octree can be
+    // measured and checked without a GPU.
+    namespace OctreeTraversal {
+        struct Ray {
+            Ray() = default;
+            Ray(glm::vec3 origin, glm::vec3 direction);
+
+            glm::vec3 origin{ 0.0f };
+            glm::vec3 direction{ 0.0f, 0.0f, -1.0f };
+            glm::vec3 inverseDirection{ 0.0f };
+        };
+
+        struct HitInfo {
+            float distance{ std::numeric_limits<float>::max() };
+            glm::vec3 position{ 0.0f };
+            glm::vec3 normal{ 0.0f };
+
+            int material{ -1 };
+        };
+
+        struct Stats {
+            size_t nodesVisited{ 0 };
+            size_t boxChecks{ 0 };
+        };
+
+        using Voxels = std::vector<VoxelRayTracing::Voxel>;
+        using Bricks = std::vector<VoxelBrick>;
+        using BrickAttributes = std::vector<uint32_t>;
+
+        // Direct translation of HitScene in VoxelRayTracing.frag, children are sorted by distance and pushed onto a stack
+        bool StackTraversal(const Voxels& voxels, const Bricks& bricks, const BrickAttributes& brickAttributes, int rootIndex, const Ray& ray, HitInfo& hitInfo, Stats& stats);
+
+        // Parametric top down traversal from:
+        // J. Revelles, C. Urena, M. Lastra, "An Efficient Parametric Algorithm for Octree Traversal" (2000)
+        // Children are visited in the order the ray passes through them, so the first leaf hit is the closest one
+        // Both traversals step through bricks with the same DDA as HitBrick in VoxelRayTracing.frag
+        bool ParametricTraversal(const Voxels& voxels, const Bricks& bricks, const BrickAttributes& brickAttributes, int rootIndex, const Ray& ray, HitInfo& hitInfo, Stats& stats);
+
+        struct BenchmarkResult {
+            std::string name;
+
+            size_t primaryRays{ 0 };
+            size_t secondaryRays{ 0 };
+            size_t hits{ 0 };
+
+            Stats stats{ };
+
+            double seconds{ 0.0 };
+
+            size_t mismatches{ 0 }; // Rays where the result disagrees with the stack traversal
+
+            double RaysPerSecond() const;
+            double NodesVisitedPerRay() const;
+        };
+
+        // Fires one primary ray per pixel of a width x height image from the camera, and one diffuse bounce from every
+        // primary hit, through both traversals.
+        std::vector<BenchmarkResult> Benchmark(const Voxels& voxels, const Bricks& bricks, const BrickAttributes& brickAttributes, int rootIndex, const glm::mat4& inverseView, const glm::mat4& inverseProjection, glm::vec3 cameraPosition, int width, int height);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Rutile {
+    // Octree nodes covering size^3 cells of the grid that are neither empty nor full store those cells in a brick instead
+    // of more nodes, rays then step through the cells of the brick directly.
+    // VoxelRayTracing.frag receives the constants below as #defines (see GLSLDefines), so this is the only place the
+    // layout is defined.
+    //
+    // Materials are kept out of the brick in a separate attribute stream. Starting at attributeOffset it holds the
+    // paletteSize materials used by the brick, followed by a bitsPerIndex wide palette index for every cell.
+    // A brick with a single material has no indices at all.
+    struct VoxelBrick {
+        static constexpr int size = 8;
+        static constexpr int cellCount = size * size * size;
+
+        // One bit per cell
+        static constexpr int occupancyWordCount = cellCount / 32;
+
+        static constexpr int wordCount = occupancyWordCount + 3;
+
+        // Same ordering as Grid
+        static int CellIndex(int x, int y, int z) {
+            return x * size * size + y * size + z;
+        }
+
+        // cellMaterials holds the material of each cell, or -1 for empty cells, the brick's palette and indices are
+        // appended to attributes
+        static VoxelBrick Create(const std::array<int, cellCount>& cellMaterials, std::vector<uint32_t>& attributes) {
+            VoxelBrick brick{ };
+
+            std::vector<int> palette{ };
+            std::array<int, cellCount> paletteIndices{ };
+
+            for (int cell = 0; cell < cellCount; ++cell) {
+                if (cellMaterials[cell] == -1) continue;
+
+                brick.occupancy[cell / 32] |= 1u << (cell % 32);
+
+                auto it = std::find(palette.begin(), palette.end(), cellMaterials[cell]);
+                paletteIndices[cell] = (int)(it - palette.begin());
+
+                if (it == palette.end()) {
+                    palette.push_back(cellMaterials[cell]);
+                }
+            }
+
+            // Powers of two so that an index never crosses a word
+            int bitsPerIndex = 0;
+            while (palette.size() > ((size_t)1 << bitsPerIndex)) {
+                bitsPerIndex = bitsPerIndex == 0 ? 1 : bitsPerIndex * 2;
+            }
+
+            brick.attributeOffset = (uint32_t)attributes.size();
+            brick.paletteSize = (uint32_t)palette.size();
+            brick.bitsPerIndex = (uint32_t)bitsPerIndex;
+
+            for (int material : palette) {
+                attributes.push_back((uint32_t)material);
+            }
+
+            if (bitsPerIndex != 0) {
+                const int indicesPerWord = 32 / bitsPerIndex;
+                const size_t firstIndexWord = attributes.size();
+
+                attributes.resize(firstIndexWord + (size_t)cellCount / (size_t)indicesPerWord, 0);
+
+                for (int cell = 0; cell < cellCount; ++cell) {
+                    attributes[firstIndexWord + cell / indicesPerWord] |= (uint32_t)paletteIndices[cell] << ((cell % indicesPerWord) * bitsPerIndex);
+                }
+            }
+
+            return brick;
+        }
+
+        bool IsFilled(int cell) const {
+            return (occupancy[cell / 32] & (1u << (cell % 32))) != 0;
+        }
+
+        int GetMaterial(const std::vector<uint32_t>& attributes, int cell) const {
+            uint32_t paletteIndex = 0;
+
+            if (bitsPerIndex != 0) {
+                const uint32_t indicesPerWord = 32 / bitsPerIndex;
+                const uint32_t word = attributes[attributeOffset + paletteSize + (uint32_t)cell / indicesPerWord];
+
+                paletteIndex = (word >> (((uint32_t)cell % indicesPerWord) * bitsPerIndex)) & ((1u << bitsPerIndex) - 1);
+            }
+
+            return (int)attributes[attributeOffset + paletteIndex];
+        }
+
+        // Number of words in the attribute stream used by this brick
+        size_t AttributeWordCount() const {
+            return paletteSize + (bitsPerIndex == 0 ? 0 : (size_t)cellCount / (size_t)(32 / bitsPerIndex));
+        }
+
+        static std::string GLSLDefines() {
+            return
+                "#define BRICK_SIZE " + std::to_string(size) + "\n"
+                "#define BRICK_OCCUPANCY_WORDS " + std::to_string(occupancyWordCount) + "\n"
+                "#define BRICK_WORDS " + std::to_string(wordCount);
+        }
+
+        std::array<uint32_t, occupancyWordCount> occupancy{ };
+
+        uint32_t attributeOffset{ 0 };
+        uint32_t paletteSize{ 0 };
+        uint32_t bitsPerIndex{ 0 };
+    };
+
+    static_assert(sizeof(VoxelBrick) == VoxelBrick::wordCount * sizeof(uint32_t), "VoxelBrick must match the layout in VoxelRayTracing.frag");
+}
\ No newline at end of file
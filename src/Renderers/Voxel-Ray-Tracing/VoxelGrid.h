@@ -0,0 +1,150 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace Rutile {
+    // A single cell of the grid, either empty or filled with a material
+    struct VoxelValue {
+        VoxelValue() = default;
+        explicit VoxelValue(int materialIndex)
+            : materialIndex(materialIndex) { }
+
+        bool IsFilled() const {
+            return materialIndex != -1;
+        }
+
+        int GetMaterialIndex() const {
+            return materialIndex;
+        }
+
+        int materialIndex{ -1 };
+    };
+
+    // Dense grid of voxels, stored as chunks of chunkSize^3 cells. Each chunk only stores indices into its own palette of
+    // materials, using as few bits per cell as that palette allows, so the number of materials in a scene has no effect
+    // on the memory used per cell.
+    struct Grid {
+        static constexpr int chunkSize = 8;
+
+        Grid(int n)
+            : n{ n }, chunksPerSide{ (n + chunkSize - 1) / chunkSize } {
+
+            chunks.resize((size_t)chunksPerSide * (size_t)chunksPerSide * (size_t)chunksPerSide);
+        }
+
+        VoxelValue Get(int x, int y, int z) const {
+            const Chunk& chunk = chunks[ChunkIndex(x, y, z)];
+
+            return VoxelValue{ chunk.palette[chunk.GetPaletteIndex(CellIndex(x, y, z))] };
+        }
+
+        VoxelValue Get(size_t index) const {
+            const glm::ivec3 coordinate = Coordinate(index);
+
+            return Get(coordinate.x, coordinate.y, coordinate.z);
+        }
+
+        void Set(int x, int y, int z, VoxelValue val) {
+            chunks[ChunkIndex(x, y, z)].Set(CellIndex(x, y, z), val.materialIndex);
+        }
+
+        void Set(size_t index, VoxelValue val) {
+            const glm::ivec3 coordinate = Coordinate(index);
+
+            Set(coordinate.x, coordinate.y, coordinate.z, val);
+        }
+
+        size_t Index(int x, int y, int z) const {
+            return (size_t)x * (size_t)n * (size_t)n + (size_t)y * (size_t)n + (size_t)z;
+        }
+
+        glm::ivec3 Coordinate(size_t index) const {
+            return glm::ivec3{ (int)(index / ((size_t)n * (size_t)n)), (int)((index / (size_t)n) % (size_t)n), (int)(index % (size_t)n) };
+        }
+
+        int Size() const {
+            return n;
+        }
+
+    private:
+        struct Chunk {
+            std::vector<int> palette{ -1 }; // palette[0] is always an empty cell, so a new chunk needs no indices at all
+
+            int bitsPerIndex{ 0 }; // Always a power of two (or 0) so that indices never cross a word
+            std::vector<uint32_t> indices{ };
+
+            int GetPaletteIndex(int cell) const {
+                if (bitsPerIndex == 0) {
+                    return 0;
+                }
+
+                const int indicesPerWord = 32 / bitsPerIndex;
+                const uint32_t mask = bitsPerIndex == 32 ? 0xFFFFFFFF : (1u << bitsPerIndex) - 1;
+
+                return (int)((indices[cell / indicesPerWord] >> ((cell % indicesPerWord) * bitsPerIndex)) & mask);
+            }
+
+            void SetPaletteIndex(int cell, int paletteIndex) {
+                const int indicesPerWord = 32 / bitsPerIndex;
+                const int shift = (cell % indicesPerWord) * bitsPerIndex;
+                const uint32_t mask = bitsPerIndex == 32 ? 0xFFFFFFFF : (1u << bitsPerIndex) - 1;
+
+                uint32_t& word = indices[cell / indicesPerWord];
+                word &= ~(mask << shift);
+                word |= ((uint32_t)paletteIndex & mask) << shift;
+            }
+
+            void Set(int cell, int material) {
+                auto it = std::find(palette.begin(), palette.end(), material);
+                const int paletteIndex = (int)(it - palette.begin());
+
+                if (it == palette.end()) {
+                    palette.push_back(material);
+
+                    int newBitsPerIndex = std::max(bitsPerIndex, 1);
+                    while (newBitsPerIndex < 32 && palette.size() > ((size_t)1 << newBitsPerIndex)) {
+                        newBitsPerIndex *= 2;
+                    }
+
+                    if (newBitsPerIndex != bitsPerIndex) {
+                        Repack(newBitsPerIndex);
+                    }
+                }
+
+                SetPaletteIndex(cell, paletteIndex);
+            }
+
+            void Repack(int newBitsPerIndex) {
+                constexpr int cellCount = chunkSize * chunkSize * chunkSize;
+
+                std::vector<int> paletteIndices(cellCount);
+                for (int i = 0; i < cellCount; ++i) {
+                    paletteIndices[i] = GetPaletteIndex(i);
+                }
+
+                bitsPerIndex = newBitsPerIndex;
+                indices.assign((size_t)cellCount / (size_t)(32 / bitsPerIndex), 0);
+
+                for (int i = 0; i < cellCount; ++i) {
+                    SetPaletteIndex(i, paletteIndices[i]);
+                }
+            }
+        };
+
+        size_t ChunkIndex(int x, int y, int z) const {
+            return ((size_t)(x / chunkSize) * (size_t)chunksPerSide + (size_t)(y / chunkSize)) * (size_t)chunksPerSide + (size_t)(z / chunkSize);
+        }
+
+        static int CellIndex(int x, int y, int z) {
+            return (x % chunkSize) * chunkSize * chunkSize + (y % chunkSize) * chunkSize + (z % chunkSize);
+        }
+
+        int n;
+        int chunksPerSide;
+
+        std::vector<Chunk> chunks{ };
+    };
+}
\ No newline at end of file
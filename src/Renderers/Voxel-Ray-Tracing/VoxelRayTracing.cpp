@@ -2,16 +2,22 @@
 #include "imgui.h"
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <bitset>
 #include <iostream>
+#include <sstream>
 #include <stack>
+#include <unordered_map>
 
 #include "GUI/ImGuiUtil.h"
 
+#include "OctreeTraversal.h"
+
 #include "Settings/App.h"
 
 #include "Utility/Random.h"
 #include "Utility/events/Events.h"
+#include "Utility/OpenGl/GLCapabilities.h"
 #include "Utility/OpenGl/GLDebug.h"
 #include "Utility/RayTracing/AABB.h"
 #include "Utility/RayTracing/AABBFactory.h"
@@ -45,6 +51,8 @@ namespace Rutile {
 
         m_MaterialBank = std::make_unique<SSBO<LocalMaterial>>(0);
         m_VoxelSSBO = std::make_unique<SSBO<Voxel>>(5);
+        m_BrickSSBO = std::make_unique<SSBO<VoxelBrick>>(6);
+        m_BrickAttributeSSBO = std::make_unique<SSBO<uint32_t>>(7);
 
         std::vector<float> vertices = {
             // Positions
@@ -59,7 +67,7 @@ namespace Rutile {
             0, 2, 3
         };
 
-        m_VoxelRayTracingShader = std::make_unique<Shader>("assets\\shaders\\renderers\\VoxelRayTracing\\VoxelRayTracing.vert", "assets\\shaders\\renderers\\VoxelRayTracing\\VoxelRayTracing.frag");
+        m_VoxelRayTracingShader = std::make_unique<Shader>("assets\\shaders\\renderers\\VoxelRayTracing\\VoxelRayTracing.vert", "assets\\shaders\\renderers\\VoxelRayTracing\\VoxelRayTracing.frag", "", VoxelBrick::GLSLDefines());
         m_RenderingShader = std::make_unique<Shader>("assets\\shaders\\renderers\\VoxelRayTracing\\Rendering.vert", "assets\\shaders\\renderers\\VoxelRayTracing\\Rendering.frag");
 
         // Screen Rectangle
@@ -95,6 +103,27 @@ namespace Rutile {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
+        glGenTextures(1, &m_MomentTexture);
+        glBindTexture(GL_TEXTURE_2D, m_MomentTexture);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_MomentTexture, 0);
+
+        glGenTextures(1, &m_PrimaryHitDistanceTexture);
+        glBindTexture(GL_TEXTURE_2D, m_PrimaryHitDistanceTexture);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_PrimaryHitDistanceTexture, 0);
+
+        const std::array<GLenum, 3> drawBuffers{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+        glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+
         glGenRenderbuffers(1, &m_AccumulationRBO);
         glBindRenderbuffer(GL_RENDERBUFFER, m_AccumulationRBO);
 
@@ -107,231 +136,163 @@ namespace Rutile {
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+        // History, only ever copied into and read with texelFetch
+        glGenTextures(1, &m_HistoryAccumulationTexture);
+        glBindTexture(GL_TEXTURE_2D, m_HistoryAccumulationTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenTextures(1, &m_HistoryMomentTexture);
+        glBindTexture(GL_TEXTURE_2D, m_HistoryMomentTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenTextures(1, &m_HistoryPrimaryHitDistanceTexture);
+        glBindTexture(GL_TEXTURE_2D, m_HistoryPrimaryHitDistanceTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
         m_VoxelRayTracingShader->Bind();
 
+        m_ActivePixelCounter = std::make_unique<GPUCounter>();
+
         ResetAccumulatedPixelData();
 
         return window;
     }
 
-    template<typename T>
-    struct _VoxelValue {
-        bool GetBool() {
-            return (materialIndex & 0x00000001) == 1;
-        }
+    // Octant i of a voxel is offset from its minimum corner by OctantOffset(i) * half its width, see the diagram in CreateOctree
+    glm::ivec3 OctantOffset(int octant) {
+        return glm::ivec3{ octant & 1, (octant >> 2) & 1, (octant >> 1) & 1 };
+    }
 
-        void SetBool(bool newVal) {
-            if (newVal) {
-                materialIndex |= 1;
-            } else {
-                materialIndex &= 0xFFFFFFFE;
-            }
-        }
+    struct RegionSummary {
+        int voxelCount{ 0 };
+        std::array<int, 8> octantVoxelCounts{ };
 
-        int GetMaterialIndex() {
-            return materialIndex >> 1;
-        }
+        int mostCommonMaterial{ -1 };
+    };
 
-        void SetMaterialIndex(T newIndex) {
-            bool b = GetBool();
-            materialIndex = newIndex << 1;
-            SetBool(b);
-        }
+    // Counts the filled voxels in the cube of width n starting at origin, in total and per octant
+    RegionSummary SummarizeRegion(Grid& grid, glm::ivec3 origin, int n) {
+        RegionSummary summary{ };
+        std::unordered_map<int, int> materialCounts{ };
 
-    private:
-        T materialIndex{ 0 };
-    };
+        const int hN = std::max(n / 2, 1);
 
-    using VoxelValue = _VoxelValue<uint8_t>;
+        for (int x = 0; x < n; ++x) {
+            for (int y = 0; y < n; ++y) {
+                for (int z = 0; z < n; ++z) {
+                    const VoxelValue value = grid.Get(origin.x + x, origin.y + y, origin.z + z);
 
-    struct Grid {
-        Grid(int n)
-            : n{ n } {
+                    if (!value.IsFilled()) continue;
 
-            grid.resize(n * n * n);
-        }
+                    ++summary.voxelCount;
+                    ++materialCounts[value.GetMaterialIndex()];
 
-        VoxelValue& Get(int x, int y, int z) {
-            return grid[x * n * n + y * n + z];
+                    const int octant = (x >= hN ? 1 : 0) | (z >= hN ? 2 : 0) | (y >= hN ? 4 : 0);
+                    ++summary.octantVoxelCounts[octant];
+                }
+            }
         }
 
-        void Set(int x, int y, int z, VoxelValue val) {
-            grid[x * n * n + y * n + z] = val;
+        // The most common material stands in for the whole subtree when the traversal stops at this voxel
+        int mostCommonCount = 0;
+        for (const auto& [material, count] : materialCounts) {
+            if (count > mostCommonCount) {
+                mostCommonCount = count;
+                summary.mostCommonMaterial = material;
+            }
         }
 
-    private:
-        int n;
-
-        std::vector<VoxelValue> grid{ };
-    };
-
-    void Voxelify(int n, Grid& grid, std::vector<VoxelRayTracing::Voxel>& voxels, glm::vec3 minBound, glm::vec3 maxBound, int currentVoxelIndex = -1, bool first = true) {
-        if (first) {
-            // Set up the root
-            voxels.push_back(VoxelRayTracing::Voxel{ });
-
-            Voxelify(n, grid, voxels, minBound, maxBound, 0, false);
-
-            return;
-        }
+        return summary;
+    }
 
-        int voxelsFound = 0;
+    // Fills in voxels[currentVoxelIndex] from the cube of width n starting at origin in the grid, any children are appended to voxels.
+    // If bricks is not nullptr partially filled voxels of width VoxelBrick::size are stored as a brick instead of having children,
+    // with the materials of the brick appended to brickAttributes. voxelCounts is kept parallel to voxels, see VoxelRayTracing::m_VoxelCounts.
+    void Voxelify(Grid& grid, glm::ivec3 origin, int n, std::vector<VoxelRayTracing::Voxel>& voxels, std::vector<int>& voxelCounts, std::vector<VoxelBrick>* bricks, std::vector<uint32_t>* brickAttributes, glm::vec3 minBound, glm::vec3 maxBound, int currentVoxelIndex) {
+        const RegionSummary summary = SummarizeRegion(grid, origin, n);
 
-        for (int x = 0; x < n; ++x) {
-            for (int y = 0; y < n; ++y) {
-                for (int z = 0; z < n; ++z) {
-                    if (grid.Get(x, y, z).GetBool()) {
-                        ++voxelsFound;
-                    }
-                }
-            }
-        }
+        voxelCounts[currentVoxelIndex] = summary.voxelCount;
 
         VoxelRayTracing::Voxel& currentVoxel = voxels[currentVoxelIndex];
+        currentVoxel = VoxelRayTracing::Voxel{ };
         currentVoxel.minBound = minBound;
         currentVoxel.maxBound = maxBound;
+        currentVoxel.averageMaterial = summary.mostCommonMaterial;
 
-        if (n * n * n == voxelsFound || (n == 1 && grid.Get(0, 0, 0).GetBool())) {
+        if (summary.voxelCount == n * n * n) {
             currentVoxel.hasKids = false;
             currentVoxel.shouldDraw = true;
 
-            currentVoxel.k0 = grid.Get(0, 0, 0).GetMaterialIndex();
-        }
-        else {
-            if (voxelsFound != 0) {
-                currentVoxel.hasKids = true;
-                currentVoxel.shouldDraw = false;
-
-                int firstOfNextVoxelsIndex = voxels.size();
-
-                // Define children
-                std::array<int, 8> voxelCountInChildren{ };
-                std::vector<Grid> childrenGrids{ };
-                std::array<AABB, 8> childrenBounds{ };
-
-                int hN = n / 2;
-                float kidWidth = (maxBound.x - minBound.x) / 2.0f;
-
-                for (int i = 0; i < 8; ++i) {
-                    childrenGrids.push_back(Grid{ n / 2 });
-                    Grid g{ n / 2 };
+            currentVoxel.k0 = grid.Get(origin.x, origin.y, origin.z).GetMaterialIndex();
 
-                    glm::vec3 minB{ };
-                    glm::vec3 maxB{ };
-
-                    glm::ivec3 sourceOffset{ };
-
-                    switch (i) {
-                    case 0:
-                        minB = minBound;
-                        maxB = minB + kidWidth;
-
-                        sourceOffset = glm::vec3{ 0 };
-
-                        break;
-
-                    case 1:
-                        minB = minBound + glm::vec3{ kidWidth, 0.0f, 0.0f };
-                        maxB = minB + kidWidth;
-
-                        sourceOffset = glm::vec3{ hN, 0, 0 };
-
-                        break;
-                    case 2:
-                        minB = minBound + glm::vec3{ 0.0f, 0.0f, kidWidth };
-                        maxB = minB + kidWidth;
-
-                        sourceOffset = glm::vec3{ 0, 0, hN };
-
-                        break;
-                    case 3:
-                        minB = minBound + glm::vec3{ kidWidth, 0.0f, kidWidth };
-                        maxB = minB + kidWidth;
+            return;
+        }
 
-                        sourceOffset = glm::vec3{ hN, 0, hN };
+        if (summary.voxelCount == 0) {
+            currentVoxel.hasKids = false;
+            currentVoxel.shouldDraw = false;
 
-                        break;
-                    case 4:
-                        minB = minBound + glm::vec3{ 0.0f, kidWidth, 0.0f };
-                        maxB = minB + kidWidth;
+            return;
+        }
 
-                        sourceOffset = glm::vec3{ 0, hN, 0 };
+        if (bricks != nullptr && n == VoxelBrick::size) {
+            currentVoxel.hasKids = false;
+            currentVoxel.shouldDraw = false;
 
-                        break;
-                    case 5:
-                        minB = minBound + glm::vec3{ kidWidth, kidWidth, 0.0f };
-                        maxB = minB + kidWidth;
+            std::array<int, VoxelBrick::cellCount> cellMaterials{ };
+            for (int x = 0; x < n; ++x) {
+                for (int y = 0; y < n; ++y) {
+                    for (int z = 0; z < n; ++z) {
+                        cellMaterials[VoxelBrick::CellIndex(x, y, z)] = grid.Get(origin.x + x, origin.y + y, origin.z + z).GetMaterialIndex();
+                    }
+                }
+            }
 
-                        sourceOffset = glm::vec3{ hN, hN, 0 };
+            currentVoxel.brick = (int)bricks->size();
+            bricks->push_back(VoxelBrick::Create(cellMaterials, *brickAttributes));
 
-                        break;
-                    case 6:
-                        minB = minBound + glm::vec3{ 0.0f, kidWidth, kidWidth };
-                        maxB = minB + kidWidth;
+            return;
+        }
 
-                        sourceOffset = glm::vec3{ 0, hN, hN };
+        currentVoxel.hasKids = true;
+        currentVoxel.shouldDraw = false;
 
-                        break;
-                    case 7:
-                        minB = minBound + glm::vec3{ kidWidth, kidWidth, kidWidth };
-                        maxB = minB + kidWidth;
+        const int hN = n / 2;
+        const float kidWidth = (maxBound.x - minBound.x) / 2.0f;
 
-                        sourceOffset = glm::vec3{ hN, hN, hN };
+        const int firstOfNextVoxelsIndex = (int)voxels.size();
 
-                        break;
-                    }
+        // All voxels need to be added first in order to insure that they are contiguous in memory
+        int childMask = 0;
+        for (int i = 0; i < 8; ++i) {
+            if (summary.octantVoxelCounts[i] != 0) {
+                childMask |= 1 << i;
 
-                    int voxelCount = 0;
-                    for (int x = 0; x < hN; ++x) {
-                        for (int y = 0; y < hN; ++y) {
-                            for (int z = 0; z < hN; ++z) {
-                                g.Set(x, y, z, grid.Get(x + sourceOffset.x, y + sourceOffset.y, z + sourceOffset.z));
-                                if (g.Get(x,y,z).GetBool()) ++voxelCount;
-                            }
-                        }
-                    }
+                voxels.push_back(VoxelRayTracing::Voxel{ });
+                voxelCounts.push_back(0);
+            }
+        }
 
-                    voxelCountInChildren[i] = voxelCount;
-                    childrenGrids[i] = g;
-                    childrenBounds[i].min = minB;
-                    childrenBounds[i].max = maxB;
-                }
+        // Set the index of just the first octant
+        voxels[currentVoxelIndex].k0 = firstOfNextVoxelsIndex;
+        voxels[currentVoxelIndex].childMask = childMask;
 
-                // All voxels need to be added first in order to insure that they are contiguous in memory
-                for (int i = 0; i < 8; ++i) {
-                    if (voxelCountInChildren[i] != 0) {
-                        voxels.push_back(VoxelRayTracing::Voxel{ });
-                    }
-                }
+        int childrenAdded = 0;
+        for (int i = 0; i < 8; ++i) {
+            if (summary.octantVoxelCounts[i] == 0) continue;
 
-                // Set the index of just the first octant
-                voxels[currentVoxelIndex].k0 = firstOfNextVoxelsIndex;
-
-                int childrenAdded = 0;
-                for (int i = 0; i < 8; ++i) {
-                    if (voxelCountInChildren[i] == 0) continue;
-
-                    // Enable the correct bit in the child mask
-                    switch (i) {
-                        case 0: voxels[currentVoxelIndex].childMask |= 1  ; break;
-                        case 1: voxels[currentVoxelIndex].childMask |= 2  ; break;
-                        case 2: voxels[currentVoxelIndex].childMask |= 4  ; break;
-                        case 3: voxels[currentVoxelIndex].childMask |= 8  ; break;
-                        case 4: voxels[currentVoxelIndex].childMask |= 16 ; break;
-                        case 5: voxels[currentVoxelIndex].childMask |= 32 ; break;
-                        case 6: voxels[currentVoxelIndex].childMask |= 64 ; break;
-                        case 7: voxels[currentVoxelIndex].childMask |= 128; break;
-                    }
+            const glm::ivec3 offset = OctantOffset(i);
+            const glm::vec3 childMin = minBound + glm::vec3{ offset } * kidWidth;
 
-                    Voxelify(n / 2, childrenGrids[i], voxels, childrenBounds[i].min, childrenBounds[i].max, firstOfNextVoxelsIndex + childrenAdded, false);
+            Voxelify(grid, origin + offset * hN, hN, voxels, voxelCounts, bricks, brickAttributes, childMin, childMin + kidWidth, firstOfNextVoxelsIndex + childrenAdded);
 
-                    ++childrenAdded;
-                }
-            }
-            else {
-                currentVoxel.hasKids = false;
-                currentVoxel.shouldDraw = false;
-            }
+            ++childrenAdded;
         }
     }
 
@@ -343,7 +304,7 @@ namespace Rutile {
 
     // General design taken from:
     // https://www.mathworks.com/matlabcentral/fileexchange/21057-3d-bresenham-s-line-generation
-    void VoxelifiyLine(int n, Grid& grid, glm::ivec3 min, glm::ivec3 max, MaterialIndex matIndex) {
+    void VoxelifiyLine(int n, Grid& grid, glm::ivec3 min, glm::ivec3 max, MaterialIndex matIndex, std::vector<size_t>& cells) {
         int x0 = min.x;
         int y0 = min.y;
         int z0 = min.z;
@@ -369,8 +330,8 @@ namespace Rutile {
                 if (x0 >= n || y0 >= n || z0 >= n) break;
                 if (x0 < 0 || y0 < 0 || z0 < 0) break;
 
-                grid.Get(x0, y0, z0).SetBool(true);
-                grid.Get(x0, y0, z0).SetMaterialIndex(matIndex);
+                grid.Set(x0, y0, z0, VoxelValue{ (int)matIndex });
+                cells.push_back(grid.Index(x0, y0, z0));
 
                 if (ey >= 0) {
                     y0 += sy;
@@ -397,8 +358,8 @@ namespace Rutile {
                 if (x0 >= n || y0 >= n || z0 >= n) break;
                 if (x0 < 0 || y0 < 0 || z0 < 0) break;
 
-                grid.Get(x0, y0, z0).SetBool(true);
-                grid.Get(x0, y0, z0).SetMaterialIndex(matIndex);
+                grid.Set(x0, y0, z0, VoxelValue{ (int)matIndex });
+                cells.push_back(grid.Index(x0, y0, z0));
 
                 if (ex >= 0) {
                     x0 += sx;
@@ -425,8 +386,8 @@ namespace Rutile {
                 if (x0 >= n || y0 >= n || z0 >= n) break;
                 if (x0 < 0 || y0 < 0 || z0 < 0) break;
 
-                grid.Get(x0, y0, z0).SetBool(true);
-                grid.Get(x0, y0, z0).SetMaterialIndex(matIndex);
+                grid.Set(x0, y0, z0, VoxelValue{ (int)matIndex });
+                cells.push_back(grid.Index(x0, y0, z0));
 
                 if (ex >= 0) {
                     x0 += sx;
@@ -445,7 +406,7 @@ namespace Rutile {
         }
     }
 
-    void VoxelifiyTriangle(int n, Grid& grid, glm::ivec3 p0, glm::ivec3 p1, glm::ivec3 p2, MaterialIndex matIndex) {
+    void VoxelifiyTriangle(int n, Grid& grid, glm::ivec3 p0, glm::ivec3 p1, glm::ivec3 p2, MaterialIndex matIndex, std::vector<size_t>& cells) {
         int x0 = p0.x;
         int y0 = p0.y;
         int z0 = p0.z;
@@ -470,7 +431,7 @@ namespace Rutile {
 
                 if (x0 >= n || y0 >= n || z0 >= n) break;
 
-                VoxelifiyLine(n, grid, glm::ivec3{ x0, y0, z0 }, p2, matIndex);
+                VoxelifiyLine(n, grid, glm::ivec3{ x0, y0, z0 }, p2, matIndex, cells);
 
                 if (ey >= 0) {
                     y0 += sy;
@@ -496,7 +457,7 @@ namespace Rutile {
 
                 if (x0 >= n || y0 >= n || z0 >= n) break;
 
-                VoxelifiyLine(n, grid, glm::ivec3{ x0, y0, z0 }, p2, matIndex);
+                VoxelifiyLine(n, grid, glm::ivec3{ x0, y0, z0 }, p2, matIndex, cells);
 
                 if (ex >= 0) {
                     x0 += sx;
@@ -522,7 +483,7 @@ namespace Rutile {
 
                 if (x0 >= n || y0 >= n || z0 >= n) break;
 
-                VoxelifiyLine(n, grid, glm::ivec3{ x0, y0, z0 }, p2, matIndex);
+                VoxelifiyLine(n, grid, glm::ivec3{ x0, y0, z0 }, p2, matIndex, cells);
 
                 if (ex >= 0) {
                     x0 += sx;
@@ -553,7 +514,7 @@ namespace Rutile {
          */
 
         AABB sceneBoundingBox{ glm::vec3{ -0.1f }, glm::vec3{ 0.1f } };
-        constexpr int n = 256;
+        const int n = VoxelResolution();
 
         for (auto obj : App::scene.objects) {
             sceneBoundingBox = AABBFactory::Construct(AABBFactory::Construct(obj), sceneBoundingBox);
@@ -575,66 +536,467 @@ namespace Rutile {
 
         float largestVal = distancesFromCenter.back();
 
-        glm::vec3 min{ -largestVal };
-        glm::vec3 max{ largestVal };
+        m_OctreeMin = glm::vec3{ -largestVal };
+        m_OctreeMax = glm::vec3{ largestVal };
 
-        Grid grid{ n };
-        
-        for (auto obj : App::scene.objects) {
-            auto geo = App::scene.geometryBank[obj.geometry];
-            auto transform = App::scene.transformBank[obj.transform];
-            for (size_t i = 0; i < geo.indices.size(); i += 3) {
-                glm::vec3 p0 = glm::vec3{ transform.matrix * glm::vec4{ geo.vertices[geo.indices[i + 0]].position, 1.0f } };
-                glm::vec3 p1 = glm::vec3{ transform.matrix * glm::vec4{ geo.vertices[geo.indices[i + 1]].position, 1.0f } };
-                glm::vec3 p2 = glm::vec3{ transform.matrix * glm::vec4{ geo.vertices[geo.indices[i + 2]].position, 1.0f } };
+        m_Grid = std::make_unique<Grid>(n);
 
-                // Here p1-3 are in world space, representing there real coords.
-                // They need to be translated into there voxel coords, ie what voxel do they each corospond to the center of.
-                p0 -= min;
-                p0 /= max.x - min.x;
-                p0 *= n;
+        m_VoxelizedObjects.clear();
+        m_VoxelizedObjects.resize(App::scene.objects.size());
 
-                p1 -= min;
-                p1 /= max.x - min.x;
-                p1 *= n;
+        for (ObjectIndex i = 0; i < App::scene.objects.size(); ++i) {
+            VoxelizeObject(i);
+        }
+
+        RebuildOctreeFromGrid();
+    }
 
-                p2 -= min;
-                p2 /= max.x - min.x;
-                p2 *= n;
+    bool VoxelRayTracing::VoxelizeObject(ObjectIndex objectIndex) {
+        const int n = m_Grid->Size();
 
-                int x0 = (int)std::round(p0.x);
-                int y0 = (int)std::round(p0.y);
-                int z0 = (int)std::round(p0.z);
+        const Object& obj = App::scene.objects[objectIndex];
+        const Geometry& geo = App::scene.geometryBank[obj.geometry];
+        const Transform& transform = App::scene.transformBank[obj.transform];
 
-                int x1 = (int)std::round(p1.x);
-                int y1 = (int)std::round(p1.y);
-                int z1 = (int)std::round(p1.z);
+        VoxelizedObject& voxelizedObject = m_VoxelizedObjects[objectIndex];
+        voxelizedObject.cells.clear();
 
-                int x2 = (int)std::round(p2.x);
-                int y2 = (int)std::round(p2.y);
-                int z2 = (int)std::round(p2.z);
+        bool insideGrid = true;
 
-                VoxelifiyTriangle(n, grid, glm::ivec3{ x0, y0, z0 }, glm::ivec3{ x1, y1, z1 }, glm::ivec3{ x2, y2, z2 }, obj.material);
-                VoxelifiyTriangle(n, grid, glm::ivec3{ x1, y1, z1 }, glm::ivec3{ x2, y2, z2 }, glm::ivec3{ x0, y0, z0 }, obj.material);
-                VoxelifiyTriangle(n, grid, glm::ivec3{ x2, y2, z2 }, glm::ivec3{ x0, y0, z0 }, glm::ivec3{ x1, y1, z1 }, obj.material);
+        for (size_t i = 0; i < geo.indices.size(); i += 3) {
+            glm::vec3 p0 = glm::vec3{ transform.matrix * glm::vec4{ geo.vertices[geo.indices[i + 0]].position, 1.0f } };
+            glm::vec3 p1 = glm::vec3{ transform.matrix * glm::vec4{ geo.vertices[geo.indices[i + 1]].position, 1.0f } };
+            glm::vec3 p2 = glm::vec3{ transform.matrix * glm::vec4{ geo.vertices[geo.indices[i + 2]].position, 1.0f } };
+
+            // Here p1-3 are in world space, representing there real coords.
+            // They need to be translated into there voxel coords, ie what voxel do they each corospond to the center of.
+            p0 -= m_OctreeMin;
+            p0 /= m_OctreeMax.x - m_OctreeMin.x;
+            p0 *= n;
+
+            p1 -= m_OctreeMin;
+            p1 /= m_OctreeMax.x - m_OctreeMin.x;
+            p1 *= n;
+
+            p2 -= m_OctreeMin;
+            p2 /= m_OctreeMax.x - m_OctreeMin.x;
+            p2 *= n;
+
+            int x0 = (int)std::round(p0.x);
+            int y0 = (int)std::round(p0.y);
+            int z0 = (int)std::round(p0.z);
+
+            int x1 = (int)std::round(p1.x);
+            int y1 = (int)std::round(p1.y);
+            int z1 = (int)std::round(p1.z);
+
+            int x2 = (int)std::round(p2.x);
+            int y2 = (int)std::round(p2.y);
+            int z2 = (int)std::round(p2.z);
+
+            const glm::ivec3 triangleMin = glm::min(glm::min(glm::ivec3{ x0, y0, z0 }, glm::ivec3{ x1, y1, z1 }), glm::ivec3{ x2, y2, z2 });
+            const glm::ivec3 triangleMax = glm::max(glm::max(glm::ivec3{ x0, y0, z0 }, glm::ivec3{ x1, y1, z1 }), glm::ivec3{ x2, y2, z2 });
+
+            if (glm::any(glm::lessThan(triangleMin, glm::ivec3{ 0 })) || glm::any(glm::greaterThanEqual(triangleMax, glm::ivec3{ n }))) {
+                insideGrid = false;
             }
+
+            VoxelifiyTriangle(n, *m_Grid, glm::ivec3{ x0, y0, z0 }, glm::ivec3{ x1, y1, z1 }, glm::ivec3{ x2, y2, z2 }, obj.material, voxelizedObject.cells);
+            VoxelifiyTriangle(n, *m_Grid, glm::ivec3{ x1, y1, z1 }, glm::ivec3{ x2, y2, z2 }, glm::ivec3{ x0, y0, z0 }, obj.material, voxelizedObject.cells);
+            VoxelifiyTriangle(n, *m_Grid, glm::ivec3{ x2, y2, z2 }, glm::ivec3{ x0, y0, z0 }, glm::ivec3{ x1, y1, z1 }, obj.material, voxelizedObject.cells);
+        }
+
+        std::ranges::sort(voxelizedObject.cells);
+        voxelizedObject.cells.erase(std::unique(voxelizedObject.cells.begin(), voxelizedObject.cells.end()), voxelizedObject.cells.end());
+
+        voxelizedObject.min = glm::ivec3{ std::numeric_limits<int>::max() };
+        voxelizedObject.max = glm::ivec3{ std::numeric_limits<int>::min() };
+
+        for (size_t cell : voxelizedObject.cells) {
+            const glm::ivec3 coordinate = m_Grid->Coordinate(cell);
+
+            voxelizedObject.min = glm::min(voxelizedObject.min, coordinate);
+            voxelizedObject.max = glm::max(voxelizedObject.max, coordinate);
         }
 
+        return insideGrid;
+    }
+
+    void VoxelRayTracing::RebuildOctreeFromGrid() {
         voxels.clear();
-        Voxelify(n, grid, voxels, min, max);
+        voxels.push_back(Voxel{ });
+
+        m_VoxelCounts.clear();
+        m_VoxelCounts.push_back(0);
+
+        bricks.clear();
+        brickAttributes.clear();
+
+        Voxelify(*m_Grid, glm::ivec3{ 0 }, m_Grid->Size(), voxels, m_VoxelCounts, m_UseBricks ? &bricks : nullptr, &brickAttributes, m_OctreeMin, m_OctreeMax, 0);
+
+        m_GarbageVoxelCount = 0;
+        m_GarbageBrickCount = 0;
+        m_GarbageBrickAttributeCount = 0;
 
         m_VoxelRayTracingShader->Bind();
 
         m_VoxelSSBO->SetData(voxels);
+        m_BrickSSBO->SetData(bricks);
+        m_BrickAttributeSSBO->SetData(brickAttributes);
 
         m_VoxelRayTracingShader->SetInt("octreeRootIndex", 0);
     }
 
+    void VoxelRayTracing::UpdateObjectVoxels(ObjectIndex objectIndex) {
+        if (!m_Grid || objectIndex >= m_VoxelizedObjects.size()) {
+            return;
+        }
+
+        // Remove the objects old voxels
+        const VoxelizedObject oldVoxels = m_VoxelizedObjects[objectIndex];
+
+        for (size_t cell : oldVoxels.cells) {
+            m_Grid->Set(cell, VoxelValue{ });
+        }
+
+        // Insert the new ones, if the object has left the octree it needs to be resized which means starting over
+        if (!VoxelizeObject(objectIndex)) {
+            CreateOctree();
+            return;
+        }
+
+        glm::ivec3 dirtyMin = glm::min(oldVoxels.min, m_VoxelizedObjects[objectIndex].min);
+        glm::ivec3 dirtyMax = glm::max(oldVoxels.max, m_VoxelizedObjects[objectIndex].max);
+
+        // Other objects may have shared some of the removed voxels, so any that overlap them are put back
+        for (ObjectIndex i = 0; i < m_VoxelizedObjects.size(); ++i) {
+            if (i == objectIndex) continue;
+
+            const VoxelizedObject& other = m_VoxelizedObjects[i];
+
+            if (glm::any(glm::greaterThan(other.min, oldVoxels.max)) || glm::any(glm::lessThan(other.max, oldVoxels.min))) continue;
+
+            VoxelizeObject(i);
+
+            dirtyMin = glm::min(dirtyMin, m_VoxelizedObjects[i].min);
+            dirtyMax = glm::max(dirtyMax, m_VoxelizedObjects[i].max);
+        }
+
+        if (glm::any(glm::greaterThan(dirtyMin, dirtyMax))) {
+            return;
+        }
+
+        const size_t firstAppendedVoxel = voxels.size();
+        const size_t firstAppendedBrick = bricks.size();
+        const size_t firstAppendedBrickAttribute = brickAttributes.size();
+        std::vector<size_t> modifiedVoxels{ };
+
+        RebuildOctreeRegion(0, glm::ivec3{ 0 }, m_Grid->Size(), dirtyMin, dirtyMax, modifiedVoxels);
+
+        // Replaced subtrees are left behind in the buffer, once they take up too much of it everything gets rebuilt
+        if (m_GarbageVoxelCount > voxels.size() / 2 || m_GarbageBrickCount > bricks.size() / 2 || m_GarbageBrickAttributeCount > brickAttributes.size() / 2) {
+            RebuildOctreeFromGrid();
+            return;
+        }
+
+        // Upload runs of modified voxels, followed by everything that was appended
+        std::ranges::sort(modifiedVoxels);
+
+        SSBOBatch::Begin();
+
+        size_t i = 0;
+        while (i < modifiedVoxels.size()) {
+            const size_t start = modifiedVoxels[i];
+            size_t end = start + 1;
+
+            while (i + 1 < modifiedVoxels.size() && modifiedVoxels[i + 1] <= end) {
+                end = std::max(end, modifiedVoxels[i + 1] + 1);
+                ++i;
+            }
+
+            m_VoxelSSBO->Update(start, { voxels.data() + start, end - start });
+
+            ++i;
+        }
+
+        if (voxels.size() > firstAppendedVoxel) {
+            m_VoxelSSBO->Update(firstAppendedVoxel, { voxels.data() + firstAppendedVoxel, voxels.size() - firstAppendedVoxel });
+        }
+
+        if (bricks.size() > firstAppendedBrick) {
+            m_BrickSSBO->Update(firstAppendedBrick, { bricks.data() + firstAppendedBrick, bricks.size() - firstAppendedBrick });
+        }
+
+        if (brickAttributes.size() > firstAppendedBrickAttribute) {
+            m_BrickAttributeSSBO->Update(firstAppendedBrickAttribute, { brickAttributes.data() + firstAppendedBrickAttribute, brickAttributes.size() - firstAppendedBrickAttribute });
+        }
+
+        SSBOBatch::End();
+    }
+
+    // Works from the leaves up, the grid is only read where it was edited and every voxel above that is combined from
+    // the counts stored for its children
+    void VoxelRayTracing::RebuildOctreeRegion(int voxelIndex, glm::ivec3 origin, int n, glm::ivec3 dirtyMin, glm::ivec3 dirtyMax, std::vector<size_t>& modifiedVoxels) {
+        const glm::ivec3 regionMax = origin + n - 1;
+
+        if (glm::any(glm::greaterThan(origin, dirtyMax)) || glm::any(glm::lessThan(regionMax, dirtyMin))) {
+            return;
+        }
+
+        // Below this the region is small enough to scan, and it is where bricks are made
+        const int leafSize = m_UseBricks ? VoxelBrick::size : 1;
+
+        if (n <= leafSize) {
+            RebuildSubtree(voxelIndex, origin, n, modifiedVoxels);
+            return;
+        }
+
+        const Voxel oldVoxel = voxels[voxelIndex];
+
+        const int hN = n / 2;
+        const float kidWidth = (oldVoxel.maxBound.x - oldVoxel.minBound.x) / 2.0f;
+
+        // A leaf is uniform, so every octant of it starts out as a leaf of the same kind
+        const bool wasFull = !oldVoxel.hasKids && oldVoxel.shouldDraw;
+
+        std::array<bool, 8> hadChild{ };
+        std::array<bool, 8> needsChild{ };
+        bool relayout = !oldVoxel.hasKids;
+
+        for (int i = 0; i < 8; ++i) {
+            hadChild[i] = oldVoxel.hasKids && (oldVoxel.childMask & (1 << i)) != 0;
+
+            if (hadChild[i] || wasFull) {
+                needsChild[i] = true;
+                continue;
+            }
+
+            // The octant was empty, only the edited cells can have filled it
+            const glm::ivec3 octantMin = origin + OctantOffset(i) * hN;
+            const glm::ivec3 octantMax = octantMin + hN - 1;
+
+            if (ContainsFilledCell(glm::max(octantMin, dirtyMin), glm::min(octantMax, dirtyMax))) {
+                needsChild[i] = true;
+                relayout = true;
+            }
+        }
+
+        int firstChild = oldVoxel.k0;
+
+        if (relayout) {
+            // Children have to be contiguous, so they all move to the end of voxels. Only their own records move, whatever
+            // is below them stays where it is.
+            firstChild = (int)voxels.size();
+
+            int oldChild = oldVoxel.k0;
+            for (int i = 0; i < 8; ++i) {
+                if (!needsChild[i]) continue;
+
+                if (hadChild[i]) {
+                    const Voxel child = voxels[oldChild];
+                    const int count = m_VoxelCounts[oldChild];
+
+                    voxels.push_back(child);
+                    m_VoxelCounts.push_back(count);
+
+                    ++m_GarbageVoxelCount;
+                    ++oldChild;
+
+                    continue;
+                }
+
+                const glm::ivec3 childOrigin = origin + OctantOffset(i) * hN;
+
+                Voxel child{ };
+                child.minBound = oldVoxel.minBound + glm::vec3{ OctantOffset(i) } * kidWidth;
+                child.maxBound = child.minBound + kidWidth;
+                child.hasKids = false;
+                child.shouldDraw = wasFull;
+
+                if (wasFull) {
+                    child.k0 = m_Grid->Get(childOrigin.x, childOrigin.y, childOrigin.z).GetMaterialIndex();
+                    child.averageMaterial = oldVoxel.averageMaterial;
+                }
+
+                voxels.push_back(child);
+                m_VoxelCounts.push_back(wasFull ? hN * hN * hN : 0);
+            }
+        }
+
+        int child = firstChild;
+        for (int i = 0; i < 8; ++i) {
+            if (!needsChild[i]) continue;
+
+            RebuildOctreeRegion(child, origin + OctantOffset(i) * hN, hN, dirtyMin, dirtyMax, modifiedVoxels);
+
+            ++child;
+        }
+
+        // Children that ended up empty are dropped, and the rest move down to stay contiguous
+        int childMask = 0;
+        int childCount = 0;
+        int voxelCount = 0;
+
+        child = firstChild;
+        for (int i = 0; i < 8; ++i) {
+            if (!needsChild[i]) continue;
+
+            const int count = m_VoxelCounts[child];
+
+            if (count == 0) {
+                ++m_GarbageVoxelCount;
+            } else {
+                const int slot = firstChild + childCount;
+
+                if (slot != child) {
+                    voxels[slot] = voxels[child];
+                    m_VoxelCounts[slot] = count;
+
+                    modifiedVoxels.push_back((size_t)slot);
+                }
+
+                childMask |= 1 << i;
+                ++childCount;
+                voxelCount += count;
+            }
+
+            ++child;
+        }
+
+        Voxel& voxel = voxels[voxelIndex];
+        voxel.hasKids = true;
+        voxel.shouldDraw = false;
+        voxel.k0 = firstChild;
+        voxel.childMask = childMask;
+        voxel.averageMaterial = MostCommonChildMaterial(firstChild, childCount);
+        voxel.brick = -1;
+
+        m_VoxelCounts[voxelIndex] = voxelCount;
+        modifiedVoxels.push_back((size_t)voxelIndex);
+
+        // Uniform regions are leaves, the same as in Voxelify
+        if (voxelCount == 0 || voxelCount == n * n * n) {
+            MarkSubtreeAsGarbage(voxelIndex);
+
+            Voxel leaf{ };
+            leaf.minBound = oldVoxel.minBound;
+            leaf.maxBound = oldVoxel.maxBound;
+            leaf.hasKids = false;
+            leaf.shouldDraw = voxelCount != 0;
+
+            if (leaf.shouldDraw) {
+                leaf.k0 = m_Grid->Get(origin.x, origin.y, origin.z).GetMaterialIndex();
+                leaf.averageMaterial = voxels[voxelIndex].averageMaterial;
+            }
+
+            voxels[voxelIndex] = leaf;
+        }
+    }
+
+    void VoxelRayTracing::RebuildSubtree(int voxelIndex, glm::ivec3 origin, int n, std::vector<size_t>& modifiedVoxels) {
+        const Voxel oldVoxel = voxels[voxelIndex];
+
+        // The voxel keeps its place in its parent but its children are moved to the end of voxels
+        MarkSubtreeAsGarbage(voxelIndex);
+
+        std::vector<Voxel> subtree{ Voxel{ } };
+        std::vector<int> subtreeCounts{ 0 };
+        Voxelify(*m_Grid, origin, n, subtree, subtreeCounts, m_UseBricks ? &bricks : nullptr, &brickAttributes, oldVoxel.minBound, oldVoxel.maxBound, 0);
+
+        // subtree[k] ends up at voxels[offset + k]
+        const int offset = (int)voxels.size() - 1;
+        for (auto& voxel : subtree) {
+            if (voxel.hasKids) {
+                voxel.k0 += offset;
+            }
+        }
+
+        voxels[voxelIndex] = subtree[0];
+        m_VoxelCounts[voxelIndex] = subtreeCounts[0];
+        modifiedVoxels.push_back((size_t)voxelIndex);
+
+        voxels.insert(voxels.end(), subtree.begin() + 1, subtree.end());
+        m_VoxelCounts.insert(m_VoxelCounts.end(), subtreeCounts.begin() + 1, subtreeCounts.end());
+    }
+
+    bool VoxelRayTracing::ContainsFilledCell(glm::ivec3 min, glm::ivec3 max) const {
+        for (int x = min.x; x <= max.x; ++x) {
+            for (int y = min.y; y <= max.y; ++y) {
+                for (int z = min.z; z <= max.z; ++z) {
+                    if (m_Grid->Get(x, y, z).IsFilled()) {
+                        return true;
+                    }
+                }
+            }
+        }
+
+        return false;
+    }
+
+    // Every child votes for its own most common material with the number of cells below it, which is close to the
+    // exact count Voxelify takes from the grid without having to read it again
+    int VoxelRayTracing::MostCommonChildMaterial(int firstChild, int childCount) const {
+        std::array<int, 8> materials{ };
+        std::array<int, 8> counts{ };
+        int materialCount = 0;
+
+        for (int child = firstChild; child < firstChild + childCount; ++child) {
+            const int material = voxels[child].averageMaterial;
+
+            int i = 0;
+            while (i < materialCount && materials[i] != material) {
+                ++i;
+            }
+
+            if (i == materialCount) {
+                materials[i] = material;
+                ++materialCount;
+            }
+
+            counts[i] += m_VoxelCounts[child];
+        }
+
+        int mostCommonMaterial = -1;
+        int mostCommonCount = 0;
+        for (int i = 0; i < materialCount; ++i) {
+            if (counts[i] > mostCommonCount) {
+                mostCommonCount = counts[i];
+                mostCommonMaterial = materials[i];
+            }
+        }
+
+        return mostCommonMaterial;
+    }
+
+    void VoxelRayTracing::MarkSubtreeAsGarbage(int voxelIndex) {
+        const Voxel voxel = voxels[voxelIndex];
+
+        if (voxel.brick != -1) {
+            ++m_GarbageBrickCount;
+            m_GarbageBrickAttributeCount += bricks[voxel.brick].AttributeWordCount();
+        }
+
+        if (!voxel.hasKids) {
+            return;
+        }
+
+        for (int i = 0; i < std::popcount((unsigned int)voxel.childMask); ++i) {
+            ++m_GarbageVoxelCount;
+            MarkSubtreeAsGarbage(voxel.k0 + i);
+        }
+    }
+
     void VoxelRayTracing::Cleanup(GLFWwindow* window) {
         m_VoxelRayTracingShader.reset();
         m_RenderingShader.reset();
 
         m_VoxelSSBO.reset();
+        m_BrickSSBO.reset();
+        m_BrickAttributeSSBO.reset();
+
+        m_Grid.reset();
+
+        m_ActivePixelCounter.reset();
 
         glfwDestroyWindow(window);
     }
@@ -648,6 +1010,23 @@ namespace Rutile {
 
             glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_AccumulationTexture, 0);
 
+            glBindTexture(GL_TEXTURE_2D, m_MomentTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_MomentTexture, 0);
+
+            glBindTexture(GL_TEXTURE_2D, m_PrimaryHitDistanceTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_PrimaryHitDistanceTexture, 0);
+
+            glBindTexture(GL_TEXTURE_2D, m_HistoryAccumulationTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+
+            glBindTexture(GL_TEXTURE_2D, m_HistoryMomentTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+
+            glBindTexture(GL_TEXTURE_2D, m_HistoryPrimaryHitDistanceTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, App::screenWidth, App::screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+
             glBindRenderbuffer(GL_RENDERBUFFER, m_AccumulationRBO);
 
             glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, App::screenWidth, App::screenHeight);
@@ -655,19 +1034,85 @@ namespace Rutile {
 
             ResetAccumulatedPixelData();
         }
-        if (EVENT_IS(event, CameraUpdate) ||
-            EVENT_IS(event, ObjectTransformUpdate) ||
+        if (EVENT_IS(event, ObjectTransformUpdate)) {
+            UpdateObjectVoxels(dynamic_cast<ObjectTransformUpdate*>(event)->index);
+        }
+        if (EVENT_IS(event, CameraUpdate)) {
+            ViewChanged();
+        }
+        if (EVENT_IS(event, ObjectTransformUpdate) ||
             EVENT_IS(event, ObjectMaterialUpdate)) {
 
             ResetAccumulatedPixelData();
         }
         if (EVENT_IS(event, ObjectMaterialUpdate)) {
-            CreateAndUploadMaterialBuffer();
+            UploadMaterial(App::scene.objects[dynamic_cast<ObjectMaterialUpdate*>(event)->index].material);
         }
     }
     void VoxelRayTracing::Render() {
-        m_VoxelRayTracingShader->Bind();
+        if (m_FrameCount == 0) {
+            if (GLCapabilities::ClearTexture()) {
+                // A null clear value is zero, the storage is kept
+                glClearTexImage(m_AccumulationTexture, 0, GL_RGBA, GL_FLOAT, nullptr);
+                glClearTexImage(m_MomentTexture, 0, GL_RED, GL_FLOAT, nullptr);
+                glClearTexImage(m_PrimaryHitDistanceTexture, 0, GL_RED, GL_FLOAT, nullptr);
+            } else {
+                // Zeros are uploaded instead, a buffer big enough for the RGBA texture covers the single channel ones
+                const std::vector<glm::vec4> zeros((size_t)App::screenWidth * (size_t)App::screenHeight, glm::vec4{ 0.0f });
+
+                glBindTexture(GL_TEXTURE_2D, m_AccumulationTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, App::screenWidth, App::screenHeight, GL_RGBA, GL_FLOAT, zeros.data());
+
+                glBindTexture(GL_TEXTURE_2D, m_MomentTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, App::screenWidth, App::screenHeight, GL_RED, GL_FLOAT, zeros.data());
+
+                glBindTexture(GL_TEXTURE_2D, m_PrimaryHitDistanceTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, App::screenWidth, App::screenHeight, GL_RED, GL_FLOAT, zeros.data());
+            }
+
+            // Nothing has been accumulated that could be reprojected
+            m_ViewChanged = false;
+        }
+
+        // Once every pixel has converged only the resolve is left
+        if (!m_Converged) {
+            m_ActivePixelCounter->Begin(activePixelBinding);
+
+            if (m_ViewChanged) {
+                CopyAccumulationToHistory();
+            }
+
+            TraceFrame();
+
+            m_ActivePixelCounter->End();
+
+            m_ViewChanged = false;
+
+            const glm::mat4 cameraProjection = glm::perspective(glm::radians(App::settings.fieldOfView), (float)App::screenWidth / (float)App::screenHeight, App::settings.nearPlane, App::settings.farPlane);
+            m_PreviousViewProjection = cameraProjection * App::camera.View();
+            m_PreviousCameraPosition = App::camera.position;
+
+            m_Converged = m_AdaptiveSampling && m_ActivePixelCounter->Value() == 0u;
+        }
+
+        // Read from accumulation framebuffer, divide by sample count, and render to default framebuffer
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, App::screenWidth, App::screenHeight);
+
+        glClearColor(App::settings.backgroundColor.b, App::settings.backgroundColor.g, App::settings.backgroundColor.b, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
 
+        m_RenderingShader->Bind();
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_AccumulationTexture);
+        m_RenderingShader->SetInt("accumulationBuffer", 0);
+
+        glBindVertexArray(m_VAO);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+    }
+
+    void VoxelRayTracing::TraceFrame() {
         ++m_FrameCount;
 
         // Render into accumulation framebuffer
@@ -691,27 +1136,42 @@ namespace Rutile {
 
         m_VoxelRayTracingShader->SetInt("maxBounces", App::settings.maxBounces);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_AccumulationTexture);
-        m_VoxelRayTracingShader->SetInt("accumulationBuffer", 0);
-
-        glBindVertexArray(m_VAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+        // A voxel further than (width / lodVoxelSizeThreshold) from the ray origin covers less than m_LODPixelSize pixels
+        const float pixelSpread = 2.0f * std::tan(glm::radians(App::settings.fieldOfView) / 2.0f) / (float)App::screenHeight;
 
-        // Read from accumulation framebuffer, divide by frame count, and render to default framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, App::screenWidth, App::screenHeight);
+        m_VoxelRayTracingShader->SetBool("lodEnabled", m_LODEnabled);
+        m_VoxelRayTracingShader->SetFloat("lodVoxelSizeThreshold", m_LODPixelSize * pixelSpread);
 
-        glClearColor(App::settings.backgroundColor.b, App::settings.backgroundColor.g, App::settings.backgroundColor.b, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+        m_VoxelRayTracingShader->SetBool("adaptiveSampling", m_AdaptiveSampling);
+        m_VoxelRayTracingShader->SetInt("minimumSamples", m_MinimumSamples);
+        m_VoxelRayTracingShader->SetInt("maximumSamples", m_MaximumSamples);
+        m_VoxelRayTracingShader->SetFloat("convergenceThreshold", m_ConvergenceThreshold);
 
-        m_RenderingShader->Bind();
+        m_VoxelRayTracingShader->SetBool("reproject", m_ViewChanged);
+        m_VoxelRayTracingShader->SetMat4("previousViewProjection", m_PreviousViewProjection);
+        m_VoxelRayTracingShader->SetVec3("previousCameraPosition", m_PreviousCameraPosition);
+        m_VoxelRayTracingShader->SetInt("historyLength", m_HistoryLength);
+        m_VoxelRayTracingShader->SetFloat("depthTolerance", m_DepthTolerance);
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, m_AccumulationTexture);
-        m_RenderingShader->SetInt("accumulationBuffer", 0);
+        m_VoxelRayTracingShader->SetInt("accumulationBuffer", 0);
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_MomentTexture);
+        m_VoxelRayTracingShader->SetInt("momentBuffer", 1);
 
-        m_RenderingShader->SetInt("frameCount", (int)m_FrameCount);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, m_HistoryAccumulationTexture);
+        m_VoxelRayTracingShader->SetInt("historyAccumulationBuffer", 2);
+
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, m_HistoryMomentTexture);
+        m_VoxelRayTracingShader->SetInt("historyMomentBuffer", 3);
+
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, m_HistoryPrimaryHitDistanceTexture);
+        m_VoxelRayTracingShader->SetInt("historyPrimaryHitDistanceBuffer", 4);
 
         glBindVertexArray(m_VAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
@@ -726,6 +1186,54 @@ namespace Rutile {
     }
 
     void VoxelRayTracing::ProvideLocalRendererSettings() {
+        RadioButtons("Voxel Resolution", std::vector<std::string>{
+                "32##voxelResolution",
+                "64##voxelResolution",
+                "128##voxelResolution",
+                "256##voxelResolution",
+                "512##voxelResolution",
+                "1024##voxelResolution"
+            },
+            &m_VoxelResolutionOption,
+            [this] {
+                CreateOctree();
+                ResetAccumulatedPixelData();
+            }
+        );
+
+        if (ImGui::Checkbox("Brick Map", &m_UseBricks)) {
+            CreateOctree();
+            ResetAccumulatedPixelData();
+        }
+
+        ImGui::Separator();
+
+        if (ImGui::Checkbox("Level of Detail", &m_LODEnabled)) {
+            ResetAccumulatedPixelData();
+        }
+
+        if (m_LODEnabled) {
+            if (ImGui::DragFloat("LOD Pixel Size", &m_LODPixelSize, 0.01f, 0.0f, 64.0f)) {
+                ResetAccumulatedPixelData();
+            }
+        }
+
+        ImGui::Separator();
+
+        ImGui::Text("CPU Traversal Benchmark");
+        ImGui::DragInt("Benchmark Width", &m_TraversalBenchmarkWidth, 1.0f, 1, 3840);
+        ImGui::DragInt("Benchmark Height", &m_TraversalBenchmarkHeight, 1.0f, 1, 2160);
+
+        if (ImGui::Button("Run Traversal Benchmark")) {
+            RunTraversalBenchmark();
+        }
+
+        if (!m_TraversalBenchmarkReport.empty()) {
+            ImGui::TextUnformatted(m_TraversalBenchmarkReport.c_str());
+        }
+
+        ImGui::Separator();
+
         static int maxBboxChecks = 100;
         static int maxSphereChecks = 100;
         static int maxTriangleChecks = 100;
@@ -781,6 +1289,38 @@ namespace Rutile {
             break;
         }
 
+        ImGui::Checkbox("Temporal Reprojection", &m_TemporalReprojection);
+
+        if (m_TemporalReprojection) {
+            // Only used when the view changes, so there is nothing to reset
+            ImGui::DragInt("History Length", &m_HistoryLength, 1.0f, 1, 1 << 20);
+            ImGui::DragFloat("Depth Tolerance", &m_DepthTolerance, 0.001f, 0.001f, 1.0f);
+        }
+
+        if (ImGui::Checkbox("Adaptive Sampling", &m_AdaptiveSampling)) {
+            ResumeSampling();
+        }
+
+        if (m_AdaptiveSampling) {
+            // Nothing accumulated is invalidated by these, pixels are only ever held back
+            if (ImGui::DragFloat("Convergence Threshold", &m_ConvergenceThreshold, 0.0005f, 0.001f, 0.5f)) {
+                ResumeSampling();
+            }
+            if (ImGui::DragInt("Minimum Samples", &m_MinimumSamples, 0.1f, 1, m_MaximumSamples)) {
+                ResumeSampling();
+            }
+            if (ImGui::DragInt("Maximum Samples", &m_MaximumSamples, 1.0f, m_MinimumSamples, 1 << 20)) {
+                ResumeSampling();
+            }
+
+            if (m_Converged) {
+                ImGui::Text("Converged");
+            } else if (const std::optional<uint32_t> activePixels = m_ActivePixelCounter->Value()) {
+                const double activePercentage = 100.0 * (double)*activePixels / ((double)App::screenWidth * (double)App::screenHeight);
+                ImGui::Text(("Active Pixels: " + std::to_string(*activePixels) + " (" + std::to_string(activePercentage) + "%)").c_str());
+            }
+        }
+
         m_VoxelRayTracingShader->Bind();
         m_VoxelRayTracingShader->SetInt("maxBboxChecks", bbox);
         m_VoxelRayTracingShader->SetInt("maxSphereChecks", sphere);
@@ -789,38 +1329,90 @@ namespace Rutile {
     }
 
     void VoxelRayTracing::ProjectionMatrixUpdate() {
-        ResetAccumulatedPixelData();
+        ViewChanged();
+    }
+
+    void VoxelRayTracing::RunTraversalBenchmark() {
+        const glm::mat4 cameraProjection = glm::perspective(glm::radians(App::settings.fieldOfView), (float)m_TraversalBenchmarkWidth / (float)m_TraversalBenchmarkHeight, App::settings.nearPlane, App::settings.farPlane);
+        const glm::mat4 inverseProjection = glm::inverse(cameraProjection);
+
+        const glm::mat4 inverseView = glm::inverse(App::camera.View());
+
+        const std::vector<OctreeTraversal::BenchmarkResult> results = OctreeTraversal::Benchmark(voxels, bricks, brickAttributes, 0, inverseView, inverseProjection, App::camera.position, m_TraversalBenchmarkWidth, m_TraversalBenchmarkHeight);
+
+        std::stringstream report{ };
+        for (const auto& result : results) {
+            report << result.name << ":\n";
+            report << "    Rays: " << result.primaryRays << " primary, " << result.secondaryRays << " secondary, " << result.hits << " hits\n";
+            report << "    Time: " << result.seconds * 1000.0 << "ms, " << result.RaysPerSecond() / 1000000.0 << " MRays/s\n";
+            report << "    Nodes visited per ray: " << result.NodesVisitedPerRay() << "\n";
+            report << "    Box checks per ray: " << (double)result.stats.boxChecks / (double)std::max<size_t>(result.primaryRays + result.secondaryRays, 1) << "\n";
+
+            if (&result != &results.front()) {
+                report << "    Results differing from " << results.front().name << ": " << result.mismatches << "\n";
+            }
+        }
+
+        m_TraversalBenchmarkReport = report.str();
+    }
+
+    int VoxelRayTracing::VoxelResolution() const {
+        return 32 << m_VoxelResolutionOption;
     }
 
     void VoxelRayTracing::ResetAccumulatedPixelData() {
+        // The textures are cleared by the next Render, however many resets happen before it
         m_FrameCount = 0;
 
-        glBindFramebuffer(GL_FRAMEBUFFER, m_AccumulationFrameBuffer);
-        glBindTexture(GL_TEXTURE_2D, m_AccumulationTexture);
+        ResumeSampling();
+    }
+
+    void VoxelRayTracing::ResumeSampling() {
+        m_Converged = false;
+
+        // Counts from before may have been of pixels that are no longer converged
+        m_ActivePixelCounter->Reset();
+    }
 
-        std::vector<glm::vec4> clearData{ };
-        clearData.resize((size_t)App::screenWidth * (size_t)App::screenHeight);
-        for (auto& val : clearData) {
-            val = glm::vec4{ 0.0f };
+    void VoxelRayTracing::ViewChanged() {
+        if (!m_TemporalReprojection) {
+            ResetAccumulatedPixelData();
+            return;
         }
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, App::screenWidth, App::screenHeight, 0, GL_RGBA, GL_FLOAT, clearData.data());
+        // Pixels may now see surfaces that were never sampled, or fewer samples than they had before
+        m_ViewChanged = true;
+        ResumeSampling();
     }
 
-    void VoxelRayTracing::CreateAndUploadMaterialBuffer() {
-        m_VoxelRayTracingShader->Bind();
+    void VoxelRayTracing::CopyAccumulationToHistory() {
+        glCopyImageSubData(m_AccumulationTexture, GL_TEXTURE_2D, 0, 0, 0, 0, m_HistoryAccumulationTexture, GL_TEXTURE_2D, 0, 0, 0, 0, App::screenWidth, App::screenHeight, 1);
+        glCopyImageSubData(m_MomentTexture, GL_TEXTURE_2D, 0, 0, 0, 0, m_HistoryMomentTexture, GL_TEXTURE_2D, 0, 0, 0, 0, App::screenWidth, App::screenHeight, 1);
+        glCopyImageSubData(m_PrimaryHitDistanceTexture, GL_TEXTURE_2D, 0, 0, 0, 0, m_HistoryPrimaryHitDistanceTexture, GL_TEXTURE_2D, 0, 0, 0, 0, App::screenWidth, App::screenHeight, 1);
+    }
+
+    VoxelRayTracing::LocalMaterial VoxelRayTracing::CreateLocalMaterial(const Material& material) {
+        LocalMaterial mat{ };
+        mat.type = (int)material.type;
+        mat.fuzz = material.fuzz;
+        mat.indexOfRefraction = material.indexOfRefraction;
+        mat.color = glm::vec4{ material.solid.color, 1.0 };
+
+        return mat;
+    }
 
+    void VoxelRayTracing::CreateAndUploadMaterialBuffer() {
         std::vector<LocalMaterial> localMats{ };
         for (size_t i = 0; i < App::scene.materialBank.Size(); ++i) {
-            LocalMaterial mat{ };
-            mat.type = (int)App::scene.materialBank[i].type;
-            mat.fuzz = App::scene.materialBank[i].fuzz;
-            mat.indexOfRefraction = App::scene.materialBank[i].indexOfRefraction;
-            mat.color = glm::vec4{ App::scene.materialBank[i].solid.color, 1.0 };
-
-            localMats.emplace_back(mat);
+            localMats.emplace_back(CreateLocalMaterial(App::scene.materialBank[i]));
         }
 
         m_MaterialBank->SetData(localMats);
     }
+
+    void VoxelRayTracing::UploadMaterial(MaterialIndex index) {
+        const LocalMaterial mat = CreateLocalMaterial(App::scene.materialBank[index]);
+
+        m_MaterialBank->Update(index, { &mat, 1 });
+    }
 }
\ No newline at end of file
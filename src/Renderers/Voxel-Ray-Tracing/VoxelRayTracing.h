@@ -1,12 +1,18 @@
 #pragma once
 #include <chrono>
+#include <limits>
 #include <memory>
+#include <string>
 
 #include "renderers/Renderer.h"
 
+#include "Utility/OpenGl/GPUCounter.h"
 #include "Utility/OpenGl/Shader.h"
 #include "Utility/OpenGl/SSBO.h"
 
+#include "VoxelBrick.h"
+#include "VoxelGrid.h"
+
 namespace Rutile {
     class VoxelRayTracing : public Renderer {
     public:
@@ -33,9 +39,15 @@ namespace Rutile {
             int shouldDraw{ false };
 
             int childMask{ 0 }; // first 8 bits dictate which children the voxel has
+
+            int averageMaterial{ -1 }; // Most common material of all voxels below this one, used when traversal stops early
+
+            int brick{ -1 }; // Index into bricks if this voxel stores its contents in a brick
         };
 
         std::vector<Voxel> voxels;
+        std::vector<VoxelBrick> bricks;
+        std::vector<uint32_t> brickAttributes; // Material palettes and indices of the bricks, see VoxelBrick
 
     private:
         struct LocalMaterial {
@@ -46,7 +58,18 @@ namespace Rutile {
         };
 
         void ResetAccumulatedPixelData();
+        void TraceFrame(); // One sample into every pixel that hasn't converged
+
+        // Lets converged pixels be traced again, without throwing away what they have accumulated
+        void ResumeSampling();
+
+        // Reprojects what was accumulated on the next frame when temporal reprojection is on, otherwise starts over
+        void ViewChanged();
+        void CopyAccumulationToHistory();
+
+        static LocalMaterial CreateLocalMaterial(const Material& material);
         void CreateAndUploadMaterialBuffer();
+        void UploadMaterial(MaterialIndex index); // Only rewrites the one material in the buffer
 
         std::chrono::time_point<std::chrono::steady_clock> m_RendererLoadTime;
 
@@ -59,12 +82,93 @@ namespace Rutile {
 
         size_t m_FrameCount{ 0 };
 
+        // Adaptive sampling, see Converged in VoxelRayTracing.frag
+        static constexpr unsigned int activePixelBinding = 8; // activePixelBuffer in VoxelRayTracing.frag
+
+        bool m_AdaptiveSampling{ true };
+        int m_MinimumSamples{ 16 };
+        int m_MaximumSamples{ 4096 };
+        float m_ConvergenceThreshold{ 0.01f };
+
+        std::unique_ptr<GPUCounter> m_ActivePixelCounter;
+        bool m_Converged{ false }; // Nothing is traced until the accumulation is reset or sampling resumes
+
+        // Temporal reprojection, see ReprojectHistory in VoxelRayTracing.frag
+        bool m_TemporalReprojection{ true };
+        int m_HistoryLength{ 64 };
+        float m_DepthTolerance{ 0.05f };
+
+        bool m_ViewChanged{ false }; // The next trace reprojects instead of adding to the accumulation in place
+        glm::mat4 m_PreviousViewProjection{ 1.0f }; // Of the last traced frame
+        glm::vec3 m_PreviousCameraPosition{ 0.0f };
+
         unsigned int m_AccumulationFrameBuffer{ 0 };
-        unsigned int m_AccumulationTexture{ 0 };
+        unsigned int m_AccumulationTexture{ 0 };        // Sum of the samples in rgb, and their count in a
+        unsigned int m_MomentTexture{ 0 };              // Sum of the squared luminance of the samples
+        unsigned int m_PrimaryHitDistanceTexture{ 0 };  // How far the last primary ray went, 0 if it missed
         unsigned int m_AccumulationRBO{ 0 };
 
+        // Copies of the textures above from before the view changed, read while reprojecting
+        unsigned int m_HistoryAccumulationTexture{ 0 };
+        unsigned int m_HistoryMomentTexture{ 0 };
+        unsigned int m_HistoryPrimaryHitDistanceTexture{ 0 };
+
         std::unique_ptr<SSBO<Voxel>> m_VoxelSSBO;
+        std::unique_ptr<SSBO<VoxelBrick>> m_BrickSSBO;
+        std::unique_ptr<SSBO<uint32_t>> m_BrickAttributeSSBO;
 
         std::unique_ptr<SSBO<LocalMaterial>> m_MaterialBank;
+
+        // Voxelization
+        int m_VoxelResolutionOption{ 3 }; // Resolution is 32 << option, so the default is 256
+
+        int VoxelResolution() const;
+
+        bool m_UseBricks{ true }; // Stop the octree at VoxelBrick::size and store the remaining levels in bricks
+
+        // Incremental re-voxelization
+        struct VoxelizedObject {
+            std::vector<size_t> cells; // Grid indices this object wrote to
+
+            // Inclusive bounds of cells
+            glm::ivec3 min{ std::numeric_limits<int>::max() };
+            glm::ivec3 max{ std::numeric_limits<int>::min() };
+        };
+
+        bool VoxelizeObject(ObjectIndex objectIndex); // Returns false if part of the object falls outside of the grid
+        void RebuildOctreeFromGrid();
+
+        void UpdateObjectVoxels(ObjectIndex objectIndex);
+        void RebuildOctreeRegion(int voxelIndex, glm::ivec3 origin, int n, glm::ivec3 dirtyMin, glm::ivec3 dirtyMax, std::vector<size_t>& modifiedVoxels);
+        void RebuildSubtree(int voxelIndex, glm::ivec3 origin, int n, std::vector<size_t>& modifiedVoxels); // Voxelifies the region again
+        bool ContainsFilledCell(glm::ivec3 min, glm::ivec3 max) const; // Inclusive bounds, empty if min > max on any axis
+        int MostCommonChildMaterial(int firstChild, int childCount) const;
+        void MarkSubtreeAsGarbage(int voxelIndex); // Counts everything below voxelIndex, and its brick, as garbage
+
+        std::unique_ptr<Grid> m_Grid;
+
+        glm::vec3 m_OctreeMin{ 0.0f };
+        glm::vec3 m_OctreeMax{ 0.0f };
+
+        std::vector<VoxelizedObject> m_VoxelizedObjects;
+
+        // Filled grid cells below each voxel, parallel to voxels. Edits combine these instead of reading the grid again.
+        std::vector<int> m_VoxelCounts;
+
+        size_t m_GarbageVoxelCount{ 0 }; // Voxels in the buffer that are no longer reachable from the root
+        size_t m_GarbageBrickCount{ 0 };
+        size_t m_GarbageBrickAttributeCount{ 0 };
+
+        // Level of detail
+        bool m_LODEnabled{ false };
+        float m_LODPixelSize{ 1.0f }; // Traversal stops once a voxel covers less than this many pixels
+
+        // CPU traversal benchmark, see OctreeTraversal.h
+        void RunTraversalBenchmark();
+
+        int m_TraversalBenchmarkWidth{ 320 };
+        int m_TraversalBenchmarkHeight{ 180 };
+
+        std::string m_TraversalBenchmarkReport{ };
     };
 }
\ No newline at end of file
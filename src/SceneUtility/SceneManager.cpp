@@ -71,6 +71,9 @@ namespace Rutile {
             case SceneType::MINECRAFT_WORLD: {
                 return GetMinecraftWorld();
             }
+            case SceneType::MANY_POINT_LIGHTS: {
+                return GetManyPointLights();
+            }
         }
     }
 
@@ -896,4 +899,52 @@ namespace Rutile {
 
         return sceneFactory.GetScene();
     }
+
+    Scene SceneManager::GetManyPointLights() {
+        SceneFactory sceneFactory;
+
+        App::camera = Camera{ };
+        App::camera.pitch = -35.0f;
+        App::camera.yaw = -90.0f;
+        App::camera.position = glm::vec3{ 0.0f, 14.0f, 26.0f };
+        App::updateCameraVectors = true;
+
+        Material floorMaterial = MaterialFactory::Construct({ 0.4f, 0.4f, 0.4f });
+        Material pillarMaterial = MaterialFactory::Construct({ 0.8f, 0.8f, 0.8f });
+
+        Transform floor{ };
+        floor.scale = { 40.0f, 1.0f, 40.0f };
+        sceneFactory.Add(GeometryFactory::Primitive::CUBE, floor, floorMaterial, "Floor");
+
+        // A grid of pillars for the lights to cast shadows off of
+        for (int x = -4; x <= 4; ++x) {
+            for (int z = -4; z <= 4; ++z) {
+                Transform pillar{ };
+                pillar.position = { (float)x * 4.0f, 1.5f, (float)z * 4.0f };
+                pillar.scale = { 0.6f, 2.0f, 0.6f };
+                sceneFactory.Add(GeometryFactory::Primitive::CUBE, pillar, pillarMaterial);
+            }
+        }
+
+        // Small, dim lights, each only reaches a few clusters
+        for (int i = 0; i < 512; ++i) {
+            PointLight pointLight{ };
+            pointLight.position = { RandomFloat(-19.0f, 19.0f), RandomFloat(0.7f, 2.5f), RandomFloat(-19.0f, 19.0f) };
+
+            pointLight.ambient = { 0.0f, 0.0f, 0.0f };
+            pointLight.diffuse = RandomVec3(0.1f, 0.3f);
+            pointLight.specular = pointLight.diffuse;
+
+            pointLight.constant = 1.0f;
+            pointLight.linear = 0.7f;
+            pointLight.quadratic = 4.0f;
+
+            pointLight.shadowMapNearPlane = 0.1f;
+            pointLight.shadowMapFarPlane = 5.0f;
+
+            sceneFactory.Add(pointLight);
+        }
+
+        return sceneFactory.GetScene();
+    }
 }
\ No newline at end of file
@@ -17,6 +17,7 @@
 #include "SceneUtility/SceneManager.h"
 
 #include "Utility/TimingData.h"
+#include "Utility/OpenGl/GPUTimer.h"
 #include "Utility/events/EventManager.h"
 
 namespace Rutile {
@@ -49,6 +50,7 @@ namespace Rutile {
         inline static glm::ivec2 lastMousePosition = mousePosition;
 
         inline static TimingData timingData{ };
+        inline static std::unique_ptr<GPUTimer> gpuTimer = nullptr; // Queries belong to the renderer's context
 
         inline static EventManager eventManager;
     };
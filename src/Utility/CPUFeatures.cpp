@@ -0,0 +1,36 @@
+#include "CPUFeatures.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Rutile {
+    bool CPUSupportsAVX2() {
+        static const bool supported = [] {
+#ifdef _MSC_VER
+            int info[4];
+
+            __cpuid(info, 0);
+            if (info[0] < 7) {
+                return false;
+            }
+
+            __cpuid(info, 1);
+            const bool osxsave = (info[2] & (1 << 27)) != 0;
+            const bool avx = (info[2] & (1 << 28)) != 0;
+
+            // The OS has to preserve the xmm and ymm registers across context switches
+            if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+                return false;
+            }
+
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2") != 0;
+#endif
+        }();
+
+        return supported;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,6 @@
+#pragma once
+
+namespace Rutile {
+    // Checks the CPU and that the OS saves the upper halves of the ymm registers, the result is cached
+    bool CPUSupportsAVX2();
+}
\ No newline at end of file
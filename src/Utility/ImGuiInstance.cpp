@@ -5,6 +5,8 @@
 #include "imgui_impl_opengl3.h"
 #include "implot.h"
 
+#include "Settings/App.h"
+
 namespace Rutile {
     void ImGuiInstance::Init(GLFWwindow* window) {
         IMGUI_CHECKVERSION();
@@ -34,8 +36,12 @@ namespace Rutile {
     }
 
     void ImGuiInstance::FinishFrame() {
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        { // The platform windows have contexts of their own, only the main viewport is timed
+            GPUTimeScope imGuiTime{ App::gpuTimer.get(), "ImGui" };
+
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
 
         const ImGuiIO& io = ImGui::GetIO();
 
@@ -0,0 +1,15 @@
+#include "GLCapabilities.h"
+
+#include <gl/glew.h>
+
+namespace Rutile {
+    namespace GLCapabilities {
+        bool BufferStorage() {
+            return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+        }
+
+        bool ClearTexture() {
+            return GLEW_VERSION_4_4 || GLEW_ARB_clear_texture;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#pragma once
+
+namespace Rutile {
+    // Features newer than the GL 4.3 the renderers are written against, none of the renderers request a context
+    // version so these have to be checked before use. Only valid once GLEW is initialized for the current context
+    namespace GLCapabilities {
+        bool BufferStorage(); // glBufferStorage, GL 4.4 or ARB_buffer_storage
+        bool ClearTexture();  // glClearTexImage and glClearTexSubImage, GL 4.4 or ARB_clear_texture
+    }
+}
\ No newline at end of file
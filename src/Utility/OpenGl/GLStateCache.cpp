@@ -0,0 +1,81 @@
+#include "GLStateCache.h"
+
+#include <gl/glew.h>
+#include <GLFW/glfw3.h>
+
+namespace Rutile {
+    template<typename T>
+    bool GLStateCache::Update(std::optional<T>& cached, const T& value, StateCounter& counter) {
+        if (cached == value) {
+            ++counter.skipped;
+            return false;
+        }
+
+        cached = value;
+        ++counter.issued;
+        return true;
+    }
+
+    void GLStateCache::UseProgram(unsigned int program) {
+        if (Update(m_Program, program, m_Counters.programs)) {
+            glUseProgram(program);
+        }
+    }
+
+    void GLStateCache::BindVertexArray(unsigned int vertexArray) {
+        if (Update(m_VertexArray, vertexArray, m_Counters.vertexArrays)) {
+            glBindVertexArray(vertexArray);
+        }
+    }
+
+    void GLStateCache::BindFramebuffer(unsigned int framebuffer) {
+        if (Update(m_Framebuffer, framebuffer, m_Counters.framebuffers)) {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        }
+    }
+
+    void GLStateCache::BindTexture(unsigned int unit, unsigned int target, unsigned int texture) {
+        if (!Update(m_Textures[unit], std::make_pair(target, texture), m_Counters.textures)) {
+            return;
+        }
+
+        // The active unit isn't counted on its own, it only ever changes to bind a texture
+        if (m_ActiveTextureUnit != unit) {
+            m_ActiveTextureUnit = unit;
+            glActiveTexture(GL_TEXTURE0 + unit);
+        }
+
+        glBindTexture(target, texture);
+    }
+
+    void GLStateCache::CullFace(unsigned int face) {
+        if (Update(m_CullFace, face, m_Counters.cullFaces)) {
+            glCullFace(face);
+        }
+    }
+
+    void GLStateCache::Viewport(int x, int y, int width, int height) {
+        if (Update(m_Viewport, std::array<int, 4>{ x, y, width, height }, m_Counters.viewports)) {
+            glViewport(x, y, width, height);
+        }
+    }
+
+    void GLStateCache::Invalidate() {
+        m_Program.reset();
+        m_VertexArray.reset();
+        m_Framebuffer.reset();
+        m_CullFace.reset();
+        m_Viewport.reset();
+
+        m_ActiveTextureUnit.reset();
+        m_Textures.fill(std::nullopt);
+    }
+
+    void GLStateCache::ResetCounters() {
+        m_Counters = Counters{ };
+    }
+
+    const GLStateCache::Counters& GLStateCache::GetCounters() const {
+        return m_Counters;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <utility>
+
+namespace Rutile {
+    // Remembers the GL state that was set through it and skips calls that wouldn't change anything. Anything that
+    // changes the same state without going through the cache has to be followed by Invalidate.
+    class GLStateCache {
+    public:
+        struct StateCounter {
+            size_t issued{ 0 };
+            size_t skipped{ 0 };
+        };
+
+        struct Counters {
+            StateCounter programs;
+            StateCounter vertexArrays;
+            StateCounter framebuffers;
+            StateCounter textures;
+            StateCounter cullFaces;
+            StateCounter viewports;
+        };
+
+        static constexpr size_t maxTextureUnits = 16;
+
+        void UseProgram(unsigned int program);
+        void BindVertexArray(unsigned int vertexArray);
+        void BindFramebuffer(unsigned int framebuffer);
+        void BindTexture(unsigned int unit, unsigned int target, unsigned int texture);
+        void CullFace(unsigned int face);
+        void Viewport(int x, int y, int width, int height);
+
+        // Forgets all state, the next call of each kind is always issued
+        void Invalidate();
+
+        void ResetCounters();
+        const Counters& GetCounters() const;
+
+    private:
+        // Returns true if value differs from cached, which is then updated
+        template<typename T>
+        static bool Update(std::optional<T>& cached, const T& value, StateCounter& counter);
+
+        std::optional<unsigned int> m_Program;
+        std::optional<unsigned int> m_VertexArray;
+        std::optional<unsigned int> m_Framebuffer;
+        std::optional<unsigned int> m_CullFace;
+        std::optional<std::array<int, 4>> m_Viewport;
+
+        std::optional<unsigned int> m_ActiveTextureUnit;
+        std::array<std::optional<std::pair<unsigned int, unsigned int>>, maxTextureUnits> m_Textures; // Target and texture
+
+        Counters m_Counters;
+    };
+}
\ No newline at end of file
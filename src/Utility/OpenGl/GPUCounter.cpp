@@ -0,0 +1,90 @@
+#include "GPUCounter.h"
+
+#include <GLFW/glfw3.h>
+
+namespace Rutile {
+    GPUCounter::GPUCounter() {
+        for (Slot& slot : m_Slots) {
+            glGenBuffers(1, &slot.buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, sizeof(uint32_t), nullptr, GL_DYNAMIC_READ);
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    GPUCounter::~GPUCounter() {
+        for (Slot& slot : m_Slots) {
+            if (slot.fence != nullptr) {
+                glDeleteSync(slot.fence);
+            }
+
+            glDeleteBuffers(1, &slot.buffer);
+        }
+    }
+
+    void GPUCounter::Begin(unsigned int binding) {
+        Slot& slot = m_Slots[m_Slot];
+
+        // The GPU fell more than frameLatency frames behind, the old value in this copy is dropped
+        if (slot.fence != nullptr) {
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+
+        slot.generation = m_Generation;
+
+        const uint32_t zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t), &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, slot.buffer);
+    }
+
+    void GPUCounter::End() {
+        // Makes the shaders' atomics visible to glGetBufferSubData
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        m_Slots[m_Slot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        m_Slot = (m_Slot + 1) % frameLatency;
+
+        // Oldest first, so the newest finished copy is the one that sticks
+        for (size_t i = 0; i < frameLatency; ++i) {
+            Slot& slot = m_Slots[(m_Slot + i) % frameLatency];
+
+            if (slot.fence == nullptr) {
+                continue;
+            }
+
+            const GLenum result = glClientWaitSync(slot.fence, 0, 0);
+            if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+                break;
+            }
+
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+
+            if (slot.generation != m_Generation) {
+                continue;
+            }
+
+            uint32_t value = 0;
+            glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(uint32_t), &value);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+            m_Value = value;
+        }
+    }
+
+    void GPUCounter::Reset() {
+        ++m_Generation;
+        m_Value = std::nullopt;
+    }
+
+    std::optional<uint32_t> GPUCounter::Value() const {
+        return m_Value;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+#include <gl/glew.h>
+
+namespace Rutile {
+    // A single uint that shaders atomicAdd to. There is a copy per frame in flight, and a copy is only read back once
+    // its fence has signaled, so reading never waits on the GPU and the value lags a few frames behind.
+    class GPUCounter {
+    public:
+        static constexpr size_t frameLatency = 3;
+
+        GPUCounter();
+        GPUCounter(const GPUCounter& other) = delete;
+        GPUCounter(GPUCounter&& other) noexcept = delete;
+        GPUCounter& operator=(const GPUCounter& other) = delete;
+        GPUCounter& operator=(GPUCounter&& other) noexcept = delete;
+        ~GPUCounter();
+
+        // Zeroes this frame's copy and binds it as the shader storage buffer at binding
+        void Begin(unsigned int binding);
+
+        // Fences this frame's copy and reads back the copies the GPU is done with
+        void End();
+
+        // Whatever was counted before is never returned by Value
+        void Reset();
+
+        // The newest value that was read back, if there is one yet
+        std::optional<uint32_t> Value() const;
+
+    private:
+        struct Slot {
+            unsigned int buffer{ 0 };
+            GLsync fence{ nullptr };
+            size_t generation{ 0 };
+        };
+
+        std::array<Slot, frameLatency> m_Slots;
+        size_t m_Slot{ 0 };
+
+        size_t m_Generation{ 0 };
+        std::optional<uint32_t> m_Value;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include "GPUTimer.h"
+
+#include <gl/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+
+namespace Rutile {
+    GPUTimer::~GPUTimer() {
+        for (Pass& pass : m_Passes) {
+            glDeleteQueries((GLsizei)frameLatency, pass.queries.data());
+        }
+    }
+
+    void GPUTimer::Begin(const std::string& name) {
+        if (m_ActivePass) {
+            std::cout << "ERROR: GPU timer pass \"" << name << "\" began while \"" << m_Passes[*m_ActivePass].name << "\" was still active" << std::endl;
+            return;
+        }
+
+        const size_t passIndex = FindOrAddPass(name);
+        Pass& pass = m_Passes[passIndex];
+
+        // The previous result in this slot was not available in time, it is dropped rather than waited for
+        pass.issued[m_Slot] = true;
+
+        glBeginQuery(GL_TIME_ELAPSED, pass.queries[m_Slot]);
+
+        m_ActivePass = passIndex;
+    }
+
+    void GPUTimer::End() {
+        if (!m_ActivePass) {
+            std::cout << "ERROR: GPU timer pass ended without one being active" << std::endl;
+            return;
+        }
+
+        glEndQuery(GL_TIME_ELAPSED);
+
+        m_ActivePass = std::nullopt;
+    }
+
+    void GPUTimer::EndFrame() {
+        if (m_ActivePass) {
+            End();
+        }
+
+        m_Slot = (m_Slot + 1) % frameLatency;
+
+        for (Pass& pass : m_Passes) {
+            // Oldest first, so the history stays in order
+            for (size_t i = 0; i < frameLatency; ++i) {
+                const size_t slot = (m_Slot + i) % frameLatency;
+
+                if (!pass.issued[slot]) {
+                    continue;
+                }
+
+                GLint available = GL_FALSE;
+                glGetQueryObjectiv(pass.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+
+                if (!available) {
+                    break;
+                }
+
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(pass.queries[slot], GL_QUERY_RESULT, &nanoseconds);
+
+                pass.issued[slot] = false;
+                pass.milliseconds = (double)nanoseconds / 1000000.0;
+
+                if (pass.historyCount < historySize) {
+                    pass.history[pass.historyCount] = (float)pass.milliseconds;
+                    ++pass.historyCount;
+                } else {
+                    pass.history[pass.historyOffset] = (float)pass.milliseconds;
+                    pass.historyOffset = (pass.historyOffset + 1) % historySize;
+                }
+            }
+        }
+    }
+
+    const std::vector<GPUTimer::Pass>& GPUTimer::GetPasses() const {
+        return m_Passes;
+    }
+
+    size_t GPUTimer::FindOrAddPass(const std::string& name) {
+        for (size_t i = 0; i < m_Passes.size(); ++i) {
+            if (m_Passes[i].name == name) {
+                return i;
+            }
+        }
+
+        Pass pass{ };
+        pass.name = name;
+        glGenQueries((GLsizei)frameLatency, pass.queries.data());
+
+        m_Passes.push_back(pass);
+
+        return m_Passes.size() - 1;
+    }
+
+    GPUTimeScope::GPUTimeScope(GPUTimer* timer, const std::string& name)
+        : m_Timer(timer) {
+        if (m_Timer != nullptr) {
+            m_Timer->Begin(name);
+        }
+    }
+
+    GPUTimeScope::~GPUTimeScope() {
+        if (m_Timer != nullptr) {
+            m_Timer->End();
+        }
+    }
+}
\ No newline at end of file
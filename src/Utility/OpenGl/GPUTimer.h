@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace Rutile {
+    // Measures how long named passes take on the GPU with GL_TIME_ELAPSED queries. Every pass owns a ring of queries
+    // and a result is only read back once it is available, frameLatency frames later at most, so the CPU never waits
+    // on the GPU. Queries of the same target can't nest, so passes can't either.
+    class GPUTimer {
+    public:
+        static constexpr size_t frameLatency = 3;
+        static constexpr size_t historySize = 256;
+
+        struct Pass {
+            std::string name;
+
+            std::array<unsigned int, frameLatency> queries{ };
+            std::array<bool, frameLatency> issued{ };
+
+            double milliseconds{ 0.0 };
+
+            // Ring of the last results, the oldest one is at historyOffset
+            std::array<float, historySize> history{ };
+            size_t historyOffset{ 0 };
+            size_t historyCount{ 0 };
+        };
+
+        GPUTimer() = default;
+        GPUTimer(const GPUTimer& other) = delete;
+        GPUTimer(GPUTimer&& other) noexcept = default;
+        GPUTimer& operator=(const GPUTimer& other) = delete;
+        GPUTimer& operator=(GPUTimer&& other) noexcept = default;
+        ~GPUTimer();
+
+        void Begin(const std::string& name);
+        void End();
+
+        // Collects the results that became available and moves on to the next set of queries
+        void EndFrame();
+
+        const std::vector<Pass>& GetPasses() const;
+
+    private:
+        size_t FindOrAddPass(const std::string& name);
+
+        std::vector<Pass> m_Passes;
+        std::optional<size_t> m_ActivePass;
+
+        size_t m_Slot{ 0 };
+    };
+
+    class GPUTimeScope {
+    public:
+        GPUTimeScope(GPUTimer* timer, const std::string& name);
+        GPUTimeScope(const GPUTimeScope& other) = delete;
+        GPUTimeScope(GPUTimeScope&& other) noexcept = delete;
+        GPUTimeScope& operator=(const GPUTimeScope& other) = delete;
+        GPUTimeScope& operator=(GPUTimeScope&& other) noexcept = delete;
+        ~GPUTimeScope();
+
+    private:
+        GPUTimer* m_Timer;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,242 @@
+#include "GeometryArena.h"
+
+#include <gl/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstddef>
+
+namespace Rutile {
+    FreeList::FreeList(size_t capacity) {
+        Grow(capacity);
+    }
+
+    std::optional<size_t> FreeList::Allocate(size_t count) {
+        if (count == 0) {
+            return 0;
+        }
+
+        for (auto it = m_FreeRanges.begin(); it != m_FreeRanges.end(); ++it) {
+            if (it->second < count) {
+                continue;
+            }
+
+            const size_t offset = it->first;
+            const size_t remaining = it->second - count;
+
+            m_FreeRanges.erase(it);
+
+            if (remaining > 0) {
+                m_FreeRanges[offset + count] = remaining;
+            }
+
+            m_UsedCount += count;
+
+            return offset;
+        }
+
+        return std::nullopt;
+    }
+
+    void FreeList::Free(size_t offset, size_t count) {
+        if (count == 0) {
+            return;
+        }
+
+        m_UsedCount -= count;
+
+        auto next = m_FreeRanges.lower_bound(offset);
+
+        // Merge with the range after
+        if (next != m_FreeRanges.end() && offset + count == next->first) {
+            count += next->second;
+            next = m_FreeRanges.erase(next);
+        }
+
+        // Merge with the range before
+        if (next != m_FreeRanges.begin()) {
+            auto previous = std::prev(next);
+
+            if (previous->first + previous->second == offset) {
+                previous->second += count;
+                return;
+            }
+        }
+
+        m_FreeRanges[offset] = count;
+    }
+
+    void FreeList::Grow(size_t newCapacity) {
+        if (newCapacity <= m_Capacity) {
+            return;
+        }
+
+        const size_t oldCapacity = m_Capacity;
+        m_Capacity = newCapacity;
+
+        // The new range was never allocated, count it as used so that freeing it balances out
+        m_UsedCount += newCapacity - oldCapacity;
+        Free(oldCapacity, newCapacity - oldCapacity);
+    }
+
+    size_t FreeList::Capacity() const {
+        return m_Capacity;
+    }
+
+    size_t FreeList::UsedCount() const {
+        return m_UsedCount;
+    }
+
+    GeometryArena::GeometryArena(size_t vertexCapacity, size_t indexCapacity)
+        : m_Vertices(vertexCapacity), m_Indices(indexCapacity) {
+
+        glGenVertexArrays(1, &m_VAO);
+        glGenBuffers(1, &m_VBO);
+        glGenBuffers(1, &m_EBO);
+
+        glBindVertexArray(m_VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(vertexCapacity * sizeof(Vertex)), nullptr, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)(indexCapacity * sizeof(Index)), nullptr, GL_STATIC_DRAW);
+
+        SetVertexAttributes();
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    GeometryArena::~GeometryArena() {
+        glDeleteBuffers(1, &m_EBO);
+        glDeleteBuffers(1, &m_VBO);
+        glDeleteVertexArrays(1, &m_VAO);
+    }
+
+    GeometryArena::Allocation GeometryArena::Add(const Geometry& geometry) {
+        Allocation allocation{ };
+        allocation.vertexCount = geometry.vertices.size();
+        allocation.indexCount = geometry.indices.size();
+
+        std::optional<size_t> firstVertex = m_Vertices.Allocate(allocation.vertexCount);
+        if (!firstVertex) {
+            GrowVertexBuffer(m_Vertices.Capacity() + allocation.vertexCount);
+            firstVertex = m_Vertices.Allocate(allocation.vertexCount);
+        }
+
+        std::optional<size_t> firstIndex = m_Indices.Allocate(allocation.indexCount);
+        if (!firstIndex) {
+            GrowIndexBuffer(m_Indices.Capacity() + allocation.indexCount);
+            firstIndex = m_Indices.Allocate(allocation.indexCount);
+        }
+
+        allocation.firstVertex = *firstVertex;
+        allocation.firstIndex = *firstIndex;
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)(allocation.firstVertex * sizeof(Vertex)), (GLsizeiptr)(allocation.vertexCount * sizeof(Vertex)), geometry.vertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // Bound through GL_COPY_WRITE_BUFFER so that the element buffer binding of whichever VAO is bound is left alone
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)(allocation.firstIndex * sizeof(Index)), (GLsizeiptr)(allocation.indexCount * sizeof(Index)), geometry.indices.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        return allocation;
+    }
+
+    void GeometryArena::Remove(const Allocation& allocation) {
+        m_Vertices.Free(allocation.firstVertex, allocation.vertexCount);
+        m_Indices.Free(allocation.firstIndex, allocation.indexCount);
+    }
+
+    unsigned int GeometryArena::VAO() const {
+        return m_VAO;
+    }
+
+    size_t GeometryArena::VertexCapacity() const {
+        return m_Vertices.Capacity();
+    }
+
+    size_t GeometryArena::IndexCapacity() const {
+        return m_Indices.Capacity();
+    }
+
+    size_t GeometryArena::UsedVertexCount() const {
+        return m_Vertices.UsedCount();
+    }
+
+    size_t GeometryArena::UsedIndexCount() const {
+        return m_Indices.UsedCount();
+    }
+
+    void GeometryArena::GrowVertexBuffer(size_t minimumCapacity) {
+        const size_t oldCapacity = m_Vertices.Capacity();
+        const size_t newCapacity = std::max(minimumCapacity, oldCapacity * 2);
+
+        unsigned int newVBO;
+        glGenBuffers(1, &newVBO);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)(newCapacity * sizeof(Vertex)), nullptr, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, m_VBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)(oldCapacity * sizeof(Vertex)));
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(1, &m_VBO);
+        m_VBO = newVBO;
+
+        m_Vertices.Grow(newCapacity);
+
+        // The attributes still point at the old buffer
+        glBindVertexArray(m_VAO);
+        SetVertexAttributes();
+        glBindVertexArray(0);
+    }
+
+    void GeometryArena::GrowIndexBuffer(size_t minimumCapacity) {
+        const size_t oldCapacity = m_Indices.Capacity();
+        const size_t newCapacity = std::max(minimumCapacity, oldCapacity * 2);
+
+        unsigned int newEBO;
+        glGenBuffers(1, &newEBO);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newEBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)(newCapacity * sizeof(Index)), nullptr, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, m_EBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)(oldCapacity * sizeof(Index)));
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(1, &m_EBO);
+        m_EBO = newEBO;
+
+        m_Indices.Grow(newCapacity);
+
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        glBindVertexArray(0);
+    }
+
+    void GeometryArena::SetVertexAttributes() {
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+        glEnableVertexAttribArray(0);
+
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        glEnableVertexAttribArray(1);
+
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+        glEnableVertexAttribArray(2);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <map>
+#include <optional>
+
+#include "RenderingAPI/Geometry.h"
+
+namespace Rutile {
+    // First fit allocator over a range of elements, neighbouring free ranges are merged when they are released
+    class FreeList {
+    public:
+        FreeList(size_t capacity = 0);
+
+        std::optional<size_t> Allocate(size_t count);
+        void Free(size_t offset, size_t count);
+
+        // Adds [Capacity(), newCapacity) to the free ranges
+        void Grow(size_t newCapacity);
+
+        size_t Capacity() const;
+        size_t UsedCount() const;
+
+    private:
+        std::map<size_t, size_t> m_FreeRanges; // Offset to count
+
+        size_t m_Capacity{ 0 };
+        size_t m_UsedCount{ 0 };
+    };
+
+    // One vertex buffer and one index buffer shared by many geometries, described by a single VAO. Each geometry gets a
+    // range of both buffers, its indices stay relative to its own vertices and are drawn with firstVertex as the base
+    // vertex. Both buffers grow geometrically when a geometry doesn't fit.
+    class GeometryArena {
+    public:
+        struct Allocation {
+            size_t firstVertex{ 0 };
+            size_t vertexCount{ 0 };
+
+            size_t firstIndex{ 0 };
+            size_t indexCount{ 0 };
+        };
+
+        GeometryArena(size_t vertexCapacity = 65536, size_t indexCapacity = 262144);
+        GeometryArena(const GeometryArena& other) = delete;
+        GeometryArena(GeometryArena&& other) noexcept = default;
+        GeometryArena& operator=(const GeometryArena& other) = delete;
+        GeometryArena& operator=(GeometryArena&& other) noexcept = default;
+        ~GeometryArena();
+
+        // Uploads straight from the geometry's vertices and indices
+        Allocation Add(const Geometry& geometry);
+        void Remove(const Allocation& allocation);
+
+        // Attributes 0 to 2 are position, normal and uv, anything past that is left to the user of the arena
+        unsigned int VAO() const;
+
+        size_t VertexCapacity() const;
+        size_t IndexCapacity() const;
+
+        size_t UsedVertexCount() const;
+        size_t UsedIndexCount() const;
+
+    private:
+        void GrowVertexBuffer(size_t minimumCapacity);
+        void GrowIndexBuffer(size_t minimumCapacity);
+
+        void SetVertexAttributes();
+
+        unsigned int m_VAO{ 0 };
+        unsigned int m_VBO{ 0 };
+        unsigned int m_EBO{ 0 };
+
+        FreeList m_Vertices;
+        FreeList m_Indices;
+    };
+}
\ No newline at end of file
@@ -1,27 +1,76 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <span>
 #include <vector>
 
+#include "Utility/OpenGl/GLCapabilities.h"
+
 namespace Rutile {
     template<typename T>
-    class SSBO {
+    class SSBO;
+
+    // Waiting for the GPU to finish with one buffer means waiting for all of its work, so every update to a single
+    // region SSBO between Begin and End shares one wait, whichever buffer it is made to. Nothing may be drawn with the
+    // buffers until End.
+    class SSBOBatch {
     public:
-        SSBO(unsigned int bufferBase, const std::vector<T>& data = std::vector<T>{ }) {
-            glGenBuffers(1, &m_Handle);
-            glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Handle);
+        static void Begin() {
+            ++m_Depth;
+        }
 
-            if (data.empty()) {
-                glBufferData(GL_SHADER_STORAGE_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
-            } else {
-                glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(T) * data.size(), data.data(), GL_DYNAMIC_DRAW);
+        static void End() {
+            if (--m_Depth == 0) {
+                m_WaitedForGPU = false;
             }
+        }
+
+    private:
+        template<typename T>
+        friend class SSBO;
 
-            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bufferBase, m_Handle);
+        inline static int m_Depth{ 0 };
+        inline static bool m_WaitedForGPU{ false }; // Already waited during the current batch
+    };
 
-            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    // Shader storage buffer with immutable storage that stays mapped for its whole lifetime, updates are plain copies
+    // into the mapping and only touch the bytes they are given.
+    //
+    // Data that is rewritten every frame should use more than one region: the buffer then holds regionCount copies
+    // and EndFrame moves on to the next one, waiting on the fence of the frame that last used it. Since the new region
+    // holds data from regionCount frames ago, everything the shaders read has to be written again every frame.
+    // With a single region an update waits for the GPU to finish with the buffer, which is meant for data that only
+    // changes on edits. Edits that make several updates should put them in an SSBOBatch, so that they wait only once.
+    //
+    // Without buffer storage (GL 4.4) the same regions are kept in a buffer made with glBufferData, and updates go
+    // through glBufferSubData instead of the mapping.
+    template<typename T>
+    class SSBO {
+    public:
+        SSBO(unsigned int bufferBase, const std::vector<T>& data = std::vector<T>{ }, size_t regionCount = 1)
+            : m_BufferBase(bufferBase), m_Persistent(GLCapabilities::BufferStorage()), m_Fences(std::max(regionCount, (size_t)1), nullptr) {
+
+            GLint alignment;
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            m_RegionAlignment = (size_t)alignment;
+
+            // Storage can't be empty
+            Allocate(std::max(data.size(), (size_t)1));
+
+            Update(0, data);
         }
 
         ~SSBO() {
+            for (GLsync& fence : m_Fences) {
+                if (fence != nullptr) {
+                    glDeleteSync(fence);
+                }
+            }
+
+            // Deleting the buffer also unmaps it
             glDeleteBuffers(1, &m_Handle);
         }
 
@@ -30,13 +79,161 @@ namespace Rutile {
         SSBO& operator=(const SSBO& other) = delete;
         SSBO& operator=(SSBO&& other) noexcept = default;
 
+        // Overwrites the start of the buffer with data, growing it if it doesn't fit. The buffer never shrinks, elements
+        // past data.size() keep whatever was written there before and an empty vector changes nothing, so the shaders
+        // have to get the element count some other way.
         void SetData(const std::vector<T>& data) {
+            Update(0, data);
+        }
+
+        // Overwrites data.size() elements starting at offset, if the range runs past the end of the buffer it is grown
+        // (to at least double its size) and the old contents are kept.
+        void Update(size_t offset, std::span<const T> data) {
+            if (data.empty()) {
+                return;
+            }
+
+            if (offset + data.size() > m_Capacity) {
+                Grow(offset + data.size());
+            }
+
+            const size_t byteOffset = m_Region * m_RegionSize + offset * sizeof(T);
+
+            if (!m_Persistent) {
+                // glBufferSubData already waits for the commands reading the old contents
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Handle);
+                glBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)byteOffset, (GLsizeiptr)data.size_bytes(), data.data());
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+                return;
+            }
+
+            if (m_Fences.size() == 1 && !SSBOBatch::m_WaitedForGPU) {
+                WaitForGPU();
+
+                // The GPU stays done with the buffers until the batch ends
+                SSBOBatch::m_WaitedForGPU = SSBOBatch::m_Depth > 0;
+            }
+
+            std::memcpy(m_Mapping + byteOffset, data.data(), data.size_bytes());
+        }
+
+        // Call once all of this frame's commands that read the buffer have been issued
+        void EndFrame() {
+            if (m_Fences.size() == 1) {
+                return;
+            }
+
+            m_Fences[m_Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            m_Region = (m_Region + 1) % m_Fences.size();
+
+            WaitForFence(m_Fences[m_Region]);
+
+            BindRegion();
+        }
+
+        size_t Capacity() const {
+            return m_Capacity;
+        }
+
+    private:
+        void Allocate(size_t capacity) {
+            m_Capacity = capacity;
+            m_RegionSize = (capacity * sizeof(T) + m_RegionAlignment - 1) / m_RegionAlignment * m_RegionAlignment;
+
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            const GLsizeiptr size = (GLsizeiptr)(m_RegionSize * m_Fences.size());
+
+            glGenBuffers(1, &m_Handle);
             glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Handle);
-            glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(data.size() * sizeof(T)), data.data(), GL_DYNAMIC_DRAW);
+
+            if (m_Persistent) {
+                glBufferStorage(GL_SHADER_STORAGE_BUFFER, size, nullptr, flags);
+
+                m_Mapping = static_cast<std::byte*>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, size, flags));
+
+                if (m_Mapping == nullptr) {
+                    std::cout << "ERROR: Failed to persistently map shader storage buffer" << std::endl;
+                }
+            } else {
+                glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+            }
+
             glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+            BindRegion();
         }
 
-    private:
-        unsigned int m_Handle;
+        void Grow(size_t minimumCapacity) {
+            const unsigned int oldHandle = m_Handle;
+            const size_t oldRegionSize = m_RegionSize;
+            const size_t oldCapacity = m_Capacity;
+
+            Allocate(std::max(minimumCapacity, m_Capacity * 2));
+
+            // Only the current region holds data that is still needed
+            glBindBuffer(GL_COPY_READ_BUFFER, oldHandle);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_Handle);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)(m_Region * oldRegionSize), (GLintptr)(m_Region * m_RegionSize), (GLsizeiptr)(oldCapacity * sizeof(T)));
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            glDeleteBuffers(1, &oldHandle);
+
+            // The fences guarded the old buffer
+            for (GLsync& fence : m_Fences) {
+                if (fence != nullptr) {
+                    glDeleteSync(fence);
+                    fence = nullptr;
+                }
+            }
+
+            // The copy has to land before the caller writes through the mapping, growing is rare enough to stall on
+            WaitForGPU();
+        }
+
+        void BindRegion() {
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, m_BufferBase, m_Handle, (GLintptr)(m_Region * m_RegionSize), (GLsizeiptr)m_RegionSize);
+        }
+
+        static void WaitForGPU() {
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            WaitForFence(fence);
+        }
+
+        static void WaitForFence(GLsync& fence) {
+            if (fence == nullptr) {
+                return;
+            }
+
+            while (true) {
+                const GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1ms
+
+                if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+                    break;
+                }
+
+                if (result == GL_WAIT_FAILED) {
+                    std::cout << "ERROR: Waiting on a shader storage buffer fence failed" << std::endl;
+                    break;
+                }
+            }
+
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        unsigned int m_Handle{ 0 };
+        unsigned int m_BufferBase;
+
+        bool m_Persistent; // Mapped with buffer storage, otherwise updated with glBufferSubData
+        std::byte* m_Mapping{ nullptr };
+
+        size_t m_Capacity{ 0 }; // In elements, per region
+        size_t m_RegionSize{ 0 }; // In bytes, including padding up to the binding alignment
+        size_t m_RegionAlignment{ 1 };
+
+        size_t m_Region{ 0 };
+        std::vector<GLsync> m_Fences; // One per region
     };
 }
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <gl/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -31,8 +33,29 @@ namespace Rutile {
         return out;
     }
 
-    Shader::Shader(const std::string& vertexShaderPath, const std::string& fragmentShaderPath, const std::string& geometryShaderPath) {
-        std::string vertexShaderSource = ReadFile(vertexShaderPath);
+    std::string InsertDefines(const std::string& source, const std::string& defines) {
+        if (defines.empty()) {
+            return source;
+        }
+
+        const size_t versionPosition = source.find("#version");
+        if (versionPosition == std::string::npos) {
+            return defines + "\n" + source;
+        }
+
+        const size_t endOfVersionLine = source.find('\n', versionPosition);
+        if (endOfVersionLine == std::string::npos) {
+            return source + "\n" + defines + "\n";
+        }
+
+        // #line keeps the line numbers in compile errors matching the file
+        const long long nextLine = std::count(source.begin(), source.begin() + (long long)endOfVersionLine + 1, '\n') + 1;
+
+        return source.substr(0, endOfVersionLine + 1) + defines + "\n#line " + std::to_string(nextLine) + "\n" + source.substr(endOfVersionLine + 1);
+    }
+
+    Shader::Shader(const std::string& vertexShaderPath, const std::string& fragmentShaderPath, const std::string& geometryShaderPath, const std::string& defines) {
+        std::string vertexShaderSource = InsertDefines(ReadFile(vertexShaderPath), defines);
         const char* vertexSource = vertexShaderSource.c_str();
 
         unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -48,7 +71,7 @@ namespace Rutile {
             std::cout << infoLog << std::endl;
         }
 
-        std::string fragmentShaderSource = ReadFile(fragmentShaderPath);
+        std::string fragmentShaderSource = InsertDefines(ReadFile(fragmentShaderPath), defines);
         const char* fragmentSource = fragmentShaderSource.c_str();
 
         unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
@@ -64,7 +87,7 @@ namespace Rutile {
 
         unsigned int geometryShader = 0;
         if (!geometryShaderPath.empty()) {
-            std::string geometryShaderSource = ReadFile(geometryShaderPath);
+            std::string geometryShaderSource = InsertDefines(ReadFile(geometryShaderPath), defines);
             const char* geometrySource = geometryShaderSource.c_str();
 
             geometryShader = glCreateShader(GL_GEOMETRY_SHADER);
@@ -102,6 +125,45 @@ namespace Rutile {
         if (!geometryShaderPath.empty()) {
             glDeleteShader(geometryShader);
         }
+
+        ReflectUniforms();
+    }
+
+    std::unique_ptr<Shader> Shader::Compute(const std::string& computeShaderPath, const std::string& defines) {
+        std::string computeShaderSource = InsertDefines(ReadFile(computeShaderPath), defines);
+        const char* computeSource = computeShaderSource.c_str();
+
+        unsigned int computeShader = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(computeShader, 1, &computeSource, nullptr);
+        glCompileShader(computeShader);
+
+        int success;
+        char infoLog[512];
+        glGetShaderiv(computeShader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(computeShader, 512, nullptr, infoLog);
+            std::cout << "ERROR: Compute shader failed to compile:" << std::endl;
+            std::cout << infoLog << std::endl;
+        }
+
+        std::unique_ptr<Shader> shader{ new Shader{ } };
+
+        shader->m_ShaderHandle = glCreateProgram();
+        glAttachShader(shader->m_ShaderHandle, computeShader);
+        glLinkProgram(shader->m_ShaderHandle);
+
+        glGetProgramiv(shader->m_ShaderHandle, GL_LINK_STATUS, &success);
+        if (!success) {
+            glGetProgramInfoLog(shader->m_ShaderHandle, 512, nullptr, infoLog);
+            std::cout << "ERROR: Compute shader program failed to link:" << std::endl;
+            std::cout << infoLog << std::endl;
+        }
+
+        glDeleteShader(computeShader);
+
+        shader->ReflectUniforms();
+
+        return shader;
     }
 
     Shader::~Shader() {
@@ -112,32 +174,146 @@ namespace Rutile {
         glUseProgram(m_ShaderHandle);
     }
 
+    unsigned int Shader::Handle() const {
+        return m_ShaderHandle;
+    }
+
+    template<typename T>
+    bool Shader::UpdateCachedValue(int location, const T& value) {
+        static_assert(sizeof(T) <= sizeof(CachedUniform::data), "Uniform type is too large to cache");
+
+        if (location < 0) {
+            return false;
+        }
+
+        if ((size_t)location >= m_UniformValues.size()) {
+            m_UniformValues.resize((size_t)location + 1);
+        }
+
+        CachedUniform& cached = m_UniformValues[location];
+        if (cached.valid && std::memcmp(cached.data.data(), &value, sizeof(T)) == 0) {
+            return false;
+        }
+
+        std::memcpy(cached.data.data(), &value, sizeof(T));
+        cached.valid = true;
+
+        return true;
+    }
+
+    // glProgramUniform is used so that setting a uniform never depends on which program happens to be bound, which
+    // the cached values rely on
+    void Shader::Set(UniformHandle<float> uniform, const float& value) {
+        if (UpdateCachedValue(uniform.location, value)) {
+            glProgramUniform1f(m_ShaderHandle, uniform.location, value);
+        }
+    }
+
+    void Shader::Set(UniformHandle<int> uniform, const int& value) {
+        if (UpdateCachedValue(uniform.location, value)) {
+            glProgramUniform1i(m_ShaderHandle, uniform.location, value);
+        }
+    }
+
+    void Shader::Set(UniformHandle<bool> uniform, const bool& value) {
+        Set(UniformHandle<int>{ uniform.location }, value ? 1 : 0);
+    }
+
+    void Shader::Set(UniformHandle<glm::vec3> uniform, const glm::vec3& value) {
+        if (UpdateCachedValue(uniform.location, value)) {
+            glProgramUniform3fv(m_ShaderHandle, uniform.location, 1, glm::value_ptr(value));
+        }
+    }
+
+    void Shader::Set(UniformHandle<glm::vec4> uniform, const glm::vec4& value) {
+        if (UpdateCachedValue(uniform.location, value)) {
+            glProgramUniform4fv(m_ShaderHandle, uniform.location, 1, glm::value_ptr(value));
+        }
+    }
+
+    void Shader::Set(UniformHandle<glm::mat4> uniform, const glm::mat4& value) {
+        if (UpdateCachedValue(uniform.location, value)) {
+            glProgramUniformMatrix4fv(m_ShaderHandle, uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+        }
+    }
+
     void Shader::SetFloat(const std::string& name, const float& value) {
-        glUniform1f(glGetUniformLocation(m_ShaderHandle, name.c_str()), value);
+        Set(GetUniform<float>(name), value);
     }
 
     void Shader::SetInt(const std::string& name, const int& value) {
-        glUniform1i(glGetUniformLocation(m_ShaderHandle, name.c_str()), value);
+        Set(GetUniform<int>(name), value);
     }
 
     void Shader::SetVec3(const std::string& name, const glm::vec3& value) {
-        glUniform3fv(glGetUniformLocation(m_ShaderHandle, name.c_str()), 1, glm::value_ptr(value));
+        Set(GetUniform<glm::vec3>(name), value);
     }
 
     void Shader::SetVec4(const std::string& name, const glm::vec4& value) {
-        glUniform4fv(glGetUniformLocation(m_ShaderHandle, name.c_str()), 1, glm::value_ptr(value));
+        Set(GetUniform<glm::vec4>(name), value);
     }
 
     void Shader::SetMat4(const std::string& name, const glm::mat4& value) {
-        glUniformMatrix4fv(glGetUniformLocation(m_ShaderHandle, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+        Set(GetUniform<glm::mat4>(name), value);
     }
 
     void Shader::SetBool(const std::string& name, const bool& value) {
-        int realValue = 0;
-        if (value) {
-            realValue = 1;
+        Set(GetUniform<bool>(name), value);
+    }
+
+    void Shader::ReflectUniforms() {
+        int uniformCount = 0;
+        glGetProgramiv(m_ShaderHandle, GL_ACTIVE_UNIFORMS, &uniformCount);
+
+        int maxNameLength = 0;
+        glGetProgramiv(m_ShaderHandle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+        std::vector<char> nameBuffer((size_t)std::max(maxNameLength, 1));
+
+        int maxLocation = -1;
+
+        for (int i = 0; i < uniformCount; ++i) {
+            int nameLength = 0;
+            int arraySize = 0;
+            GLenum type = 0;
+            glGetActiveUniform(m_ShaderHandle, (GLuint)i, (GLsizei)nameBuffer.size(), &nameLength, &arraySize, &type, nameBuffer.data());
+
+            std::string name{ nameBuffer.data(), (size_t)nameLength };
+
+            const int location = glGetUniformLocation(m_ShaderHandle, name.c_str());
+            if (location == -1) {
+                continue; // Uniform block members
+            }
+
+            m_UniformLocations[name] = location;
+            maxLocation = std::max(maxLocation, location);
+
+            // Arrays are reported once as "name[0]", register "name" and every element
+            const size_t arraySuffix = name.rfind("[0]");
+            if (arraySuffix != std::string::npos && arraySuffix + 3 == name.size()) {
+                const std::string baseName = name.substr(0, arraySuffix);
+
+                m_UniformLocations[baseName] = location;
+
+                for (int element = 1; element < arraySize; ++element) {
+                    const std::string elementName = baseName + "[" + std::to_string(element) + "]";
+                    const int elementLocation = glGetUniformLocation(m_ShaderHandle, elementName.c_str());
+
+                    m_UniformLocations[elementName] = elementLocation;
+                    maxLocation = std::max(maxLocation, elementLocation);
+                }
+            }
+        }
+
+        m_UniformValues.resize((size_t)(maxLocation + 1));
+    }
+
+    int Shader::GetUniformLocation(const std::string& name) const {
+        const auto it = m_UniformLocations.find(name);
+        if (it == m_UniformLocations.end()) {
+            return -1;
         }
 
-        SetInt(name, realValue);
+        return it->second;
     }
 }
\ No newline at end of file
@@ -1,21 +1,60 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <glm/glm.hpp>
 
 namespace Rutile {
+    // Location of a uniform resolved ahead of time with Shader::GetUniform, the type makes sure it is only ever set
+    // with the type it was resolved as
+    template<typename T>
+    struct UniformHandle {
+        int location{ -1 };
+
+        bool IsValid() const {
+            return location != -1;
+        }
+    };
+
     class Shader {
     public:
-        Shader(const std::string& vertexShaderPath, const std::string& fragmentShaderPath, const std::string& geometryShaderPath = "");
+        // defines is inserted into every stage directly after the #version line, it is intended for #defines that
+        // need to agree with values on the CPU side
+        Shader(const std::string& vertexShaderPath, const std::string& fragmentShaderPath, const std::string& geometryShaderPath = "", const std::string& defines = "");
         Shader(const Shader& other) = delete;
         Shader(Shader&& other) noexcept = default;
         Shader& operator=(const Shader& other) = delete;
         Shader& operator=(Shader&& other) noexcept = default;
         ~Shader();
 
+        // Builds a program out of a single compute stage, defines works the same as above
+        static std::unique_ptr<Shader> Compute(const std::string& computeShaderPath, const std::string& defines = "");
+
         void Bind();
 
+        unsigned int Handle() const;
+
+        // Returns an invalid handle for names the linked program doesn't use, setting those does nothing
+        template<typename T>
+        UniformHandle<T> GetUniform(const std::string& name) const {
+            return UniformHandle<T>{ GetUniformLocation(name) };
+        }
+
+        void Set(UniformHandle<float> uniform, const float& value);
+        void Set(UniformHandle<int>   uniform, const int& value);
+        void Set(UniformHandle<bool>  uniform, const bool& value);
+
+        void Set(UniformHandle<glm::vec3> uniform, const glm::vec3& value);
+        void Set(UniformHandle<glm::vec4> uniform, const glm::vec4& value);
+        void Set(UniformHandle<glm::mat4> uniform, const glm::mat4& value);
+
+        // Look the name up in the table built at link time, prefer resolving a UniformHandle once for anything set
+        // every frame
         void SetFloat(const std::string& name, const float& value);
         void SetInt  (const std::string& name, const int& value);
 
@@ -26,6 +65,25 @@ namespace Rutile {
         void SetBool(const std::string& name, const bool& value);
 
     private:
-        unsigned int m_ShaderHandle;
+        Shader() = default;
+
+        void ReflectUniforms();
+
+        int GetUniformLocation(const std::string& name) const;
+
+        // Returns false if the uniform already holds value, so the GL call can be skipped
+        template<typename T>
+        bool UpdateCachedValue(int location, const T& value);
+
+        unsigned int m_ShaderHandle{ 0 };
+
+        std::unordered_map<std::string, int> m_UniformLocations;
+
+        struct CachedUniform {
+            std::array<uint32_t, 16> data{ };
+            bool valid{ false };
+        };
+
+        std::vector<CachedUniform> m_UniformValues; // Indexed by location
     };
 }
\ No newline at end of file
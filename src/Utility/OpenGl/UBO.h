@@ -0,0 +1,36 @@
+#pragma once
+
+namespace Rutile {
+    // Uniform buffer holding a single T, T has to match the std140 layout of the block in the shader
+    template<typename T>
+    class UBO {
+    public:
+        UBO(unsigned int bindingPoint, const T& data = T{ }) {
+            glGenBuffers(1, &m_Handle);
+            glBindBuffer(GL_UNIFORM_BUFFER, m_Handle);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(T), &data, GL_DYNAMIC_DRAW);
+
+            glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, m_Handle);
+
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+
+        ~UBO() {
+            glDeleteBuffers(1, &m_Handle);
+        }
+
+        UBO(const UBO& other) = delete;
+        UBO(UBO&& other) noexcept = default;
+        UBO& operator=(const UBO& other) = delete;
+        UBO& operator=(UBO&& other) noexcept = default;
+
+        void SetData(const T& data) {
+            glBindBuffer(GL_UNIFORM_BUFFER, m_Handle);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+
+    private:
+        unsigned int m_Handle;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "Denoiser.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Rutile {
+    void GBuffer::Resize(size_t size) {
+        normals.resize(size);
+        depths.resize(size);
+        albedos.resize(size);
+    }
+
+    void Denoiser::Resize(size_t width, size_t height) {
+        m_Width = width;
+        m_Height = height;
+
+        gBuffer.Resize(width * height);
+
+        for (std::vector<glm::vec4>& illumination : m_Illumination) {
+            illumination.resize(width * height);
+        }
+    }
+
+    void Denoiser::Demodulate(const std::vector<glm::vec4>& accumulation, const std::vector<float>& luminanceSquaredSums, size_t start, size_t length) {
+        auto illuminationAt = [&](size_t i) {
+            const glm::vec3 mean = glm::vec3{ accumulation[i] } / std::max(accumulation[i].a, 1.0f);
+
+            return gBuffer.depths[i] == 0.0f ? mean : mean / SafeAlbedo(gBuffer.albedos[i]);
+        };
+
+        for (size_t i = start; i < start + length; ++i) {
+            const glm::vec3 illumination = illuminationAt(i);
+            const float sampleCount = std::max(accumulation[i].a, 1.0f);
+
+            float variance;
+            if (sampleCount >= minimumTemporalSamples) {
+                // Variance of the mean, from the variance of the samples
+                const float meanLuminance = Luminance(glm::vec3{ accumulation[i] }) / sampleCount;
+                const float sampleVariance = std::max(luminanceSquaredSums[i] / sampleCount - meanLuminance * meanLuminance, 0.0f);
+
+                const float albedoLuminance = gBuffer.depths[i] == 0.0f ? 1.0f : Luminance(SafeAlbedo(gBuffer.albedos[i]));
+
+                variance = sampleVariance / sampleCount / (albedoLuminance * albedoLuminance);
+            } else {
+                // Spread of the surrounding pixels on the same surface
+                const int x = (int)(i % m_Width);
+                const int y = (int)(i / m_Width);
+
+                float sum = 0.0f;
+                float squaredSum = 0.0f;
+                float count = 0.0f;
+
+                for (int offsetY = -1; offsetY <= 1; ++offsetY) {
+                    for (int offsetX = -1; offsetX <= 1; ++offsetX) {
+                        const int neighbourX = x + offsetX;
+                        const int neighbourY = y + offsetY;
+
+                        if (neighbourX < 0 || neighbourY < 0 || neighbourX >= (int)m_Width || neighbourY >= (int)m_Height) {
+                            continue;
+                        }
+
+                        const size_t neighbour = (size_t)neighbourY * m_Width + (size_t)neighbourX;
+
+                        if ((gBuffer.depths[neighbour] == 0.0f) != (gBuffer.depths[i] == 0.0f)) {
+                            continue;
+                        }
+
+                        const float luminance = Luminance(illuminationAt(neighbour));
+
+                        sum += luminance;
+                        squaredSum += luminance * luminance;
+                        count += 1.0f;
+                    }
+                }
+
+                const float mean = sum / count;
+                variance = std::max(squaredSum / count - mean * mean, 0.0f);
+            }
+
+            m_Illumination[0][i] = glm::vec4{ illumination, variance };
+        }
+    }
+
+    void Denoiser::Filter(const DenoiserSettings& settings, int iteration, size_t start, size_t length) {
+        const std::vector<glm::vec4>& source = m_Illumination[iteration % 2];
+        std::vector<glm::vec4>& target = m_Illumination[(iteration + 1) % 2];
+
+        const int stepWidth = 1 << iteration;
+
+        for (size_t i = start; i < start + length; ++i) {
+            const glm::vec4 center = source[i];
+            const float centerDepth = gBuffer.depths[i];
+
+            // Nothing was hit, the background has no noise to filter
+            if (centerDepth == 0.0f) {
+                target[i] = center;
+                continue;
+            }
+
+            const glm::vec3 centerNormal = gBuffer.normals[i];
+            const float centerLuminance = Luminance(glm::vec3{ center });
+
+            const float luminanceScale = settings.luminancePhi * std::sqrt(center.a) + 1e-6f;
+
+            const int x = (int)(i % m_Width);
+            const int y = (int)(i / m_Width);
+
+            glm::vec3 colorSum{ 0.0f };
+            float varianceSum = 0.0f;
+            float weightSum = 0.0f;
+
+            for (int offsetY = -2; offsetY <= 2; ++offsetY) {
+                for (int offsetX = -2; offsetX <= 2; ++offsetX) {
+                    const int neighbourX = x + offsetX * stepWidth;
+                    const int neighbourY = y + offsetY * stepWidth;
+
+                    if (neighbourX < 0 || neighbourY < 0 || neighbourX >= (int)m_Width || neighbourY >= (int)m_Height) {
+                        continue;
+                    }
+
+                    const size_t neighbour = (size_t)neighbourY * m_Width + (size_t)neighbourX;
+                    const float neighbourDepth = gBuffer.depths[neighbour];
+
+                    if (neighbourDepth == 0.0f) {
+                        continue;
+                    }
+
+                    const glm::vec4 sample = source[neighbour];
+
+                    const float offsetLength = (float)stepWidth * std::sqrt((float)(offsetX * offsetX + offsetY * offsetY));
+
+                    const float normalWeight = std::pow(std::max(glm::dot(centerNormal, gBuffer.normals[neighbour]), 0.0f), settings.normalPhi);
+                    const float depthWeight = std::exp(-std::abs(centerDepth - neighbourDepth) / (settings.depthPhi * centerDepth * offsetLength + 1e-6f));
+                    const float luminanceWeight = std::exp(-std::abs(centerLuminance - Luminance(glm::vec3{ sample })) / luminanceScale);
+
+                    const float weight = kernel[offsetX + 2] * kernel[offsetY + 2] * normalWeight * depthWeight * luminanceWeight;
+
+                    colorSum += weight * glm::vec3{ sample };
+                    varianceSum += weight * weight * sample.a;
+                    weightSum += weight;
+                }
+            }
+
+            // The center always has a weight above zero
+            target[i] = glm::vec4{ colorSum / weightSum, varianceSum / (weightSum * weightSum) };
+        }
+    }
+
+    float Denoiser::Luminance(glm::vec3 color) {
+        return glm::dot(color, glm::vec3{ 0.2126f, 0.7152f, 0.0722f });
+    }
+
+    glm::vec3 Denoiser::SafeAlbedo(glm::vec3 albedo) {
+        return glm::max(albedo, glm::vec3{ 0.001f });
+    }
+
+    glm::vec3 Denoiser::Remodulate(const DenoiserSettings& settings, size_t pixel) const {
+        const glm::vec3 illumination = glm::vec3{ m_Illumination[settings.iterations % 2][pixel] };
+
+        return gBuffer.depths[pixel] == 0.0f ? illumination : illumination * SafeAlbedo(gBuffer.albedos[pixel]);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace Rutile {
+    // How strongly the edges of the image stop the filter, the same settings drive Denoiser and Denoise.frag
+    struct DenoiserSettings {
+        int iterations{ 5 };         // The step width doubles every iteration, 5 covers a 125 pixel wide footprint
+        float luminancePhi{ 4.0f };  // Luminance difference that is tolerated, in standard deviations
+        float normalPhi{ 128.0f };   // Power of the cosine between the normals
+        float depthPhi{ 0.01f };     // Relative difference in primary hit distance tolerated per pixel of offset
+    };
+
+    // Surface of the primary hit of every pixel, rows from the bottom of the screen up
+    struct GBuffer {
+        std::vector<glm::vec3> normals;  // Zero where the primary ray missed
+        std::vector<float> depths;       // Distance from the camera, 0 where the primary ray missed
+        std::vector<glm::vec3> albedos;  // In gamma space, like the samples
+
+        void Resize(size_t size);
+    };
+
+    // Edge avoiding a-trous wavelet filter (Dammertz et al. 2010) with the luminance weight guided by the variance of
+    // every pixel as in SVGF (Schied et al. 2017). The albedo of the primary hit is divided out before filtering so
+    // only the lighting is blurred, and multiplied back in after.
+    //
+    // Every step works on a range of pixels so that the caller can spread it over threads, but all pixels of a step
+    // have to be done before the next one starts
+    class Denoiser {
+    public:
+        void Resize(size_t width, size_t height);
+
+        GBuffer gBuffer;
+
+        // accumulation holds the sum of the samples in rgb and their count in a
+        void Demodulate(const std::vector<glm::vec4>& accumulation, const std::vector<float>& luminanceSquaredSums, size_t start, size_t length);
+        void Filter(const DenoiserSettings& settings, int iteration, size_t start, size_t length);
+
+        // The filtered color of a pixel, after the last iteration
+        glm::vec3 Remodulate(const DenoiserSettings& settings, size_t pixel) const;
+
+        static float Luminance(glm::vec3 color);
+
+    private:
+        // B3 spline, the kernel gets wider by leaving holes between these taps
+        static constexpr std::array<float, 5> kernel{ 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+        // Below this many samples the variance from the moments is too noisy, it is estimated from the neighbours
+        static constexpr float minimumTemporalSamples = 4.0f;
+
+        static glm::vec3 SafeAlbedo(glm::vec3 albedo); // Dividing by black would lose the lighting
+
+        // Filtered lighting in rgb and its variance in a, iterations read from one and write to the other
+        std::array<std::vector<glm::vec4>, 2> m_Illumination;
+
+        size_t m_Width{ 0 };
+        size_t m_Height{ 0 };
+    };
+}
\ No newline at end of file